@@ -0,0 +1,4 @@
+#!/bin/sh
+echo Generating project files...
+chmod +x tools/premake5
+tools/premake5 --file=lua/linux.lua gmake2
@@ -0,0 +1,75 @@
+workspace "Mr. Modman"
+	location "../build/"
+	targetdir "%{wks.location}/bin/%{cfg.buildcfg}-%{cfg.platform}/"
+	objdir "%{wks.location}/obj/%{prj.name}/%{cfg.buildcfg}-%{cfg.platform}/"
+
+	warnings "extra"
+
+	platforms {
+		"Linux-x64",
+	}
+
+	configurations {
+		"Release",
+		"Debug",
+	}
+
+	--x64
+	filter "platforms:Linux-x64"
+		architecture "x86_64"
+	--end
+
+	filter "Release"
+		defines "NDEBUG"
+		optimize "full"
+		symbols "off"
+
+	filter "Debug"
+		defines "DEBUG"
+		optimize "debug"
+		symbols "on"
+
+	--Portable pieces of the loader, built on Linux so they can be measured outside of a game
+	project "bench"
+		language "c++"
+		cppdialect "c++17"
+		kind "consoleapp"
+
+		includedirs {
+			"../src/bench/",
+			"../src/utils/",
+		}
+
+		files {
+			"../src/bench/**",
+		}
+
+	--Overlay hooks for Linux and Proton games, loaded into the game with LD_PRELOAD
+	project "preload"
+		targetname "modman_preload"
+		language "c++"
+		cppdialect "c++17"
+		kind "sharedlib"
+		pic "on"
+
+		includedirs {
+			"../src/utils/",
+		}
+
+		files {
+			"../src/preload/**",
+		}
+
+		links {
+			"dl",
+		}
+
+	--Opens a list of files like a game would, to check and time the preload shim
+	project "standin"
+		language "c++"
+		cppdialect "c++17"
+		kind "consoleapp"
+
+		files {
+			"../src/standin/**",
+		}
@@ -126,8 +126,11 @@ workspace "Mr. Modman"
 			"../src/app/window/**",
 			"../src/app/settings/**",
 
+			"../src/utils/chunk/**",
 			"../src/utils/fs/**",
 			"../src/utils/logger/**",
+			"../src/utils/overlay/**",
+			"../src/utils/path/**",
 
 			"../src/app/resource/**",
 		}
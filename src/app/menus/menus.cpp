@@ -3,6 +3,8 @@
 #include "fs/fs.hpp"
 #include "menus.hpp"
 #include "settings/settings.hpp"
+#include "overlay/overlay.hpp"
+#include "chunk/chunk.hpp"
 
 #ifdef _WIN32
 #include <shellapi.h>
@@ -96,6 +98,7 @@ void menus::update()
 	menus::new_game();
 	menus::new_pack();
 	menus::mods();
+	menus::layers();
 }
 
 void menus::menu_bar()
@@ -113,37 +116,36 @@ void menus::menu_bar()
 		{
 			if (ImGui::Button("Mods"))
 			{
-				//Setup temp and reset pack_mods
-				auto temp = fs::get_all_dirs(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\" + menus::current_game.pack), "|f");
-				menus::pack_mods = temp;
-
-				if (menus::pack_mods.size() >= 1)
-				{
-					menus::pack_mods.emplace_back("||");
-				}
+				menus::load_mods();
+				menus::show_mods = !menus::show_mods;
+			}
 
-				temp = fs::get_all_files(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\" + menus::current_game.pack));
-				menus::pack_mods.insert(menus::pack_mods.end(), temp.begin(), temp.end());
-				//End
+			if (ImGui::Button("Layers"))
+			{
+				menus::pack_layers = menus::pack_chain(menus::current_game.pack);
+				menus::resolved.clear();
 
-				//Global Mods
-				temp = fs::get_all_dirs(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\_global"), "|f");
-				menus::global_mods = temp;
+				std::string manifest = menus::build_manifest();
 
-				if (menus::global_mods.size() >= 1)
+				if (!manifest.empty() && overlay::load(manifest))
 				{
-					menus::global_mods.emplace_back("||");
-				}
-
-				temp = fs::get_all_files(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\_global"));
-				menus::global_mods.insert(menus::global_mods.end(), temp.begin(), temp.end());
-				//End
+					for (auto slot : overlay::entries())
+					{
+						if (!(slot->flags & overlay::flag_directory))
+						{
+							menus::resolved.push_back({ std::string(overlay::key(slot)), overlay::layer(slot->layer), slot->shadowed });
+						}
+					}
 
-				temp.clear();
+					overlay::unload();
+				}
 
-				menus::show_mods = !menus::show_mods;
+				menus::show_layers = !menus::show_layers;
 			}
 
+			//The loader writes <pack>.trace.json next to the pack folder, open it in chrome://tracing or ui.perfetto.dev
+			ImGui::Checkbox("Trace", &menus::trace_startup);
+
 			if (ImGui::Button("Play"))
 			{
 				STARTUPINFOA startup_info;
@@ -159,17 +161,76 @@ void menus::menu_bar()
 					menus::current_game.cwd = menus::current_game.cwd.erase(menus::current_game.cwd.size() - 1, 1);
 				}
 
+				menus::pack_layers = menus::pack_chain(menus::current_game.pack);
+				std::string manifest = menus::build_manifest();
+
+				std::string args = "--exe \"" + menus::current_game.path + "\"" +
+					" --cwd \"" + menus::current_game.cwd + "\"" +
+					" --game \"" + menus::current_game.name + "\"" +
+					" --modpack \"" + menus::current_game.pack + "\"";
+
+				if (!manifest.empty())
+				{
+					args.append(" --manifest \"" + manifest + "\"");
+				}
+
+				//Only needed by the loader if it has to index the trees itself
+				if (menus::pack_layers.size() > 1)
+				{
+					std::string parents;
+					for (std::size_t i = 1; i < menus::pack_layers.size(); i++)
+					{
+						parents.append(i > 1 ? "," : "").append(menus::pack_layers[i]);
+					}
+
+					args.append(" --parents \"" + parents + "\"");
+				}
+
+				if (menus::trace_startup)
+				{
+					args.append(" --trace");
+				}
+
+				//Opt in per game under [game] in its config.ini: lazy_imports = "true", eager_imports = "d3d9, dinput8", parallel_mods = "true"
+				//Prefetching the last launch's files is on unless prefetch = "false"
+				ini_t* ini = ini_load(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\config.ini").c_str());
+
+				if (ini)
+				{
+					const char* parallel = ini_get(ini, "game", "parallel_mods");
+
+					if (parallel && settings::get_boolean(parallel))
+					{
+						args.append(" --parallel-mods");
+					}
+
+					const char* prefetch = ini_get(ini, "game", "prefetch");
+
+					if (prefetch && !settings::get_boolean(prefetch))
+					{
+						args.append(" --no-prefetch");
+					}
+
+					const char* lazy = ini_get(ini, "game", "lazy_imports");
+					const char* eager = ini_get(ini, "game", "eager_imports");
+
+					if (lazy && settings::get_boolean(lazy))
+					{
+						args.append(" --lazy-imports");
+
+						if (eager)
+						{
+							args.append(" --eager \"" + std::string(eager) + "\"");
+						}
+					}
+
+					ini_free(ini);
+				}
+
 				CreateProcessA
 				(
 					fs::get_cur_dir().append("loader.exe").c_str(),
-					logger::va
-					(
-						"--exe \"%s\" --cwd \"%s\" --game \"%s\" --modpack \"%s\"",
-						menus::current_game.path.c_str(),
-						menus::current_game.cwd.c_str(),
-						menus::current_game.name.c_str(),
-						menus::current_game.pack.c_str()
-					).data(),
+					args.data(),
 					nullptr,
 					nullptr,
 					false,
@@ -186,6 +247,108 @@ void menus::menu_bar()
 	}
 }
 
+//The pack followed by its parents as declared in the game's config.ini, e.g.
+//[variant]
+//parents = "base, common"
+std::vector<std::string> menus::pack_chain(const std::string& pack)
+{
+	std::vector<std::string> chain;
+	std::vector<std::string> visiting;
+	std::string ini_file = fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\config.ini");
+
+	ini_t* ini = fs::exists(ini_file) ? ini_load(ini_file.c_str()) : nullptr;
+	menus::flatten(ini, pack, chain, visiting);
+
+	if (ini)
+	{
+		ini_free(ini);
+	}
+
+	return chain;
+}
+
+//Depth first, a pack shared by several parents is only stacked once at its first position
+void menus::flatten(ini_t* ini, const std::string& pack, std::vector<std::string>& chain, std::vector<std::string>& visiting)
+{
+	if (std::find(visiting.begin(), visiting.end(), pack) != visiting.end())
+	{
+		logger::log_warning(logger::va("Pack \"%s\" is its own parent, ignoring the cycle", pack.c_str()));
+		return;
+	}
+
+	if (pack.empty() || !pack.compare("_global") || std::find(chain.begin(), chain.end(), pack) != chain.end())
+	{
+		return;
+	}
+
+	chain.emplace_back(pack);
+
+	const char* parents = ini ? ini_get(ini, pack.c_str(), "parents") : nullptr;
+
+	if (!parents)
+	{
+		return;
+	}
+
+	visiting.emplace_back(pack);
+
+	for (auto parent : logger::split(parents, ","))
+	{
+		parent.erase(0, parent.find_first_not_of(' '));
+		parent.erase(parent.find_last_not_of(' ') + 1);
+
+		menus::flatten(ini, parent, chain, visiting);
+	}
+
+	visiting.pop_back();
+}
+
+std::string menus::build_manifest()
+{
+	std::string mods = fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\");
+	std::string manifest = fs::get_pref_dir().append("cache\\" + menus::current_game.name + "\\" + menus::current_game.pack + ".manifest");
+
+	//What the game wrote under this pack goes first, then _global always wins, then the pack, then its parents nearest first
+	std::vector<std::string> names = { overlay::write_layer, "_global" };
+	for (const auto& pack : menus::pack_layers)
+	{
+		names.emplace_back(pack);
+	}
+
+	std::vector<std::string> layers = { fs::get_pref_dir().append("saves\\" + menus::current_game.name + "\\" + menus::current_game.pack) };
+	for (std::size_t i = 1; i < names.size(); i++)
+	{
+		layers.emplace_back(mods + names[i]);
+	}
+
+	std::uint64_t fingerprint = overlay::fingerprint(layers);
+
+	//Only rebuild when the mod trees changed since the last launch
+	if (overlay::load(manifest) && overlay::manifest_fingerprint() == fingerprint)
+	{
+		overlay::unload();
+		return manifest;
+	}
+
+	//However deep the stack is it ends up as one flat table, lookups never walk the layers
+	overlay::builder builder;
+	for (std::size_t i = 0; i < layers.size(); i++)
+	{
+		builder.walk(layers[i], names[i]);
+	}
+
+	overlay::unload();
+
+	if (!overlay::save(manifest, builder.finish(fingerprint)))
+	{
+		//Most likely mapped by a running instance, let the loader index the trees itself
+		logger::log_error(logger::va("Failed to write manifest \"%s\"", manifest.c_str()));
+		return "";
+	}
+
+	return manifest;
+}
+
 void menus::file()
 {
 	if (ImGui::BeginMenu("File"))
@@ -515,11 +678,23 @@ void menus::new_pack()
 			ImGui::SameLine();
 			ImGui::InputText("##game_name", menus::pack_name_buffer, sizeof(menus::pack_name_buffer));
 
+			ImGui::Text("Parents:");
+			ImGui::SameLine();
+			ImGui::InputText("##pack_parents", menus::pack_parents_buffer, sizeof(menus::pack_parents_buffer));
+
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::BeginTooltip();
+				ImGui::Text("Packs to stack underneath, comma separated, nearest first...");
+				ImGui::EndTooltip();
+			}
+
 			ImGui::SetCursorPos({ size.x - 100, size.y - 35 });
 			if (ImGui::Button("Close##pack"))
 			{
 				menus::show_new_packs = false;
 				menus::clear_buffer(menus::pack_name_buffer, sizeof(menus::pack_name_buffer));
+				menus::clear_buffer(menus::pack_parents_buffer, sizeof(menus::pack_parents_buffer));
 			}
 			ImGui::SameLine();
 			if (ImGui::Button("Finish##pack"))
@@ -543,6 +718,17 @@ void menus::new_pack()
 				}
 
 				fs::mkdir(path);
+
+				if (std::strlen(menus::pack_parents_buffer) > 0)
+				{
+					std::string ini_file = fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\config.ini");
+
+					ini_t* ini = ini_load(ini_file.c_str());
+					ini_set(ini, name.c_str(), "parents", menus::pack_parents_buffer);
+					ini_save(ini, ini_file.c_str());
+					ini_free(ini);
+				}
+
 				menus::current_game.pack = name;
 				menus::current_game.packs.emplace_back(menus::current_game.pack);
 
@@ -550,6 +736,7 @@ void menus::new_pack()
 
 				menus::show_new_packs = false;
 				menus::clear_buffer(menus::pack_name_buffer, sizeof(menus::pack_name_buffer));
+				menus::clear_buffer(menus::pack_parents_buffer, sizeof(menus::pack_parents_buffer));
 
 			}
 			ImGui::End();
@@ -596,6 +783,13 @@ void menus::mods()
 					{
 						fs::open_folder(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\_global\\"));
 					}
+
+					if (ImGui::Button("Pack Files##global"))
+					{
+						menus::pack_layer("_global");
+						menus::load_mods();
+					}
+					menus::pack_tooltip();
 					ImGui::EndMenu();
 				}
 				ImGui::EndMenuBar();
@@ -618,6 +812,7 @@ void menus::mods()
 				}
 
 				ImGui::Text(mod.c_str());
+				menus::mod_cost("_global", mod);
 				ImGui::SameLine();
 				ImGui::SetCursorPosX(size.x - 25);
 
@@ -688,6 +883,13 @@ void menus::mods()
 					{
 						fs::open_folder(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\" + menus::current_game.pack + "\\"));
 					}
+
+					if (ImGui::Button("Pack Files##pack"))
+					{
+						menus::pack_layer(menus::current_game.pack);
+						menus::load_mods();
+					}
+					menus::pack_tooltip();
 					ImGui::EndMenu();
 				}
 				ImGui::EndMenuBar();
@@ -710,6 +912,7 @@ void menus::mods()
 				}
 
 				ImGui::Text(mod.c_str());
+				menus::mod_cost(menus::current_game.pack, mod);
 				ImGui::SameLine();
 				ImGui::SetCursorPosX(size.x - 25);
 
@@ -771,6 +974,270 @@ void menus::mods()
 	}
 }
 
+//Both lists of the Mods window, folders first, then files with the ones the last launch measured sorted by cost
+void menus::load_mods()
+{
+	//Setup temp and reset pack_mods
+	auto temp = fs::get_all_dirs(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\" + menus::current_game.pack), "|f");
+	menus::pack_mods = temp;
+
+	if (menus::pack_mods.size() >= 1)
+	{
+		menus::pack_mods.emplace_back("||");
+	}
+
+	temp = fs::get_all_files(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\" + menus::current_game.pack));
+	menus::pack_mods.insert(menus::pack_mods.end(), temp.begin(), temp.end());
+	//End
+
+	//Global Mods
+	temp = fs::get_all_dirs(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\_global"), "|f");
+	menus::global_mods = temp;
+
+	if (menus::global_mods.size() >= 1)
+	{
+		menus::global_mods.emplace_back("||");
+	}
+
+	temp = fs::get_all_files(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\_global"));
+	menus::global_mods.insert(menus::global_mods.end(), temp.begin(), temp.end());
+	//End
+
+	temp.clear();
+
+	menus::load_mod_costs();
+	menus::sort_by_cost(menus::pack_mods, menus::current_game.pack);
+	menus::sort_by_cost(menus::global_mods, "_global");
+}
+
+//Same writer as bench chunk --pack, every file big enough to be worth it becomes name.mmz and the loader serves it as name
+//Mod binaries, executables, settings, zips and the rules file are loaded or edited as plain files and stay as they are
+void menus::pack_layer(const std::string& layer)
+{
+	const auto base = std::filesystem::u8path(fs::get_pref_dir().append("mods\\" + menus::current_game.name + "\\" + layer));
+
+	auto packable = [&](const std::filesystem::path& file)
+	{
+		std::string name = file.filename().u8string();
+		logger::to_lower(name);
+
+		if (name == overlay::rules_file || logger::ends_with(name, chunk::extension) || logger::ends_with(name, ".zip") || logger::ends_with(name, ".exe"))
+		{
+			return false;
+		}
+
+		for (auto ext : overlay::module_exts)
+		{
+			if (logger::ends_with(name, ext))
+			{
+				return false;
+			}
+		}
+
+		for (auto ext : menus::settings_exts)
+		{
+			if (logger::ends_with(name, ext))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	//Collected first, removing files while the directory is walked would skip some
+	std::vector<std::filesystem::path> files;
+	std::error_code ec;
+
+	for (std::filesystem::recursive_directory_iterator it(base, std::filesystem::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (it->is_regular_file(ec) && it->file_size(ec) >= menus::pack_threshold && packable(it->path()))
+		{
+			files.emplace_back(it->path());
+		}
+	}
+
+	std::uint64_t before = 0, after = 0;
+	std::size_t count = 0;
+
+	for (const auto& file : files)
+	{
+		const auto packed = std::filesystem::path(file) += chunk::extension;
+		const auto size = std::filesystem::file_size(file, ec);
+
+		if (ec || !chunk::pack(file))
+		{
+			std::filesystem::remove(packed, ec);
+			logger::log_warning(logger::va("Could not pack \"%s\"", file.u8string().c_str()));
+			continue;
+		}
+
+		//A file that does not shrink would only cost a decode on every read
+		const auto compressed = std::filesystem::file_size(packed, ec);
+
+		if (ec || compressed >= size)
+		{
+			std::filesystem::remove(packed, ec);
+			continue;
+		}
+
+		std::filesystem::remove(file, ec);
+		before += size;
+		after += compressed;
+		count++;
+	}
+
+	logger::log_info(logger::va("Packed %zu files of %s, %llu KB to %llu KB", count, layer.c_str(), before >> 10, after >> 10));
+}
+
+void menus::pack_tooltip()
+{
+	if (ImGui::IsItemHovered())
+	{
+		ImGui::BeginTooltip();
+		ImGui::Text("Compress the files of this layer into .mmz files,");
+		ImGui::Text("the loader reads them in place of the originals");
+		ImGui::EndTooltip();
+	}
+}
+
+//Written by the loader on every launch of the pack, costliest first
+void menus::load_mod_costs()
+{
+	menus::mod_costs.clear();
+
+	std::string report = fs::get_pref_dir().append("cache\\" + menus::current_game.name + "\\" + menus::current_game.pack + ".mods.csv");
+
+	if (!fs::exists(report))
+	{
+		return;
+	}
+
+	auto lines = logger::split(fs::read(report), "\n");
+
+	for (std::size_t i = 1; i < lines.size(); i++)
+	{
+		mod_cost_t cost{};
+		int loaded = 0, consumed = 0;
+
+		if (std::sscanf(lines[i].c_str(), "%lf,%lld,%d,%d,%d,%n", &cost.ms, &cost.private_kb, &cost.threads, &cost.hooks, &loaded, &consumed) == 5 && consumed)
+		{
+			//The error never holds a comma, the path after it can
+			std::string path = lines[i].substr(consumed);
+			const auto comma = path.find(',');
+
+			if (comma == std::string::npos)
+			{
+				continue;
+			}
+
+			cost.error = path.substr(0, comma);
+			path.erase(0, comma + 1);
+
+			if (!path.empty() && path.back() == '\r')
+			{
+				path.pop_back();
+			}
+
+			cost.loaded = loaded != 0;
+			menus::mod_costs[path] = cost;
+		}
+	}
+}
+
+//Files after the folders, the ones the last launch measured go first by cost
+void menus::sort_by_cost(std::vector<std::string>& list, const std::string& layer)
+{
+	auto files = std::find(list.begin(), list.end(), "||");
+	files = files == list.end() ? list.begin() : files + 1;
+
+	auto cost = [&](const std::string& mod)
+	{
+		auto it = menus::mod_costs.find(layer + "\\" + mod);
+		return it == menus::mod_costs.end() ? -1.0 : it->second.ms;
+	};
+
+	std::stable_sort(files, list.end(), [&](const std::string& a, const std::string& b)
+	{
+		return cost(a) > cost(b);
+	});
+}
+
+void menus::mod_cost(const std::string& layer, const std::string& mod)
+{
+	auto it = menus::mod_costs.find(layer + "\\" + mod);
+
+	if (it == menus::mod_costs.end())
+	{
+		return;
+	}
+
+	const auto& cost = it->second;
+
+	ImGui::SameLine();
+	ImGui::TextDisabled(cost.loaded ? "%.0f ms" : "failed", cost.ms);
+
+	if (ImGui::IsItemHovered())
+	{
+		ImGui::BeginTooltip();
+		ImGui::Text("%.2f ms in LoadLibrary", cost.ms);
+		ImGui::Text("%lld KB private memory", cost.private_kb);
+		ImGui::Text("%d threads started", cost.threads);
+		ImGui::Text("%d hooks installed", cost.hooks);
+
+		if (!cost.error.empty())
+		{
+			ImGui::Text("Not mapped, %s", cost.error.c_str());
+		}
+
+		ImGui::EndTooltip();
+	}
+}
+
+void menus::layers()
+{
+	if (menus::show_layers)
+	{
+		ImGuiWindowFlags layers_flags = ImGuiWindowFlags_NoCollapse;
+		ImGui::SetNextWindowSize({ 500, 400 }, ImGuiCond_FirstUseEver);
+
+		if (ImGui::Begin("Layers", &menus::show_layers, layers_flags))
+		{
+			//Same order build_manifest stacks them in, what the game wrote comes before every mod
+			std::string order = std::string(overlay::write_layer) + " > _global";
+			for (const auto& pack : menus::pack_layers)
+			{
+				order.append(" > " + pack);
+			}
+
+			ImGui::Text(order.c_str());
+			menus::spacer();
+
+			//Clipped, stacks with tens of thousands of files only draw the rows on screen
+			ImGuiListClipper clipper;
+			clipper.Begin(static_cast<int>(menus::resolved.size()));
+
+			while (clipper.Step())
+			{
+				for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+				{
+					const auto& entry = menus::resolved[i];
+
+					if (entry.shadowed)
+					{
+						ImGui::Text("%s -> %s (shadows %i)", entry.path.c_str(), entry.layer.c_str(), entry.shadowed);
+					}
+					else
+					{
+						ImGui::Text("%s -> %s", entry.path.c_str(), entry.layer.c_str());
+					}
+				}
+			}
+		}
+		ImGui::End();
+	}
+}
+
 void menus::build_font(ImGuiIO& io)
 {
 	std::string font = fs::get_pref_dir().append("fonts/NotoSans-Regular.ttf");
@@ -815,16 +1282,22 @@ void menus::spacer()
 char menus::game_path_buffer[MAX_PATH];
 char menus::game_name_buffer[32];
 char menus::pack_name_buffer[32];
+char menus::pack_parents_buffer[256];
 bool menus::use_custom_dir = false;
+bool menus::trace_startup = false;
 char menus::custom_dir_buffer[MAX_PATH];
 
 bool menus::show_new_game = false;
 bool menus::show_new_packs = false;
 bool menus::show_load_packs = false;
 bool menus::show_mods = false;
+bool menus::show_layers = false;
 
 std::vector<std::string> menus::global_mods;
 std::vector<std::string> menus::pack_mods;
+std::vector<std::string> menus::pack_layers;
+std::unordered_map<std::string, mod_cost_t> menus::mod_costs;
+std::vector<resolved_t> menus::resolved;
 
 std::initializer_list<std::string> menus::settings_exts = {".ini", ".cfg"};
 
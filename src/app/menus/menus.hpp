@@ -1,11 +1,30 @@
 #pragma once
 
+#include <ini_rw.h>
+#include <unordered_map>
+
 struct game_t
 {
 	std::string name, path, cwd, pack;
 	std::vector<std::string> packs;
 };
 
+struct resolved_t
+{
+	std::string path, layer;
+	int shadowed;
+};
+
+//One row of the loader's <pack>.mods.csv, what loading the mod cost on the last launch
+struct mod_cost_t
+{
+	double ms;
+	long long private_kb;
+	int threads, hooks;
+	bool loaded;
+	std::string error; //Why the loader went through LoadLibrary instead of mapping it
+};
+
 struct color_t
 {
 	int r, g, b, a;
@@ -26,18 +45,26 @@ public:
 	static char game_path_buffer[MAX_PATH];
 	static char game_name_buffer[32];
 	static char pack_name_buffer[32];
+	static char pack_parents_buffer[256];
 	static bool use_custom_dir;
 	static char custom_dir_buffer[MAX_PATH];
+	static bool trace_startup;
 
 	static std::initializer_list<std::string> settings_exts;
 	static std::vector<std::string> console_output;
 	static std::vector<std::string> games;
 	static std::vector<std::string> global_mods;
 	static std::vector<std::string> pack_mods;
+	static std::vector<std::string> pack_layers;
+	static std::vector<resolved_t> resolved;
+	static std::unordered_map<std::string, mod_cost_t> mod_costs;
 	static game_t current_game;
 
 	static std::string default_game;
 
+	//Files smaller than this are left alone by Pack Files, they gain little and a chunk is decoded whole on every read
+	static constexpr std::uintmax_t pack_threshold = 64 * 1024;
+
 	static color_t background_col;
 
 private:
@@ -50,6 +77,15 @@ private:
 	}
 
 	static void menu_bar();
+	static std::vector<std::string> pack_chain(const std::string& pack);
+	static void flatten(ini_t* ini, const std::string& pack, std::vector<std::string>& chain, std::vector<std::string>& visiting);
+	static std::string build_manifest();
+	static void load_mods();
+	static void load_mod_costs();
+	static void pack_layer(const std::string& layer);
+	static void pack_tooltip();
+	static void sort_by_cost(std::vector<std::string>& list, const std::string& layer);
+	static void mod_cost(const std::string& layer, const std::string& mod);
 	static void file();
 	static void packs();
 
@@ -64,6 +100,7 @@ private:
 	static void spacer();
 
 	static void mods();
+	static void layers();
 
 	static void console();
 
@@ -71,4 +108,5 @@ private:
 	static bool show_new_packs;
 	static bool show_load_packs;
 	static bool show_mods;
+	static bool show_layers;
 };
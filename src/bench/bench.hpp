@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Tiny benchmark harness, every suite registers itself and is picked by name on the command line
+class bench
+{
+public:
+	typedef void (*suite_fn)(const std::vector<std::string>& args);
+
+	struct suite_t
+	{
+		const char* name;
+		suite_fn fn;
+	};
+
+	struct registrar
+	{
+		registrar(const char* name, suite_fn fn)
+		{
+			bench::suites().push_back({ name, fn });
+		}
+	};
+
+	static std::vector<suite_t>& suites()
+	{
+		static std::vector<suite_t> suites;
+		return suites;
+	}
+
+	static void section(const char* name)
+	{
+		std::printf("\n[ %s ]\n", name);
+	}
+
+	//Calls fn until enough time has passed to get a stable number and prints the average cost of a single op
+	template <typename T> static double run(const char* name, std::size_t ops_per_call, T&& fn)
+	{
+		fn();
+
+		std::size_t calls = 0;
+		const auto start = clock::now();
+		auto elapsed = std::chrono::duration<double, std::nano>(0);
+
+		do
+		{
+			fn();
+			calls++;
+			elapsed = clock::now() - start;
+		} while (elapsed.count() < bench::min_time_ns);
+
+		const double ns = elapsed.count() / (static_cast<double>(calls) * ops_per_call);
+		std::printf("  %-44s %12.2f ns/op\n", name, ns);
+		return ns;
+	}
+
+	//Keeps results alive so the optimizer cannot drop the work being measured
+	static void keep(std::uint64_t value)
+	{
+		bench::sink = bench::sink + value;
+	}
+
+	typedef std::chrono::steady_clock clock;
+
+	inline static double min_time_ns = 2.5e8;
+
+private:
+	inline static volatile std::uint64_t sink = 0;
+};
+
+#define BENCH_SUITE(name, fn) static bench::registrar bench_##fn(name, fn)
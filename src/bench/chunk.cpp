@@ -0,0 +1,192 @@
+#include "bench.hpp"
+
+#include "chunk/chunk.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+namespace
+{
+	typedef std::chrono::duration<double> seconds;
+
+	//Something shaped like a texture pack, runs of near identical blocks with noisy stretches in between
+	std::vector<char> sample_data(std::size_t size)
+	{
+		std::mt19937 rng(1337);
+		std::vector<char> data(size);
+		char block[16];
+
+		for (std::size_t i = 0; i < size;)
+		{
+			const std::size_t run = std::min<std::size_t>(size - i, 512 + rng() % 8192);
+
+			if (rng() % 4 == 0)
+			{
+				for (std::size_t j = 0; j < run; j++)
+				{
+					data[i + j] = static_cast<char>(rng());
+				}
+			}
+			else
+			{
+				for (auto& byte : block)
+				{
+					byte = static_cast<char>(rng());
+				}
+
+				for (std::size_t j = 0; j < run; j++)
+				{
+					data[i + j] = (j % 61 == 0) ? static_cast<char>(rng()) : block[j % sizeof(block)];
+				}
+			}
+
+			i += run;
+		}
+
+		return data;
+	}
+
+	double mb_per_s(std::size_t bytes, seconds elapsed)
+	{
+		return bytes / elapsed.count() / (1024.0 * 1024.0);
+	}
+
+	//The bench keeps the .mmz in memory, what is measured is the chunk engine and not the disk under it
+	chunk::source_fn memory_source(const std::vector<char>& packed)
+	{
+		return [&packed](std::uint64_t offset, void* out, std::uint32_t size)
+		{
+			if (offset + size > packed.size())
+			{
+				return false;
+			}
+
+			std::memcpy(out, packed.data() + offset, size);
+			return true;
+		};
+	}
+
+	//Reads the whole file front to back in requests of size bytes, a fresh reader each pass so nothing is cached going in
+	void sequential(const std::vector<char>& data, const std::vector<char>& packed, std::size_t request)
+	{
+		std::vector<char> buffer(request);
+		std::size_t passes = 0;
+		const auto start = bench::clock::now();
+
+		do
+		{
+			chunk::reader view;
+			view.open(memory_source(packed));
+
+			for (std::uint64_t offset = 0; offset < view.size(); offset += request)
+			{
+				bench::keep(view.read(offset, buffer.data(), request));
+			}
+
+			passes++;
+		} while (bench::clock::now() - start < std::chrono::nanoseconds(static_cast<long long>(bench::min_time_ns)));
+
+		const auto elapsed = seconds(bench::clock::now() - start);
+		std::printf("  %-44s %9.1f MB/s\n", ("sequential, " + std::to_string(request >> 10) + " KB reads").c_str(), mb_per_s(data.size() * passes, elapsed));
+	}
+
+	//Small reads at random offsets, mostly in chunks the cache does not have, which is the worst a game can do to it
+	void random_seeks(const std::vector<char>& data, const std::vector<char>& packed)
+	{
+		chunk::reader view;
+		view.open(memory_source(packed));
+
+		std::mt19937_64 rng(42);
+		std::vector<double> samples;
+		std::vector<char> buffer(4096);
+		bool matches = true;
+
+		for (std::size_t i = 0; i < 20000; i++)
+		{
+			const std::uint64_t offset = rng() % (data.size() - buffer.size());
+
+			const auto start = bench::clock::now();
+			const auto read = view.read(offset, buffer.data(), buffer.size());
+			const auto end = bench::clock::now();
+
+			matches = matches && read == buffer.size() && !std::memcmp(buffer.data(), data.data() + offset, read);
+			samples.emplace_back(std::chrono::duration<double, std::micro>(end - start).count());
+		}
+
+		std::sort(samples.begin(), samples.end());
+		std::printf("  %-44s %9.1f / %.1f us%s\n", "random 4 KB reads, p50 / p99", samples[samples.size() / 2], samples[samples.size() * 99 / 100],
+			matches ? "" : " (MISMATCH)");
+	}
+
+	void report(const std::vector<char>& data, std::uint32_t chunk_size)
+	{
+		bench::section(("chunk, " + std::to_string(chunk_size >> 10) + " KB chunks").c_str());
+
+		auto start = bench::clock::now();
+		const auto packed = chunk::pack(data.data(), data.size(), chunk_size);
+		const auto packing = seconds(bench::clock::now() - start);
+
+		std::printf("  %zu MB to %.1f MB (%.1f%%), packed at %.1f MB/s\n", data.size() >> 20, packed.size() / (1024.0 * 1024.0),
+			100.0 * packed.size() / data.size(), mb_per_s(data.size(), packing));
+
+		//Straight through every chunk on this thread, the ceiling for anything the reader does
+		std::vector<char> out(data.size());
+		std::size_t passes = 0;
+		start = bench::clock::now();
+
+		do
+		{
+			chunk::reader view;
+			view.open(memory_source(packed));
+			bench::keep(view.read(0, out.data(), out.size()));
+			passes++;
+		} while (bench::clock::now() - start < std::chrono::nanoseconds(static_cast<long long>(bench::min_time_ns)));
+
+		std::printf("  %-44s %9.1f MB/s%s\n", "one read of the whole file", mb_per_s(data.size() * passes, seconds(bench::clock::now() - start)),
+			out == data ? "" : " (MISMATCH)");
+
+		sequential(data, packed, 4 * 1024);
+		sequential(data, packed, 64 * 1024);
+		random_seeks(data, packed);
+	}
+
+	//bench chunk [file] [--pack]
+	//Without a file a 64 MB sample is generated, either way it is packed at a few chunk sizes and read back through the reader
+	//--pack writes file.mmz next to the file instead, that is all it takes to store a layer file compressed
+	void chunk_suite(const std::vector<std::string>& args)
+	{
+		if (args.size() > 1 && args[1] == "--pack")
+		{
+			std::printf("  %s%s: %s\n", args[0].c_str(), chunk::extension, chunk::pack(args[0]) ? "written" : "failed");
+			return;
+		}
+
+		std::vector<char> data;
+
+		if (!args.empty())
+		{
+			std::ifstream in(args[0], std::ios::binary);
+			data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+			if (data.size() < 64 * 1024)
+			{
+				std::printf("  %s is too small to measure\n", args[0].c_str());
+				return;
+			}
+		}
+		else
+		{
+			data = sample_data(64 * 1024 * 1024);
+		}
+
+		std::printf("  %u decode workers\n", chunk::pool::shared().size());
+
+		for (std::uint32_t chunk_size : { 16 * 1024, 64 * 1024, 256 * 1024 })
+		{
+			report(data, chunk_size);
+		}
+	}
+}
+
+BENCH_SUITE("chunk", chunk_suite);
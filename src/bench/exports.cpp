@@ -0,0 +1,145 @@
+#include "bench.hpp"
+
+#include "pe/exports.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace
+{
+	template <typename T> void put(std::vector<std::uint8_t>& out, std::size_t offset, T value)
+	{
+		std::memcpy(&out[offset], &value, sizeof(T));
+	}
+
+	//A mapped module with count named exports, laid out the way the linker does it with the name table sorted
+	std::vector<std::uint8_t> sample_module(const std::vector<std::string>& names)
+	{
+		const std::uint32_t count = static_cast<std::uint32_t>(names.size());
+		const std::uint32_t directory = 0x1000, functions = directory + 40, table = functions + count * 4, ordinals = table + count * 4;
+		std::uint32_t text = ordinals + count * 2;
+
+		std::size_t size = text;
+		for (const auto& name : names)
+		{
+			size += name.size() + 1;
+		}
+
+		std::vector<std::uint8_t> image((size + 0xFFF) & ~std::size_t(0xFFF));
+		put<std::uint16_t>(image, 0, 0x5A4D);
+		put<std::uint32_t>(image, 0x3C, 0x80);
+		put<std::uint32_t>(image, 0x80, 0x4550);
+		put<std::uint16_t>(image, 0x84, pe::machine_i386);
+		put<std::uint16_t>(image, 0x94, 224);
+		put<std::uint16_t>(image, 0x98, 0x10B);
+		put<std::uint32_t>(image, 0x98 + 56, static_cast<std::uint32_t>(image.size()));
+		put<std::uint32_t>(image, 0x98 + 60, 0x400);
+		put<std::uint32_t>(image, 0x98 + 92, 16);
+		put<std::uint32_t>(image, 0x98 + 96, directory);
+		put<std::uint32_t>(image, 0x98 + 100, static_cast<std::uint32_t>(size) - directory);
+
+		put<std::uint32_t>(image, directory + 16, 1);
+		put<std::uint32_t>(image, directory + 20, count);
+		put<std::uint32_t>(image, directory + 24, count);
+		put<std::uint32_t>(image, directory + 28, functions);
+		put<std::uint32_t>(image, directory + 32, table);
+		put<std::uint32_t>(image, directory + 36, ordinals);
+
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			put<std::uint32_t>(image, functions + i * 4, 0x100000 + i * 16);
+			put<std::uint32_t>(image, table + i * 4, text);
+			put<std::uint16_t>(image, ordinals + i * 2, static_cast<std::uint16_t>(i));
+			std::memcpy(&image[text], names[i].c_str(), names[i].size() + 1);
+			text += static_cast<std::uint32_t>(names[i].size() + 1);
+		}
+
+		return image;
+	}
+
+	//What GetProcAddress does for a name, a binary search over the sorted name table on every call
+	std::uint32_t binary_search(const std::uint8_t* base, const char* name)
+	{
+		std::uint32_t directory, count, functions, table, ordinals;
+		std::memcpy(&directory, base + 0x98 + 96, 4);
+		std::memcpy(&count, base + directory + 24, 4);
+		std::memcpy(&functions, base + directory + 28, 4);
+		std::memcpy(&table, base + directory + 32, 4);
+		std::memcpy(&ordinals, base + directory + 36, 4);
+
+		std::uint32_t low = 0, high = count;
+		while (low < high)
+		{
+			const std::uint32_t middle = (low + high) / 2;
+			const auto entry = reinterpret_cast<const char*>(base + reinterpret_cast<const std::uint32_t*>(base + table)[middle]);
+			const int order = std::strcmp(name, entry);
+
+			if (!order)
+			{
+				return reinterpret_cast<const std::uint32_t*>(base + functions)[reinterpret_cast<const std::uint16_t*>(base + ordinals)[middle]];
+			}
+
+			(order < 0 ? high : low) = order < 0 ? middle : middle + 1;
+		}
+
+		return 0;
+	}
+
+	void exports_suite(const std::vector<std::string>&)
+	{
+		static const char* prefixes[] = { "Create", "Get", "Set", "Query", "Reg", "Nt", "Rtl", "Find", "Enum", "Wait" };
+		static const char* stems[] = { "File", "Window", "Process", "Thread", "Value", "Key", "Heap", "Object", "Event", "Module" };
+
+		for (std::size_t count : { 256, 2048, 8192 })
+		{
+			std::mt19937 rng(1337);
+			std::vector<std::string> names;
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				names.emplace_back(std::string(prefixes[rng() % 10]) + stems[rng() % 10] + std::to_string(i) + (i & 1 ? "W" : "A"));
+			}
+
+			std::sort(names.begin(), names.end());
+			names.erase(std::unique(names.begin(), names.end()), names.end());
+
+			const auto image = sample_module(names);
+
+			//Games import a slice of each module, a few thousand thunks overall
+			std::vector<std::string> imports;
+			for (std::size_t i = 0; i < 4096; i++)
+			{
+				imports.emplace_back(names[rng() % names.size()]);
+			}
+
+			bench::section(("exports, " + std::to_string(names.size()) + " names").c_str());
+
+			bench::run("name lookup (binary search per call)", imports.size(), [&]()
+			{
+				for (const auto& name : imports)
+				{
+					bench::keep(binary_search(image.data(), name.c_str()));
+				}
+			});
+
+			bench::run("parse export table once", 1, [&]()
+			{
+				exports table(image.data());
+				bench::keep(table.size());
+			});
+
+			const exports table(image.data());
+			bench::run("name lookup (hash map)", imports.size(), [&]()
+			{
+				for (const auto& name : imports)
+				{
+					exports::export_t found{};
+					table.find(name, found);
+					bench::keep(found.rva);
+				}
+			});
+		}
+	}
+}
+
+BENCH_SUITE("exports", exports_suite);
@@ -0,0 +1,168 @@
+#include "bench.hpp"
+
+#include "overlay/glob.hpp"
+
+#include <random>
+
+namespace
+{
+	//Plain recursive matcher with the same syntax as glob, what testing every rule in turn would cost
+	bool naive(std::string_view pattern, std::string_view path)
+	{
+		while (!pattern.empty())
+		{
+			if (pattern[0] == '*')
+			{
+				const bool deep = pattern.size() > 1 && pattern[1] == '*';
+				pattern.remove_prefix(deep ? 2 : 1);
+
+				if (deep && !pattern.empty() && pattern[0] == '\\')
+				{
+					pattern.remove_prefix(1);
+
+					if (naive(pattern, path))
+					{
+						return true;
+					}
+
+					for (std::size_t i = 1; i < path.size(); i++)
+					{
+						if (path[i] == '\\' && naive(pattern, path.substr(i + 1)))
+						{
+							return true;
+						}
+					}
+
+					return false;
+				}
+
+				for (std::size_t i = 0;; i++)
+				{
+					if (naive(pattern, path.substr(i)))
+					{
+						return true;
+					}
+
+					if (i == path.size() || (!deep && path[i] == '\\'))
+					{
+						return false;
+					}
+				}
+			}
+
+			if (path.empty() || (pattern[0] == '?' ? path[0] == '\\' : pattern[0] != path[0]))
+			{
+				return false;
+			}
+
+			pattern.remove_prefix(1);
+			path.remove_prefix(1);
+		}
+
+		return path.empty();
+	}
+
+	//Per folder extension rules plus name rules anywhere in the tree, the two shapes serve and ignore lines take
+	std::vector<std::string> sample_rules(std::size_t count)
+	{
+		std::vector<std::string> rules;
+		char buffer[64];
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (i & 1)
+			{
+				std::snprintf(buffer, sizeof(buffer), "**\\file%04u.*", static_cast<unsigned>(i));
+			}
+			else
+			{
+				std::snprintf(buffer, sizeof(buffer), "video%04u\\**\\*.bik", static_cast<unsigned>(i));
+			}
+
+			rules.emplace_back(buffer);
+		}
+
+		return rules;
+	}
+
+	std::vector<std::string> sample_paths(std::size_t rules, std::size_t count, std::mt19937& rng)
+	{
+		std::vector<std::string> paths;
+		char buffer[128];
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			const unsigned n = static_cast<unsigned>(rng() % (rules * 2));
+
+			switch (rng() % 3)
+			{
+			case 0:
+				std::snprintf(buffer, sizeof(buffer), "video%04u\\cutscenes\\intro_%u.bik", n, n);
+				break;
+			case 1:
+				std::snprintf(buffer, sizeof(buffer), "data\\levels\\file%04u.dat", n);
+				break;
+			default:
+				std::snprintf(buffer, sizeof(buffer), "textures\\characters\\hero_%u_diffuse.dds", n);
+				break;
+			}
+
+			paths.emplace_back(buffer);
+		}
+
+		return paths;
+	}
+
+	void glob_suite(const std::vector<std::string>&)
+	{
+		for (std::size_t count : { 4, 64, 1024 })
+		{
+			std::mt19937 rng(1337);
+			const auto rules = sample_rules(count);
+			const auto paths = sample_paths(count, 1024, rng);
+
+			glob automaton;
+			for (std::size_t i = 0; i < rules.size(); i++)
+			{
+				automaton.add(rules[i], static_cast<std::uint32_t>(i));
+			}
+
+			automaton.compile();
+
+			bench::section(("glob, " + std::to_string(count) + " rules").c_str());
+
+			bench::run("first match (sequential naive)", paths.size(), [&]()
+			{
+				for (const auto& p : paths)
+				{
+					std::uint32_t value = ~0u;
+
+					for (std::size_t i = 0; i < rules.size(); i++)
+					{
+						if (naive(rules[i], p))
+						{
+							value = static_cast<std::uint32_t>(i);
+							break;
+						}
+					}
+
+					bench::keep(value);
+				}
+			});
+
+			bench::run("first match (dfa)", paths.size(), [&]()
+			{
+				for (const auto& p : paths)
+				{
+					std::uint32_t value = ~0u;
+					automaton.match(p, value);
+					bench::keep(value);
+				}
+			});
+
+			std::printf("  %-44s %12zu\n", "dfa states built", automaton.states());
+		}
+	}
+}
+
+BENCH_SUITE("glob", glob_suite);
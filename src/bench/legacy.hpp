@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <regex>
+#include <string>
+#include <vector>
+
+//Reference copies of the helpers the loader and path kernels replaced, kept so the benchmarks have a baseline
+class legacy
+{
+public:
+	static void to_lower(std::string& string)
+	{
+		std::for_each(string.begin(), string.end(), ([](char& c)
+		{
+			c = std::tolower(c);
+		}));
+	}
+
+	static bool ends_with(std::string const& value, std::string const& ending)
+	{
+		if (ending.size() > value.size()) return false;
+		return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+	}
+
+	static std::string replace(std::string const& in, std::string const& from, std::string const& to)
+	{
+		return std::regex_replace(in, std::regex(from), to);
+	}
+
+	static std::uint64_t fnv1a(const std::string& key)
+	{
+		std::uint64_t hash = 0xCBF29CE484222325ull;
+
+		for (auto c : key)
+		{
+			hash ^= static_cast<std::uint8_t>(c);
+			hash *= 0x100000001B3ull;
+		}
+
+		return hash;
+	}
+
+	//How loader::load used to get the exe into memory before the sections were copied out of it
+	static std::vector<std::uint8_t> read_file(const std::string& name)
+	{
+		std::ifstream bin(name, std::ifstream::binary);
+
+		bin.seekg(0, bin.end);
+		auto binary_size = bin.tellg();
+		bin.seekg(0, bin.beg);
+
+		std::vector<std::uint8_t> executable_buffer;
+		executable_buffer.resize(binary_size);
+
+		bin.read(reinterpret_cast<char*>(&executable_buffer[0]), binary_size);
+		return executable_buffer;
+	}
+};
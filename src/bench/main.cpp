@@ -0,0 +1,44 @@
+#include "bench.hpp"
+
+#include <cstring>
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> args(argv + 1, argv + argc);
+	std::string selected = args.empty() ? "" : args[0];
+
+	if (selected == "--help" || selected == "-h")
+	{
+		std::printf("usage: bench [suite] [suite args...]\nsuites:");
+		for (const auto& suite : bench::suites())
+		{
+			std::printf(" %s", suite.name);
+		}
+		std::printf("\n");
+		return 0;
+	}
+
+	if (!selected.empty())
+	{
+		args.erase(args.begin());
+	}
+
+	bool found = false;
+	for (const auto& suite : bench::suites())
+	{
+		if (selected.empty() || selected == suite.name)
+		{
+			bench::section(suite.name);
+			suite.fn(args);
+			found = true;
+		}
+	}
+
+	if (!found)
+	{
+		std::printf("unknown suite \"%s\"\n", selected.c_str());
+		return 1;
+	}
+
+	return 0;
+}
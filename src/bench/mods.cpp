@@ -0,0 +1,300 @@
+#include "bench.hpp"
+
+#include "pe/mapper.hpp"
+
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <filesystem>
+#include <fstream>
+#endif
+
+namespace
+{
+	//Real kernel32 exports so the images also load through LoadLibraryA
+	const char* kernel32_names[] =
+	{
+		"GetTickCount", "GetCurrentThreadId", "GetCurrentProcessId", "Sleep", "GetLastError", "SetLastError", "CloseHandle", "CreateFileA",
+		"CreateFileW", "ReadFile", "WriteFile", "GetFileSize", "SetFilePointer", "GetModuleHandleA", "GetModuleHandleW", "GetProcAddress",
+		"LoadLibraryA", "LoadLibraryW", "FreeLibrary", "VirtualAlloc", "VirtualFree", "VirtualProtect", "VirtualQuery", "HeapAlloc",
+		"HeapFree", "GetProcessHeap", "HeapCreate", "HeapDestroy", "CreateThread", "ExitThread", "TerminateProcess", "GetCurrentProcess",
+		"GetCurrentThread", "WaitForSingleObject", "WaitForMultipleObjects", "CreateEventA", "CreateEventW", "SetEvent", "ResetEvent", "CreateMutexA",
+		"ReleaseMutex", "InitializeCriticalSection", "EnterCriticalSection", "LeaveCriticalSection", "DeleteCriticalSection", "QueryPerformanceCounter", "QueryPerformanceFrequency", "GetSystemTimeAsFileTime",
+		"GetModuleFileNameA", "GetModuleFileNameW", "GetCommandLineA", "GetCommandLineW", "GetEnvironmentVariableA", "MultiByteToWideChar", "WideCharToMultiByte", "lstrlenA",
+		"lstrlenW", "GetFileAttributesA", "GetFileAttributesW", "FindFirstFileA", "FindNextFileA", "FindClose", "OutputDebugStringA", "IsDebuggerPresent",
+	};
+
+	constexpr std::uint32_t image_base = 0x10000000;
+	constexpr std::uint32_t alignment = 0x1000;
+
+	template <typename T> void put(std::vector<std::uint8_t>& out, std::size_t offset, T value)
+	{
+		std::memcpy(&out[offset], &value, sizeof(T));
+	}
+
+	std::uint32_t align(std::uint32_t value)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	//An ASI the size of a typical one: code full of absolute addresses, every one with a relocation, and kernel32 imports
+	//Sections are file aligned to the page so the file offset of everything is its rva
+	std::vector<std::uint8_t> synthetic_asi(std::uint32_t code_size)
+	{
+		const std::uint32_t import_count = sizeof(kernel32_names) / sizeof(kernel32_names[0]);
+
+		const std::uint32_t text = alignment;
+		const std::uint32_t idata = text + align(code_size);
+
+		//Descriptor pair, lookup and address tables, the dll name, then hint/name entries
+		const std::uint32_t lookup = idata + 40, address = lookup + (import_count + 1) * 4, dll = address + (import_count + 1) * 4;
+		std::uint32_t names = dll + 16;
+		std::uint32_t idata_size = names - idata;
+
+		for (auto name : kernel32_names)
+		{
+			idata_size += 2 + static_cast<std::uint32_t>(std::strlen(name)) + 1 + 1;
+		}
+
+		const std::uint32_t reloc = idata + align(idata_size);
+		const std::uint32_t pages = align(code_size) / alignment;
+		const std::uint32_t slots = alignment / 16;
+		const std::uint32_t reloc_size = pages * (8 + slots * 2);
+		const std::uint32_t size = reloc + align(reloc_size);
+
+		std::vector<std::uint8_t> image(size);
+
+		put<std::uint16_t>(image, 0, 0x5A4D);
+		put<std::uint32_t>(image, 0x3C, 0x80);
+		put<std::uint32_t>(image, 0x80, 0x4550);
+
+		//File header, DLL | 32BIT_MACHINE | EXECUTABLE_IMAGE
+		put<std::uint16_t>(image, 0x84, pe::machine_i386);
+		put<std::uint16_t>(image, 0x86, 3);
+		put<std::uint16_t>(image, 0x94, 224);
+		put<std::uint16_t>(image, 0x96, 0x2102);
+
+		const std::size_t optional = 0x98;
+		put<std::uint16_t>(image, optional, 0x10B);
+		put<std::uint32_t>(image, optional + 4, code_size);
+		put<std::uint32_t>(image, optional + 16, text);
+		put<std::uint32_t>(image, optional + 20, text);
+		put<std::uint32_t>(image, optional + 28, image_base);
+		put<std::uint32_t>(image, optional + 32, alignment);
+		put<std::uint32_t>(image, optional + 36, alignment);
+		put<std::uint16_t>(image, optional + 40, 6);
+		put<std::uint16_t>(image, optional + 48, 6);
+		put<std::uint32_t>(image, optional + 56, size);
+		put<std::uint32_t>(image, optional + 60, alignment);
+		put<std::uint16_t>(image, optional + 68, 2);
+		put<std::uint16_t>(image, optional + 70, 0x40);
+		put<std::uint32_t>(image, optional + 72, 0x100000);
+		put<std::uint32_t>(image, optional + 76, 0x1000);
+		put<std::uint32_t>(image, optional + 80, 0x100000);
+		put<std::uint32_t>(image, optional + 84, 0x1000);
+		put<std::uint32_t>(image, optional + 92, 16);
+		put<std::uint32_t>(image, optional + 96 + 8, idata);
+		put<std::uint32_t>(image, optional + 96 + 12, 40);
+		put<std::uint32_t>(image, optional + 96 + 40, reloc);
+		put<std::uint32_t>(image, optional + 96 + 44, reloc_size);
+
+		const struct
+		{
+			const char* name;
+			std::uint32_t rva, size, characteristics;
+		} sections[] =
+		{
+			{ ".text", text, code_size, 0xE0000020 },
+			{ ".idata", idata, idata_size, 0xC0000040 },
+			{ ".reloc", reloc, reloc_size, 0x42000040 },
+		};
+
+		for (std::size_t i = 0; i < 3; i++)
+		{
+			const std::size_t header = optional + 224 + i * sizeof(pe::section_t);
+			std::memcpy(&image[header], sections[i].name, std::strlen(sections[i].name));
+			put<std::uint32_t>(image, header + 8, sections[i].size);
+			put<std::uint32_t>(image, header + 12, sections[i].rva);
+			put<std::uint32_t>(image, header + 16, align(sections[i].size));
+			put<std::uint32_t>(image, header + 20, sections[i].rva);
+			put<std::uint32_t>(image, header + 36, sections[i].characteristics);
+		}
+
+		//DllMain: mov eax, 1; ret 12, then an absolute address every 16 bytes
+		const std::uint8_t entry[] = { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC2, 0x0C, 0x00 };
+		std::memcpy(&image[text], entry, sizeof(entry));
+
+		for (std::uint32_t offset = 16; offset + 4 <= code_size; offset += 16)
+		{
+			put<std::uint32_t>(image, text + offset, image_base + text + offset);
+		}
+
+		put<std::uint32_t>(image, idata, lookup);
+		put<std::uint32_t>(image, idata + 12, dll);
+		put<std::uint32_t>(image, idata + 16, address);
+		std::memcpy(&image[dll], "kernel32.dll", 12);
+
+		for (std::uint32_t i = 0; i < import_count; i++)
+		{
+			put<std::uint32_t>(image, lookup + i * 4, names);
+			put<std::uint32_t>(image, address + i * 4, names);
+			std::memcpy(&image[names + 2], kernel32_names[i], std::strlen(kernel32_names[i]));
+			names += 2 + static_cast<std::uint32_t>(std::strlen(kernel32_names[i])) + 1;
+			names += names & 1;
+		}
+
+		for (std::uint32_t page = 0; page < pages; page++)
+		{
+			const std::size_t block = reloc + page * (8 + slots * 2);
+			put<std::uint32_t>(image, block, text + page * alignment);
+			put<std::uint32_t>(image, block + 4, 8 + slots * 2);
+
+			for (std::uint32_t slot = 0; slot < slots; slot++)
+			{
+				const std::uint32_t offset = page * alignment + slot * 16;
+				const bool used = offset >= 16 && offset + 4 <= code_size;
+				put<std::uint16_t>(image, block + 8 + slot * 2, static_cast<std::uint16_t>(used ? (3 << 12) | (slot * 16) : 0));
+			}
+		}
+
+		return image;
+	}
+
+	void bench_mods(const std::vector<std::string>& args)
+	{
+		const std::size_t count = args.size() > 0 ? std::stoul(args[0]) : 64;
+		const std::uint32_t code_size = args.size() > 1 ? std::stoul(args[1]) * 1024 : 256 * 1024;
+		const unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+
+		const auto file = synthetic_asi(code_size);
+		const pe image(file.data(), file.size());
+
+		std::printf("  %zu images of %u KB, %u imports and %u relocations each, %u hardware threads\n",
+			count, static_cast<std::uint32_t>(file.size() / 1024), static_cast<std::uint32_t>(sizeof(kernel32_names) / sizeof(kernel32_names[0])), code_size / 16 - 1, hardware);
+
+		//Every image lands somewhere other than its base, like all but the first ASI would
+		std::vector<std::unique_ptr<std::uint8_t[]>> targets;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			targets.emplace_back(new std::uint8_t[image.size_of_image()]);
+		}
+
+		std::unordered_map<std::string, std::uint64_t> table;
+		for (auto name : kernel32_names)
+		{
+			table.emplace(name, 0x70000000 + table.size() * 16);
+		}
+
+		const mapper::resolver_t resolve = [&](const char*, const char* name, std::uint16_t) -> std::uint64_t
+		{
+			const auto it = table.find(name);
+			return it == table.end() ? 0 : it->second;
+		};
+
+		const auto map_one = [&](std::size_t i)
+		{
+			std::string error;
+			if (!mapper::map(image, targets[i].get(), 0x20000000 + i * image.size_of_image(), resolve, error))
+			{
+				std::printf("  map failed: %s\n", error.c_str());
+			}
+		};
+
+		//Spot check one mapped image before timing, a relocated address and the first import slot
+		{
+			map_one(0);
+
+			std::uint32_t relocated, bound, lookup;
+			std::memcpy(&relocated, &targets[0][alignment + 16], 4);
+			std::memcpy(&lookup, &targets[0][image.directory(pe::directory_import).rva + 16], 4);
+			std::memcpy(&bound, &targets[0][lookup], 4);
+
+			const bool good = relocated == 0x20000000 + alignment + 16 && bound == table[kernel32_names[0]];
+			std::printf("  mapped image %s\n", good ? "checks out" : "is WRONG");
+		}
+
+		bench::run("map images, one after another", count, [&]()
+		{
+			for (std::size_t i = 0; i < count; i++)
+			{
+				map_one(i);
+			}
+		});
+
+		for (unsigned threads : { 2u, 4u, hardware })
+		{
+			char name[64];
+			std::snprintf(name, sizeof(name), "map images, %u thread pool", threads);
+
+			bench::run(name, count, [&]()
+			{
+				mapper::parallel(count, threads, map_one);
+			});
+		}
+
+#ifdef _WIN32
+		//The real comparison, LoadLibraryA one after another against mapping on the pool and DllMain in order
+		const auto folder = std::filesystem::temp_directory_path() / "mr.modman.bench";
+		std::filesystem::create_directories(folder);
+
+		std::vector<std::string> paths;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			paths.emplace_back((folder / ("synthetic" + std::to_string(i) + ".asi")).string());
+			std::ofstream(paths.back(), std::ios::binary).write(reinterpret_cast<const char*>(file.data()), file.size());
+		}
+
+		bench::run("LoadLibraryA, one after another", count, [&]()
+		{
+			std::vector<HMODULE> handles;
+			for (const auto& path : paths)
+			{
+				handles.emplace_back(LoadLibraryA(path.c_str()));
+			}
+
+			for (auto handle : handles)
+			{
+				FreeLibrary(handle);
+			}
+		});
+
+		const mapper::resolver_t system = [](const char* module, const char* name, std::uint16_t ordinal) -> std::uint64_t
+		{
+			return reinterpret_cast<std::uintptr_t>(GetProcAddress(GetModuleHandleA(module), name ? name : MAKEINTRESOURCEA(ordinal)));
+		};
+
+		bench::run("read and map on the pool, DllMain in order", count, [&]()
+		{
+			std::vector<std::uint8_t*> bases(count);
+
+			mapper::parallel(count, hardware, [&](std::size_t i)
+			{
+				std::ifstream stream(paths[i], std::ios::binary);
+				std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+				const pe source(bytes.data(), bytes.size());
+
+				std::string error;
+				bases[i] = static_cast<std::uint8_t*>(VirtualAlloc(nullptr, source.size_of_image(), MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE));
+				mapper::map(source, bases[i], reinterpret_cast<std::uintptr_t>(bases[i]), system, error);
+			});
+
+			for (auto base : bases)
+			{
+				reinterpret_cast<BOOL(WINAPI*)(HINSTANCE, DWORD, LPVOID)>(base + image.entry_point())(reinterpret_cast<HINSTANCE>(base), DLL_PROCESS_ATTACH, nullptr);
+			}
+
+			for (auto base : bases)
+			{
+				VirtualFree(base, 0, MEM_RELEASE);
+			}
+		});
+
+		std::filesystem::remove_all(folder);
+#endif
+	}
+}
+
+BENCH_SUITE("mods", bench_mods);
@@ -0,0 +1,173 @@
+#include "bench.hpp"
+#include "legacy.hpp"
+
+#include "path/path.hpp"
+
+#include <random>
+
+namespace
+{
+	//Paths shaped like what games open: an absolute game dir, a few folders, mixed case and separators
+	std::vector<std::string> sample_paths(std::size_t count)
+	{
+		static const char* folders[] = { "Data", "textures", "Sound/SFX", "Movies", "models\\characters", "scripts", "UI/Fonts", "levels/L01" };
+		static const char* files[] = { "Hero_Diffuse.DDS", "ambient_loop.wav", "intro.bik", "config.ini", "Player.mdl", "font_large.ttf", "terrain.pak" };
+
+		std::mt19937 rng(1337);
+		std::vector<std::string> paths;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			std::string path = "C:\\Program Files (x86)\\Some Game\\";
+			path.append(folders[rng() % 8]).append("/");
+			path.append(folders[rng() % 8]).append("\\");
+			path.append(std::to_string(rng() % 1000)).append("_");
+			path.append(files[rng() % 7]);
+			paths.emplace_back(path);
+		}
+
+		return paths;
+	}
+
+	void path_suite(const std::vector<std::string>&)
+	{
+		const auto paths = sample_paths(1024);
+		const std::string cwd = "c:\\program files (x86)\\some game\\";
+		char buffer[1024];
+
+		std::size_t bytes = 0;
+		for (const auto& p : paths)
+		{
+			bytes += p.size();
+		}
+		std::printf("  %zu paths, %.1f bytes avg\n", paths.size(), double(bytes) / paths.size());
+
+		bench::run("replace / with \\ (regex)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				bench::keep(legacy::replace(p, "/", "\\").size());
+			}
+		});
+
+		bench::run("replace / with \\ (path::replace)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				std::memcpy(buffer, p.data(), p.size());
+				path::replace(buffer, p.size(), '/', '\\');
+				bench::keep(buffer[0]);
+			}
+		});
+
+		bench::run("to_lower (std::tolower)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				std::string copy = p;
+				legacy::to_lower(copy);
+				bench::keep(copy[0]);
+			}
+		});
+
+		bench::run("to_lower (path::lower)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				std::memcpy(buffer, p.data(), p.size());
+				path::lower(buffer, p.size());
+				bench::keep(buffer[0]);
+			}
+		});
+
+		bench::run("fold (scalar)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				path::fold_scalar(p.data(), buffer, p.size());
+				bench::keep(buffer[0]);
+			}
+		});
+
+#ifdef PATH_X86
+		bench::run("fold (sse2)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				path::fold_sse2(p.data(), buffer, p.size());
+				bench::keep(buffer[0]);
+			}
+		});
+
+		if (path::has_avx2())
+		{
+			bench::run("fold (avx2)", paths.size(), [&]()
+			{
+				for (const auto& p : paths)
+				{
+					path::fold_avx2(p.data(), buffer, p.size());
+					bench::keep(buffer[0]);
+				}
+			});
+		}
+#endif
+
+		bench::run("strip cwd (find + erase)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				std::string copy = legacy::replace(p, "/", "\\");
+				legacy::to_lower(copy);
+				if (copy.find(cwd) != std::string::npos)
+				{
+					copy.erase(0, cwd.length());
+				}
+				bench::keep(copy.size());
+			}
+		});
+
+		bench::run("strip cwd (fold + strip_prefix)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				std::string_view key(buffer, path::fold(p, buffer, sizeof(buffer)));
+				path::strip_prefix(key, cwd);
+				bench::keep(key.size());
+			}
+		});
+
+		bench::run("hash (fnv1a)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				bench::keep(legacy::fnv1a(p));
+			}
+		});
+
+		bench::run("hash (path::hash)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				bench::keep(path::hash(p));
+			}
+		});
+
+		bench::run("ends_with (reverse iterators)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				bench::keep(legacy::ends_with(p, ".DDS"));
+			}
+		});
+
+		bench::run("ends_with (path::ends_with)", paths.size(), [&]()
+		{
+			for (const auto& p : paths)
+			{
+				bench::keep(path::ends_with(p, ".DDS"));
+			}
+		});
+	}
+}
+
+BENCH_SUITE("path", path_suite);
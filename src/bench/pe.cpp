@@ -0,0 +1,150 @@
+#include "bench.hpp"
+#include "legacy.hpp"
+
+#include "pe/pe.hpp"
+
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace
+{
+	template <typename T> void put(std::vector<std::uint8_t>& out, std::size_t offset, T value)
+	{
+		std::memcpy(&out[offset], &value, sizeof(T));
+	}
+
+	//Minimal PE32 with the section mix of a big game exe, used when no sample files are passed on the command line
+	std::string sample_image()
+	{
+		struct layout_t
+		{
+			const char* name;
+			std::uint32_t size;
+		};
+
+		static const layout_t layout[] = { { ".text", 96 << 20 }, { ".rdata", 40 << 20 }, { ".data", 8 << 20 }, { ".tls", 4096 }, { ".rsrc", 16 << 20 } };
+		const std::uint32_t headers = 0x1000;
+
+		std::size_t file_size = headers;
+		for (const auto& section : layout)
+		{
+			file_size += section.size;
+		}
+
+		std::vector<std::uint8_t> out(file_size);
+		put<std::uint16_t>(out, 0, 0x5A4D);
+		put<std::uint32_t>(out, 0x3C, 0x80);
+		put<std::uint32_t>(out, 0x80, 0x4550);
+		put<std::uint16_t>(out, 0x84, pe::machine_i386);
+		put<std::uint16_t>(out, 0x86, static_cast<std::uint16_t>(std::size(layout)));
+		put<std::uint16_t>(out, 0x94, 224);
+		put<std::uint16_t>(out, 0x98, 0x10B);
+		put<std::uint32_t>(out, 0x98 + 16, 0x1000);
+		put<std::uint32_t>(out, 0x98 + 28, 0x400000);
+		put<std::uint32_t>(out, 0x98 + 60, headers);
+		put<std::uint32_t>(out, 0x98 + 92, 16);
+
+		std::uint32_t raw = headers, rva = headers;
+		for (std::size_t i = 0; i < std::size(layout); i++)
+		{
+			pe::section_t section{};
+			std::memcpy(section.name, layout[i].name, std::strlen(layout[i].name));
+			section.virtual_size = layout[i].size;
+			section.virtual_address = rva;
+			section.raw_size = layout[i].size;
+			section.raw_offset = raw;
+			std::memcpy(&out[0x98 + 224 + i * sizeof(pe::section_t)], &section, sizeof(section));
+
+			for (std::uint32_t j = 0; j < layout[i].size; j += 64)
+			{
+				out[raw + j] = static_cast<std::uint8_t>(i + j);
+			}
+
+			raw += layout[i].size;
+			rva += layout[i].size;
+		}
+
+		put<std::uint32_t>(out, 0x98 + 56, rva);
+
+		const auto name = (std::filesystem::temp_directory_path() / "mr.modman.bench.exe").string();
+		std::ofstream(name, std::ios::binary).write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+		return name;
+	}
+
+	void pe_suite(const std::vector<std::string>& args)
+	{
+		std::vector<std::string> files = args;
+		if (files.empty())
+		{
+			files.emplace_back(sample_image());
+		}
+
+		for (const auto& name : files)
+		{
+			const int fd = open(name.c_str(), O_RDONLY);
+			struct stat info;
+
+			if (fd < 0 || fstat(fd, &info))
+			{
+				std::printf("cannot open %s\n", name.c_str());
+				continue;
+			}
+
+			const auto size = static_cast<std::size_t>(info.st_size);
+			void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+
+			if (view == MAP_FAILED)
+			{
+				continue;
+			}
+
+			const pe probe(static_cast<const std::uint8_t*>(view), size);
+			if (!probe.valid())
+			{
+				std::printf("%s is not a PE file\n", name.c_str());
+				munmap(view, size);
+				continue;
+			}
+
+			//Stands in for the reserved image, touched once so page faults do not end up in the numbers
+			std::vector<std::uint8_t> target(probe.size_of_image(), 0);
+			bench::section((name + ", " + std::to_string(size >> 20) + " MB, " + std::to_string(probe.section_list().size()) + " sections").c_str());
+
+			bench::run("ifstream into vector + memmove", 1, [&]()
+			{
+				auto buffer = legacy::read_file(name);
+				const pe image(buffer.data(), buffer.size());
+
+				for (const auto& section : image.section_list())
+				{
+					std::memmove(&target[section.virtual_address], &buffer[section.raw_offset], section.copy_size());
+				}
+
+				bench::keep(target[0x1000]);
+			});
+
+			for (unsigned threads : { 1u, std::max(4u, std::thread::hardware_concurrency()) })
+			{
+				bench::run(("mapped view, " + std::to_string(threads) + " thread copy").c_str(), 1, [&]()
+				{
+					const int file = open(name.c_str(), O_RDONLY);
+					void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+					close(file);
+
+					const pe image(static_cast<const std::uint8_t*>(mapped), size);
+					bench::keep(image.copy(target.data(), threads));
+
+					munmap(mapped, size);
+				});
+			}
+
+			munmap(view, size);
+		}
+	}
+}
+
+BENCH_SUITE("pe", pe_suite);
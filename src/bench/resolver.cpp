@@ -0,0 +1,231 @@
+#include "bench.hpp"
+
+#include "overlay/resolver.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <random>
+
+namespace
+{
+	//Counted by the replaced global operator new below, the resolver is meant to never touch the heap
+	std::atomic<std::uint64_t> allocations{ 0 };
+
+	const char* const default_root = "C:\\Games\\Some Game";
+
+	//One path per line, a prefetch list from the loader works as is since only what follows the tab is kept
+	std::vector<std::string> read_trace(const std::string& file)
+	{
+		std::vector<std::string> paths;
+		std::ifstream stream(file, std::ios::binary);
+
+		for (std::string line; std::getline(stream, line);)
+		{
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+
+			if (const auto tab = line.find('\t'); tab != std::string::npos)
+			{
+				line.erase(0, tab + 1);
+			}
+
+			//GetFinalPathNameByHandle hands out long path spellings, the resolver takes those too
+			if (!line.empty())
+			{
+				paths.emplace_back(line);
+			}
+		}
+
+		return paths;
+	}
+
+	//Opens the way a game mixes them: mostly its own dir, some overridden, some under a replaced folder, some system files
+	std::vector<std::string> sample_trace(const std::string& root, std::size_t entries, std::size_t count)
+	{
+		static const char* spellings[] = { "Data\\Textures\\", "data/textures/", "DATA\\Textures/" };
+
+		std::mt19937 rng(1337);
+		std::vector<std::string> paths;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			const auto kind = rng() % 10;
+			const auto file = std::to_string(rng() % (entries * 2));
+
+			if (kind < 5)
+			{
+				paths.emplace_back(root + "\\" + spellings[rng() % 3] + "tex_" + file + ".DDS");
+			}
+			else if (kind < 8)
+			{
+				paths.emplace_back("Sound\\sfx_" + file + ".wav");
+			}
+			else if (kind < 9)
+			{
+				paths.emplace_back(root + "\\movies\\replaced\\intro_" + file + ".bik");
+			}
+			else
+			{
+				paths.emplace_back("C:\\Windows\\System32\\d3dx9_" + std::to_string(24 + rng() % 20) + ".dll");
+			}
+		}
+
+		return paths;
+	}
+
+	std::string folded(const std::string& path)
+	{
+		char buffer[resolver::buffer_size];
+		return std::string(buffer, path::fold_utf8(path, buffer, sizeof(buffer)));
+	}
+
+	//Keys from the trace itself go in first so a recorded trace still sees hits, synthetic keys fill up the rest
+	//Every other synthetic texture exists, so half of those opens hit and half fall through to the game
+	void synthetic_overlay(const resolver& paths, const std::vector<std::string>& trace, std::size_t entries)
+	{
+		overlay::builder builder;
+		const auto layer = builder.layer("synthetic");
+		builder.rule("replace", "movies\\replaced", layer);
+
+		std::size_t added = 0;
+
+		for (std::size_t i = 0; i < trace.size() && added < entries / 2; i += 2)
+		{
+			std::string key = folded(trace[i]);
+			std::string_view view(key);
+
+			if (paths.locate(view) && !view.empty())
+			{
+				builder.add(view, "c:\\mods\\synthetic\\" + std::string(view), layer);
+				added++;
+			}
+		}
+
+		for (std::size_t i = 0; added < entries; i += 2, added++)
+		{
+			builder.add("data\\textures\\tex_" + std::to_string(i) + ".dds", "c:\\mods\\synthetic\\tex_" + std::to_string(i) + ".dds", layer);
+		}
+
+		overlay::use(builder.finish(0));
+	}
+
+	void report(const resolver& paths, const std::vector<std::string>& trace)
+	{
+		std::size_t hits = 0, hidden = 0;
+		const auto before = allocations.load();
+
+		for (const auto& p : trace)
+		{
+			const auto hit = paths.resolve_utf8(p);
+			hits += hit.slot != nullptr;
+			hidden += hit.hidden;
+		}
+
+		const double per_lookup = double(allocations.load() - before) / trace.size();
+		std::printf("  %zu overlay entries, %zu lookups, %.1f%% hits, %.1f%% hidden, %.3f allocations/lookup\n",
+			overlay::size(), trace.size(), 100.0 * hits / trace.size(), 100.0 * hidden / trace.size(), per_lookup);
+
+		bench::run("resolve", trace.size(), [&]()
+		{
+			for (const auto& p : trace)
+			{
+				const auto hit = paths.resolve_utf8(p);
+				bench::keep(reinterpret_cast<std::uintptr_t>(hit.slot) + hit.hidden);
+			}
+		});
+
+		//Single lookups are close to the clock's own cost, so that is measured the same way and taken off
+		std::vector<double> overhead, samples;
+		overhead.reserve(100000);
+		samples.reserve(1000000);
+
+		for (std::size_t i = 0; i < 100000; i++)
+		{
+			const auto start = bench::clock::now();
+			const auto end = bench::clock::now();
+			overhead.emplace_back(std::chrono::duration<double, std::nano>(end - start).count());
+		}
+
+		std::nth_element(overhead.begin(), overhead.begin() + overhead.size() / 2, overhead.end());
+		const double clock_ns = overhead[overhead.size() / 2];
+
+		while (samples.size() + trace.size() <= samples.capacity())
+		{
+			for (const auto& p : trace)
+			{
+				const auto start = bench::clock::now();
+				const auto hit = paths.resolve_utf8(p);
+				const auto end = bench::clock::now();
+
+				bench::keep(reinterpret_cast<std::uintptr_t>(hit.slot));
+				samples.emplace_back(std::max(std::chrono::duration<double, std::nano>(end - start).count() - clock_ns, 0.0));
+			}
+		}
+
+		std::sort(samples.begin(), samples.end());
+		std::printf("  %-44s %9.1f / %.1f ns (clock %.1f ns taken off)\n", "p50 / p99", samples[samples.size() / 2], samples[samples.size() * 99 / 100], clock_ns);
+	}
+
+	//bench resolver [trace] [game dir] [mod dir]
+	//Without a trace opens are generated, without a mod dir the overlay is synthetic at 1k, 100k and 1M entries
+	void resolver_suite(const std::vector<std::string>& args)
+	{
+		const std::string root = args.size() > 1 ? args[1] : default_root;
+
+		resolver paths;
+		paths.init(folded(root + "\\"), std::vector<std::string>{ "movies\\replaced\\" });
+
+		if (args.size() > 2)
+		{
+			overlay::builder builder;
+			builder.walk(args[2], "mods");
+			overlay::use(builder.finish(0));
+			overlay::build_filter();
+			paths.init(folded(root + "\\"), overlay::replaced());
+
+			const auto trace = !args[0].empty() ? read_trace(args[0]) : sample_trace(root, overlay::size(), 4096);
+			bench::section(("resolver, " + args[2]).c_str());
+			report(paths, trace);
+			return;
+		}
+
+		for (std::size_t entries : { 1000, 100000, 1000000 })
+		{
+			const auto trace = !args.empty() ? read_trace(args[0]) : sample_trace(root, entries, 4096);
+
+			if (trace.empty())
+			{
+				std::printf("  no paths in %s\n", args[0].c_str());
+				return;
+			}
+
+			synthetic_overlay(paths, trace, entries);
+			overlay::build_filter();
+
+			bench::section(("resolver, " + std::to_string(entries) + " entries").c_str());
+			report(paths, trace);
+		}
+
+		overlay::unload();
+	}
+}
+
+//Only new is replaced, the default delete already hands blocks back to free
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* block = std::malloc(size ? size : 1))
+	{
+		return block;
+	}
+
+	throw std::bad_alloc();
+}
+
+BENCH_SUITE("resolver", resolver_suite);
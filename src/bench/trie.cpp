@@ -0,0 +1,95 @@
+#include "bench.hpp"
+
+#include "overlay/trie.hpp"
+
+#include <random>
+
+namespace
+{
+	//Directory rules two levels deep, the way replace rules and mounts look after folding
+	//Names are fixed width so every rule set has the same key lengths and only the count changes
+	std::vector<std::string> sample_rules(std::size_t count, std::mt19937& rng)
+	{
+		std::vector<std::string> rules;
+		char buffer[64];
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			std::snprintf(buffer, sizeof(buffer), "folder%05u\\sub%05u\\", static_cast<unsigned>(rng() % (count / 4 + 1)), static_cast<unsigned>(i));
+			rules.emplace_back(buffer);
+		}
+
+		return rules;
+	}
+
+	//Half the lookups land under a rule, half miss in a sibling folder
+	std::vector<std::string> sample_lookups(const std::vector<std::string>& rules, std::size_t count, std::mt19937& rng)
+	{
+		std::vector<std::string> lookups;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			std::string path = rules[rng() % rules.size()];
+
+			if (i & 1)
+			{
+				path.insert(path.size() - 1, "x");
+			}
+
+			lookups.emplace_back(path + "textures\\" + std::to_string(i) + "_hero_diffuse.dds");
+		}
+
+		return lookups;
+	}
+
+	void trie_suite(const std::vector<std::string>&)
+	{
+		for (std::size_t count : { 16, 1024, 65536 })
+		{
+			std::mt19937 rng(1337);
+			const auto rules = sample_rules(count, rng);
+			const auto lookups = sample_lookups(rules, 1024, rng);
+
+			trie tree;
+			for (std::size_t i = 0; i < rules.size(); i++)
+			{
+				tree.insert(rules[i], static_cast<std::uint32_t>(i));
+			}
+
+			tree.compact();
+
+			bench::section(("trie, " + std::to_string(count) + " rules").c_str());
+
+			bench::run("longest prefix (linear scan)", lookups.size(), [&]()
+			{
+				for (const auto& p : lookups)
+				{
+					std::size_t best = 0;
+
+					for (const auto& rule : rules)
+					{
+						if (rule.size() > best && std::string_view(p).substr(0, rule.size()) == rule)
+						{
+							best = rule.size();
+						}
+					}
+
+					bench::keep(best);
+				}
+			});
+
+			bench::run("longest prefix (trie)", lookups.size(), [&]()
+			{
+				for (const auto& p : lookups)
+				{
+					std::uint32_t value = 0;
+					std::size_t length = 0;
+
+					bench::keep(tree.longest(p, value, length) ? length : 0);
+				}
+			});
+		}
+	}
+}
+
+BENCH_SUITE("trie", trie_suite);
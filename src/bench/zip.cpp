@@ -0,0 +1,551 @@
+#include "bench.hpp"
+
+#include "zip/zip.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace
+{
+	typedef std::chrono::duration<double> seconds;
+
+	double mb_per_s(std::uint64_t bytes, seconds elapsed)
+	{
+		return bytes / elapsed.count() / (1024.0 * 1024.0);
+	}
+
+	//Runs of repeating blocks with noisy stretches in between, about what a texture pack deflates like
+	std::vector<char> sample_data(std::size_t size, std::uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::vector<char> data(size);
+		char block[24];
+
+		for (std::size_t i = 0; i < size;)
+		{
+			const std::size_t run = std::min<std::size_t>(size - i, 512 + rng() % 8192);
+			const bool noise = rng() % 4 == 0;
+
+			for (auto& byte : block)
+			{
+				byte = static_cast<char>('a' + rng() % 26);
+			}
+
+			for (std::size_t j = 0; j < run; j++)
+			{
+				data[i + j] = noise || j % 61 == 0 ? static_cast<char>(rng()) : block[j % sizeof(block)];
+			}
+
+			i += run;
+		}
+
+		return data;
+	}
+
+	std::uint32_t crc32(const std::vector<char>& data)
+	{
+		static const auto table = []()
+		{
+			std::vector<std::uint32_t> table(256);
+
+			for (std::uint32_t i = 0; i < 256; i++)
+			{
+				std::uint32_t value = i;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					value = (value >> 1) ^ ((value & 1) ? 0xEDB88320u : 0);
+				}
+
+				table[i] = value;
+			}
+
+			return table;
+		}();
+
+		std::uint32_t crc = 0xFFFFFFFFu;
+		for (const char byte : data)
+		{
+			crc = table[(crc ^ static_cast<std::uint8_t>(byte)) & 0xFF] ^ (crc >> 8);
+		}
+
+		return ~crc;
+	}
+
+	//Just enough deflate to give the decoder real input, blocks of fixed codes and a single probe matcher
+	//Worse ratio than zlib and it does not matter, decoding costs about the same per symbol either way
+	//A block ends every 16K symbols like zlib's do, the streaming reader can only let go of history between blocks
+	class deflater
+	{
+	public:
+		static std::vector<char> compress(const std::vector<char>& data)
+		{
+			deflater out;
+			const auto in = reinterpret_cast<const std::uint8_t*>(data.data());
+			const std::size_t size = data.size();
+			std::vector<std::uint32_t> table(1 << 15, UINT32_MAX);
+			std::size_t symbols = 0;
+
+			out.bits(0, 1);
+			out.bits(1, 2);
+
+			for (std::size_t i = 0; i < size; symbols++)
+			{
+				if (symbols == 16384)
+				{
+					out.literal(256);
+					out.bits(0, 1);
+					out.bits(1, 2);
+					symbols = 0;
+				}
+
+				std::size_t length = 0, distance = 0;
+
+				if (i + 3 <= size)
+				{
+					const std::uint32_t hash = ((in[i] << 16 | in[i + 1] << 8 | in[i + 2]) * 2654435761u) >> 17;
+					const std::uint32_t ref = table[hash];
+					table[hash] = static_cast<std::uint32_t>(i);
+
+					if (ref != UINT32_MAX && i - ref <= 32768)
+					{
+						while (length < 258 && i + length < size && in[ref + length] == in[i + length])
+						{
+							length++;
+						}
+
+						distance = i - ref;
+					}
+				}
+
+				if (length < 3)
+				{
+					out.literal(in[i++]);
+					continue;
+				}
+
+				out.match(length, distance);
+				i += length;
+			}
+
+			//An empty last block closes the stream, nothing above knows which block would have been the last
+			out.literal(256);
+			out.bits(1, 1);
+			out.bits(1, 2);
+			out.literal(256);
+			out.flush();
+			return std::move(out.data);
+		}
+
+	private:
+		std::vector<char> data;
+		std::uint64_t buffer = 0;
+		unsigned count = 0;
+
+		void bits(std::uint32_t value, unsigned width)
+		{
+			this->buffer |= static_cast<std::uint64_t>(value) << this->count;
+			this->count += width;
+
+			while (this->count >= 8)
+			{
+				this->data.push_back(static_cast<char>(this->buffer));
+				this->buffer >>= 8;
+				this->count -= 8;
+			}
+		}
+
+		//Huffman codes go out first bit first, the opposite of every other field
+		void code(std::uint32_t value, unsigned width)
+		{
+			std::uint32_t reversed = 0;
+			for (unsigned i = 0; i < width; i++)
+			{
+				reversed |= ((value >> i) & 1) << (width - 1 - i);
+			}
+
+			this->bits(reversed, width);
+		}
+
+		void literal(std::uint32_t symbol)
+		{
+			if (symbol < 144)
+			{
+				this->code(0x30 + symbol, 8);
+			}
+			else if (symbol < 256)
+			{
+				this->code(0x190 + symbol - 144, 9);
+			}
+			else if (symbol < 280)
+			{
+				this->code(symbol - 256, 7);
+			}
+			else
+			{
+				this->code(0xC0 + symbol - 280, 8);
+			}
+		}
+
+		void match(std::size_t length, std::size_t distance)
+		{
+			static const std::uint16_t length_base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const std::uint8_t length_extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const std::uint16_t distance_base[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static const std::uint8_t distance_extra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+			unsigned symbol = 28;
+			while (length_base[symbol] > length)
+			{
+				symbol--;
+			}
+
+			this->literal(257 + symbol);
+			this->bits(static_cast<std::uint32_t>(length - length_base[symbol]), length_extra[symbol]);
+
+			symbol = 29;
+			while (distance_base[symbol] > distance)
+			{
+				symbol--;
+			}
+
+			this->code(symbol, 5);
+			this->bits(static_cast<std::uint32_t>(distance - distance_base[symbol]), distance_extra[symbol]);
+		}
+
+		void flush()
+		{
+			if (this->count)
+			{
+				this->bits(0, 8 - this->count);
+			}
+		}
+	};
+
+	//Writes a zip with plain local headers and no data descriptors, the layout every archiver produces for small files
+	class writer
+	{
+	public:
+		void add(const std::string& name, const std::vector<char>& data, bool deflate)
+		{
+			const auto body = deflate ? deflater::compress(data) : data;
+			const auto offset = static_cast<std::uint32_t>(this->out.size());
+			const std::uint16_t method = deflate ? zip::method_deflated : zip::method_stored;
+			const std::uint32_t crc = crc32(data);
+
+			this->u32(this->out, 0x04034b50);
+			this->u16(this->out, 20);
+			this->u16(this->out, 0);
+			this->u16(this->out, method);
+			this->u32(this->out, 0);
+			this->u32(this->out, crc);
+			this->u32(this->out, static_cast<std::uint32_t>(body.size()));
+			this->u32(this->out, static_cast<std::uint32_t>(data.size()));
+			this->u16(this->out, static_cast<std::uint16_t>(name.size()));
+			this->u16(this->out, 0);
+			this->out.insert(this->out.end(), name.begin(), name.end());
+			this->out.insert(this->out.end(), body.begin(), body.end());
+
+			this->u32(this->directory, 0x02014b50);
+			this->u16(this->directory, 20);
+			this->u16(this->directory, 20);
+			this->u16(this->directory, 0);
+			this->u16(this->directory, method);
+			this->u32(this->directory, 0);
+			this->u32(this->directory, crc);
+			this->u32(this->directory, static_cast<std::uint32_t>(body.size()));
+			this->u32(this->directory, static_cast<std::uint32_t>(data.size()));
+			this->u16(this->directory, static_cast<std::uint16_t>(name.size()));
+			this->u16(this->directory, 0);
+			this->u16(this->directory, 0);
+			this->u16(this->directory, 0);
+			this->u16(this->directory, 0);
+			this->u32(this->directory, 0);
+			this->u32(this->directory, offset);
+			this->directory.insert(this->directory.end(), name.begin(), name.end());
+			this->entries++;
+		}
+
+		bool save(const std::filesystem::path& path)
+		{
+			const auto offset = static_cast<std::uint32_t>(this->out.size());
+
+			this->out.insert(this->out.end(), this->directory.begin(), this->directory.end());
+			this->u32(this->out, 0x06054b50);
+			this->u16(this->out, 0);
+			this->u16(this->out, 0);
+			this->u16(this->out, static_cast<std::uint16_t>(this->entries));
+			this->u16(this->out, static_cast<std::uint16_t>(this->entries));
+			this->u32(this->out, static_cast<std::uint32_t>(this->directory.size()));
+			this->u32(this->out, offset);
+			this->u16(this->out, 0);
+
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file.write(this->out.data(), this->out.size());
+			return file.good();
+		}
+
+	private:
+		std::vector<char> out, directory;
+		std::size_t entries = 0;
+
+		void u16(std::vector<char>& to, std::uint16_t value)
+		{
+			to.push_back(static_cast<char>(value));
+			to.push_back(static_cast<char>(value >> 8));
+		}
+
+		void u32(std::vector<char>& to, std::uint32_t value)
+		{
+			this->u16(to, static_cast<std::uint16_t>(value));
+			this->u16(to, static_cast<std::uint16_t>(value >> 16));
+		}
+	};
+
+	//Positioned reads on an open file, the same call the loader makes on its shadow handles
+	class file
+	{
+	public:
+		explicit file(const std::filesystem::path& path)
+		{
+#ifdef _WIN32
+			this->handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+#else
+			this->handle = open(path.c_str(), O_RDONLY);
+#endif
+		}
+
+		~file()
+		{
+#ifdef _WIN32
+			CloseHandle(this->handle);
+#else
+			close(this->handle);
+#endif
+		}
+
+		std::uint32_t read(std::uint64_t offset, void* out, std::uint32_t size) const
+		{
+#ifdef _WIN32
+			OVERLAPPED overlapped{};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+			DWORD read = 0;
+			if (ReadFile(this->handle, out, size, nullptr, &overlapped) || GetLastError() == ERROR_IO_PENDING)
+			{
+				GetOverlappedResult(this->handle, &overlapped, &read, TRUE);
+			}
+
+			CloseHandle(overlapped.hEvent);
+			return read;
+#else
+			const auto read = pread(this->handle, out, size, static_cast<off_t>(offset));
+			return read > 0 ? static_cast<std::uint32_t>(read) : 0;
+#endif
+		}
+
+		zip::source_fn source() const
+		{
+			return [this](std::uint64_t offset, void* out, std::uint32_t size)
+			{
+				return this->read(offset, out, size) == size;
+			};
+		}
+
+	private:
+#ifdef _WIN32
+		HANDLE handle;
+#else
+		int handle;
+#endif
+	};
+
+	//Front to back in 64 KB reads, what a game streaming a file out of its archive does
+	//Cold gives every pass its own cache key so a whole entry is inflated each time, warm finds it still decoded
+	double sequential(const file& archive, const zip::entry_t& entry, const std::string& key, bool cold)
+	{
+		std::vector<char> buffer(64 * 1024);
+		std::uint64_t bytes = 0;
+		std::size_t passes = 0;
+		const auto start = bench::clock::now();
+
+		do
+		{
+			zip::reader view;
+			view.open(archive.source(), cold ? key + ":" + std::to_string(passes) : key, entry.offset, entry.stored, entry.size, entry.method);
+
+			for (std::uint64_t offset = 0; offset < view.size(); offset += buffer.size())
+			{
+				bytes += view.read(offset, buffer.data(), buffer.size());
+			}
+
+			passes++;
+		} while (bench::clock::now() - start < std::chrono::nanoseconds(static_cast<long long>(bench::min_time_ns)));
+
+		return mb_per_s(bytes, seconds(bench::clock::now() - start));
+	}
+
+	double sequential(const file& extracted, std::uint64_t size)
+	{
+		std::vector<char> buffer(64 * 1024);
+		std::uint64_t bytes = 0;
+		const auto start = bench::clock::now();
+
+		do
+		{
+			for (std::uint64_t offset = 0; offset < size; offset += buffer.size())
+			{
+				bytes += extracted.read(offset, buffer.data(), static_cast<std::uint32_t>(buffer.size()));
+			}
+		} while (bench::clock::now() - start < std::chrono::nanoseconds(static_cast<long long>(bench::min_time_ns)));
+
+		return mb_per_s(bytes, seconds(bench::clock::now() - start));
+	}
+
+	//4 KB at random offsets, p50 and p99 in microseconds, capped by time in case an entry seeks back slowly
+	template <typename T> std::pair<double, double> random_seeks(std::uint64_t size, T&& read)
+	{
+		std::mt19937_64 rng(42);
+		std::vector<double> samples;
+		std::vector<char> buffer(4096);
+		const auto limit = bench::clock::now() + std::chrono::seconds(2);
+
+		while (samples.size() < 20000 && bench::clock::now() < limit)
+		{
+			const std::uint64_t offset = rng() % (size - buffer.size());
+
+			const auto start = bench::clock::now();
+			bench::keep(read(offset, buffer.data(), buffer.size()));
+			samples.emplace_back(std::chrono::duration<double, std::micro>(bench::clock::now() - start).count());
+		}
+
+		std::sort(samples.begin(), samples.end());
+		return { samples[samples.size() / 2], samples[samples.size() * 99 / 100] };
+	}
+
+	void report(const std::filesystem::path& archive, const zip::entry_t& entry, const std::filesystem::path& folder)
+	{
+		const char* kind = entry.method == zip::method_stored ? "stored" : entry.size > zip::reader::whole_limit ? "deflated, streamed" : "deflated, decoded whole";
+		bench::section((entry.name + ", " + std::to_string(entry.size >> 20) + " MB " + kind).c_str());
+
+		const auto path = folder / ("extracted" + std::to_string(entry.offset));
+		if (!zip::extract(archive, entry.offset, entry.stored, entry.size, entry.method, path))
+		{
+			std::printf("  could not be extracted\n");
+			return;
+		}
+
+		const file zipped(archive), extracted(path);
+		const std::string key = archive.u8string() + ":" + std::to_string(entry.offset);
+
+		//Both views have to agree on every byte before any of the numbers mean something
+		std::vector<char> expected(static_cast<std::size_t>(entry.size)), actual(static_cast<std::size_t>(entry.size));
+		zip::reader view;
+		view.open(zipped.source(), key, entry.offset, entry.stored, entry.size, entry.method);
+
+		const bool matches = extracted.read(0, expected.data(), static_cast<std::uint32_t>(entry.size)) == entry.size &&
+			view.read(0, actual.data(), actual.size()) == entry.size && expected == actual;
+
+		std::printf("  %-44s %9.1f MB/s\n", "extracted file, sequential 64 KB reads", sequential(extracted, entry.size));
+
+		if (entry.method == zip::method_stored || entry.size > zip::reader::whole_limit)
+		{
+			std::printf("  %-44s %9.1f MB/s%s\n", "in the zip, sequential 64 KB reads", sequential(zipped, entry, key, false), matches ? "" : " (MISMATCH)");
+		}
+		else
+		{
+			std::printf("  %-44s %9.1f MB/s%s\n", "in the zip, first open, sequential 64 KB reads", sequential(zipped, entry, key, true), matches ? "" : " (MISMATCH)");
+			std::printf("  %-44s %9.1f MB/s\n", "in the zip, cached, sequential 64 KB reads", sequential(zipped, entry, key, false));
+		}
+
+		const auto disk = random_seeks(entry.size, [&](std::uint64_t offset, void* out, std::size_t size)
+		{
+			return extracted.read(offset, out, static_cast<std::uint32_t>(size));
+		});
+
+		//A fresh reader, the check above left a streamed entry's window holding all of it
+		//Every seek is checked too, a restart point in the wrong place only shows up here
+		zip::reader seeking;
+		seeking.open(zipped.source(), key, entry.offset, entry.stored, entry.size, entry.method);
+		bool seeks_match = true;
+
+		const auto zipped_seeks = random_seeks(entry.size, [&](std::uint64_t offset, void* out, std::size_t size)
+		{
+			const auto read = seeking.read(offset, out, size);
+			seeks_match = seeks_match && read == size && std::memcmp(out, expected.data() + offset, size) == 0;
+			return read;
+		});
+
+		std::printf("  %-44s %9.1f / %.1f us\n", "extracted file, random 4 KB reads, p50 / p99", disk.first, disk.second);
+		std::printf("  %-44s %9.1f / %.1f us%s\n", "in the zip, random 4 KB reads, p50 / p99", zipped_seeks.first, zipped_seeks.second, seeks_match ? "" : " (MISMATCH)");
+	}
+
+	//bench zip [archive.zip]
+	//Without an archive one is generated, a stored entry, a deflated one small enough to decode whole, one big enough to stream and a few thousand small files
+	//The biggest entries are read through zip::reader and compared against the same entry extracted to disk, both through positioned reads on the file
+	void zip_suite(const std::vector<std::string>& args)
+	{
+		const auto folder = std::filesystem::temp_directory_path() / "mr.modman.bench.zip";
+		std::filesystem::create_directories(folder);
+
+		auto archive = folder / "sample.zip";
+
+		if (!args.empty())
+		{
+			archive = std::filesystem::u8path(args[0]);
+		}
+		else
+		{
+			writer sample;
+			sample.add("textures/stored.bin", sample_data(32 * 1024 * 1024, 1), false);
+			sample.add("textures/whole.bin", sample_data(12 * 1024 * 1024, 2), true);
+			sample.add("textures/streamed.bin", sample_data(48 * 1024 * 1024, 3), true);
+
+			for (std::uint32_t i = 0; i < 4000; i++)
+			{
+				sample.add("scripts/" + std::to_string(i) + ".lua", sample_data(256 + i % 2048, i + 4), i % 2 == 0);
+			}
+
+			sample.save(archive);
+		}
+
+		std::vector<zip::entry_t> entries;
+		if (!zip::list(archive, entries))
+		{
+			std::printf("  %s is not a zip this version can read\n", archive.u8string().c_str());
+			std::filesystem::remove_all(folder);
+			return;
+		}
+
+		bench::section("zip index");
+		std::printf("  %zu entries\n", entries.size());
+
+		bench::run("zip::list, per entry", entries.size(), [&]()
+		{
+			std::vector<zip::entry_t> listed;
+			zip::list(archive, listed);
+			bench::keep(listed.size());
+		});
+
+		std::sort(entries.begin(), entries.end(), [](const zip::entry_t& left, const zip::entry_t& right)
+		{
+			return left.size > right.size;
+		});
+
+		for (std::size_t i = 0; i < entries.size() && i < 3; i++)
+		{
+			if (entries[i].size >= 64 * 1024)
+			{
+				report(archive, entries[i], folder);
+			}
+		}
+
+		std::filesystem::remove_all(folder);
+	}
+}
+
+BENCH_SUITE("zip", zip_suite);
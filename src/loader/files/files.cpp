@@ -0,0 +1,1094 @@
+#include "loader.hpp"
+#include "files.hpp"
+
+#include <winternl.h>
+
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "overlay/overlay.hpp"
+#include "chunk/chunk.hpp"
+#include "zip/zip.hpp"
+#include "trace/trace.hpp"
+#include "prefetch/prefetch.hpp"
+#include "readahead.hpp"
+#include "overlay/resolver.hpp"
+#include "path/path.hpp"
+
+#undef min
+#undef max
+
+namespace
+{
+	//FILE_BASIC_INFORMATION, winternl.h leaves it out
+	struct basic_information_t
+	{
+		LARGE_INTEGER creation_time;
+		LARGE_INTEGER last_access_time;
+		LARGE_INTEGER last_write_time;
+		LARGE_INTEGER change_time;
+		ULONG attributes;
+	};
+
+	constexpr NTSTATUS status_success = 0;
+	constexpr NTSTATUS status_object_name_not_found = static_cast<NTSTATUS>(0xC0000034);
+
+	HANDLE(__stdcall* oCreateFileA)(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+		DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+	HANDLE(__stdcall* oCreateFileW)(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+		DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+	DWORD(__stdcall* oGetFileAttributesA)(LPCSTR lpFileName);
+	DWORD(__stdcall* oGetFileAttributesW)(LPCWSTR lpFileName);
+	BOOL(__stdcall* oGetFileAttributesExA)(LPCSTR lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, LPVOID lpFileInformation);
+	BOOL(__stdcall* oGetFileAttributesExW)(LPCWSTR lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, LPVOID lpFileInformation);
+	NTSTATUS(__stdcall* oNtCreateFile)(PHANDLE FileHandle, ACCESS_MASK DesiredAccess, POBJECT_ATTRIBUTES ObjectAttributes, PIO_STATUS_BLOCK IoStatusBlock,
+		PLARGE_INTEGER AllocationSize, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions, PVOID EaBuffer, ULONG EaLength);
+	NTSTATUS(__stdcall* oNtQueryAttributesFile)(POBJECT_ATTRIBUTES ObjectAttributes, basic_information_t* FileInformation);
+	HANDLE(__stdcall* oFindFirstFileA)(LPCSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData);
+	HANDLE(__stdcall* oFindFirstFileW)(LPCWSTR lpFileName, LPWIN32_FIND_DATAW lpFindFileData);
+	HANDLE(__stdcall* oFindFirstFileExA)(LPCSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId, LPVOID lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+		LPVOID lpSearchFilter, DWORD dwAdditionalFlags);
+	HANDLE(__stdcall* oFindFirstFileExW)(LPCWSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId, LPVOID lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+		LPVOID lpSearchFilter, DWORD dwAdditionalFlags);
+	BOOL(__stdcall* oFindNextFileA)(HANDLE hFindFile, LPWIN32_FIND_DATAA lpFindFileData);
+	BOOL(__stdcall* oFindNextFileW)(HANDLE hFindFile, LPWIN32_FIND_DATAW lpFindFileData);
+	BOOL(__stdcall* oFindClose)(HANDLE hFindFile);
+
+	//Game dir and replace rules, set up once the overlay index is attached
+	resolver paths;
+
+	//The pack's write layer, whatever the game writes under its own dir goes here instead
+	std::wstring write_root;
+	std::uint16_t write_layer = 0xFFFF;
+
+	//Files moved into the write layer this session
+	//The index is an immutable image, so these sit in front of it until the next launch walks the write layer with the other layers
+	SRWLOCK written_lock = SRWLOCK_INIT;
+	std::deque<std::string> written_keys;
+	std::unordered_map<std::string_view, std::wstring> written;
+	std::atomic<bool> writing{ false };
+
+	//What a path resolved to, a layer file, a hole punched by a replace rule or a file in the write layer
+	struct hit_t
+	{
+		const overlay::slot_t* slot;
+		bool hidden;
+		LPCWSTR written;
+	};
+
+	//Set while one of our hooks runs on this thread
+	//kernelbase implements the A calls on top of the W ones and both on top of NtCreateFile, so only the outermost call resolves
+	//A TLS slot rather than thread_local, the loader's own TLS block is shared with the game image
+	DWORD nesting = TLS_OUT_OF_INDEXES;
+
+	class scope
+	{
+	public:
+		scope() : outer(TlsGetValue(nesting) == nullptr)
+		{
+			TlsSetValue(nesting, reinterpret_cast<LPVOID>(1));
+		}
+
+		~scope()
+		{
+			if (this->outer)
+			{
+				TlsSetValue(nesting, nullptr);
+			}
+		}
+
+		bool outermost() const
+		{
+			return this->outer;
+		}
+
+	private:
+		bool outer;
+	};
+
+	LPCWSTR find_written(std::string_view key)
+	{
+		if (!writing.load(std::memory_order_acquire))
+		{
+			return nullptr;
+		}
+
+		AcquireSRWLockShared(&written_lock);
+		const auto it = written.find(key);
+		const LPCWSTR retn = it != written.end() ? it->second.c_str() : nullptr;
+		ReleaseSRWLockShared(&written_lock);
+
+		return retn;
+	}
+
+	//Every entry point ends up here with a folded path, the write layer goes first
+	hit_t resolve(std::string_view folded)
+	{
+		if (writing.load(std::memory_order_acquire))
+		{
+			std::string_view key = folded;
+
+			if (paths.locate(key) && !key.empty())
+			{
+				if (const auto file = find_written(key))
+				{
+					return { nullptr, false, file };
+				}
+			}
+		}
+
+		const auto hit = paths.resolve(folded);
+		return { hit.slot, hit.hidden, nullptr };
+	}
+
+	hit_t resolve(LPCWSTR file_name, std::size_t length)
+	{
+		char buffer[resolver::buffer_size];
+		length = path::fold_wide(std::wstring_view(file_name, length), buffer, sizeof(buffer));
+
+		return length ? resolve(std::string_view(buffer, length)) : hit_t{};
+	}
+
+	hit_t resolve(LPCWSTR file_name)
+	{
+		return file_name ? resolve(file_name, wcslen(file_name)) : hit_t{};
+	}
+
+	//ANSI paths only take the detour through UTF-16 when they have non-ASCII bytes in them
+	hit_t resolve(LPCSTR file_name)
+	{
+		if (!file_name)
+		{
+			return {};
+		}
+
+		const std::string_view name(file_name);
+
+		if (path::ascii_prefix(name) == name.size())
+		{
+			char buffer[resolver::buffer_size];
+			const std::size_t length = path::fold(name, buffer, sizeof(buffer));
+
+			return length ? resolve(std::string_view(buffer, length)) : hit_t{};
+		}
+
+		wchar_t wide[MAX_PATH * 2];
+		const int length = MultiByteToWideChar(CP_ACP, 0, name.data(), static_cast<int>(name.size()), wide, MAX_PATH * 2);
+
+		return length ? resolve(wide, length) : hit_t{};
+	}
+
+	//Only absolute DOS paths in the \??\ namespace, opens relative to a directory handle are left alone
+	hit_t resolve(const OBJECT_ATTRIBUTES* attributes)
+	{
+		if (!attributes || attributes->RootDirectory || !attributes->ObjectName || !attributes->ObjectName->Buffer)
+		{
+			return {};
+		}
+
+		const std::wstring_view name(attributes->ObjectName->Buffer, attributes->ObjectName->Length / sizeof(wchar_t));
+
+		if (name.size() < 4 || name.compare(0, 4, L"\\??\\"))
+		{
+			return {};
+		}
+
+		return resolve(name.data(), name.size());
+	}
+
+	//The index stores the UTF-16 target next to the UTF-8 one, nothing to convert on a hit
+	LPCWSTR target(const overlay::slot_t* slot)
+	{
+		return reinterpret_cast<LPCWSTR>(overlay::target_wide(slot));
+	}
+
+	//Where an open really goes, nullptr for the path the game asked for
+	//Directories from a zip have nothing on disk to open, those stay on the game's own path
+	LPCWSTR destination(const hit_t& hit)
+	{
+		if (hit.written)
+		{
+			return hit.written;
+		}
+
+		const auto archived_directory = overlay::flag_archived | overlay::flag_directory;
+		return hit.slot && (hit.slot->flags & archived_directory) != archived_directory ? target(hit.slot) : nullptr;
+	}
+
+	//Layer files whose bytes only the read hooks can hand out, the handle itself is open on a .mmz or a zip
+	bool served(const overlay::slot_t* slot)
+	{
+		return slot && (slot->flags & (overlay::flag_packed | overlay::flag_archived)) && !(slot->flags & overlay::flag_directory);
+	}
+
+	//The read hooks serve a packed file through a second handle of their own, which a share mode of 0 would lock out
+	//Every entry of a zip opens the same archive, one entry held with share mode 0 would lock out all the others as well
+	//file is what the open really goes to, a copy up in the write layer keeps the game's share mode
+	DWORD share_mode(const hit_t& hit, LPCWSTR file, DWORD share)
+	{
+		return hit.slot && file == target(hit.slot) && served(hit.slot) ? share | FILE_SHARE_READ : share;
+	}
+
+	//Whether an open can change the file, plain reads never move anything into the write layer
+	bool writes(DWORD access, DWORD disposition)
+	{
+		return (access & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA | FILE_APPEND_DATA)) || disposition == CREATE_ALWAYS || disposition == CREATE_NEW
+			|| disposition == OPEN_ALWAYS || disposition == TRUNCATE_EXISTING;
+	}
+
+	//Moves a path the game is about to write into the write layer and returns where it lives there, nullptr leaves the open alone
+	//Whatever the game saw at that path is copied up first, unless the open throws the contents away anyway
+	//file_name has to be a Win32 path, it is the source of the copy when no layer provides the file
+	LPCWSTR copy_up(LPCWSTR file_name, std::size_t length, const hit_t& hit, bool truncates)
+	{
+		if (hit.written)
+		{
+			return hit.written;
+		}
+
+		//Written in an earlier session, it already lives in the write layer
+		if (hit.slot && hit.slot->layer == write_layer)
+		{
+			return target(hit.slot);
+		}
+
+		if (hit.slot && (hit.slot->flags & overlay::flag_directory))
+		{
+			return nullptr;
+		}
+
+		char buffer[resolver::buffer_size];
+		const std::size_t size = path::fold_wide(std::wstring_view(file_name, length), buffer, sizeof(buffer));
+		std::string_view key(buffer, size);
+
+		if (write_root.empty() || !size || !paths.locate(key) || key.empty())
+		{
+			return nullptr;
+		}
+
+		//Keeps the game's spelling when the tail of what it passed folds to the key, the key itself is lower case
+		std::wstring file = write_root;
+		wchar_t wide[MAX_PATH * 2];
+		char tail[resolver::buffer_size];
+
+		const std::size_t tail_size = length >= key.size() ? path::fold_wide(std::wstring_view(file_name + length - key.size(), key.size()), tail, sizeof(tail)) : 0;
+
+		if (tail_size == key.size() && !std::memcmp(tail, key.data(), key.size()))
+		{
+			file.append(file_name + length - key.size(), key.size());
+			std::replace(file.begin() + write_root.size(), file.end(), L'/', L'\\');
+		}
+		else
+		{
+			file.append(wide, MultiByteToWideChar(CP_UTF8, 0, key.data(), static_cast<int>(key.size()), wide, MAX_PATH * 2));
+		}
+
+		const LPCWSTR source = hit.slot ? target(hit.slot) : hit.hidden ? nullptr : file_name;
+		const DWORD attributes = source ? oGetFileAttributesW(source) : INVALID_FILE_ATTRIBUTES;
+
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			return nullptr;
+		}
+
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::path(file).parent_path(), ec);
+
+		if (attributes != INVALID_FILE_ATTRIBUTES && !truncates)
+		{
+			//Packed and archived layer files are written out decompressed, the game writes to the file it reads and not to the .mmz or zip
+			bool copied;
+
+			if (hit.slot && (hit.slot->flags & overlay::flag_packed))
+			{
+				copied = chunk::unpack(std::filesystem::path(source), std::filesystem::path(file));
+			}
+			else if (hit.slot && (hit.slot->flags & overlay::flag_archived))
+			{
+				const auto method = (hit.slot->flags & overlay::flag_deflated) ? zip::method_deflated : zip::method_stored;
+				copied = zip::extract(std::filesystem::path(source), hit.slot->offset, hit.slot->stored, hit.slot->size, method, std::filesystem::path(file));
+			}
+			else
+			{
+				copied = CopyFileW(source, file.c_str(), FALSE);
+			}
+
+			if (!copied)
+			{
+				return nullptr;
+			}
+
+			//Mods ship read only files now and then, the copy is the game's to write
+			if (attributes & FILE_ATTRIBUTE_READONLY)
+			{
+				SetFileAttributesW(file.c_str(), attributes & ~FILE_ATTRIBUTE_READONLY);
+			}
+		}
+
+		AcquireSRWLockExclusive(&written_lock);
+
+		auto it = written.find(key);
+		if (it == written.end())
+		{
+			written_keys.emplace_back(key);
+			it = written.emplace(written_keys.back(), std::move(file)).first;
+		}
+
+		const LPCWSTR retn = it->second.c_str();
+		ReleaseSRWLockExclusive(&written_lock);
+
+		writing.store(true, std::memory_order_release);
+		return retn;
+	}
+
+	void fill(const overlay::slot_t* slot, WIN32_FILE_ATTRIBUTE_DATA* data)
+	{
+		const FILETIME time{ static_cast<DWORD>(slot->time), static_cast<DWORD>(slot->time >> 32) };
+
+		data->dwFileAttributes = slot->attributes;
+		data->ftCreationTime = time;
+		data->ftLastAccessTime = time;
+		data->ftLastWriteTime = time;
+		data->nFileSizeHigh = static_cast<DWORD>(slot->size >> 32);
+		data->nFileSizeLow = static_cast<DWORD>(slot->size);
+	}
+
+	//A hidden path still lets the game create files there, it just never finds the originals
+	bool opens_existing(DWORD disposition)
+	{
+		return disposition == OPEN_EXISTING || disposition == TRUNCATE_EXISTING;
+	}
+
+	//Hands the game's own opens to the prefetch record, nested opens are the same file seen again
+	HANDLE opened(HANDLE handle, const scope& guard)
+	{
+		if (prefetch::recording && guard.outermost() && handle != INVALID_HANDLE_VALUE)
+		{
+			prefetch::record(handle);
+		}
+
+		return handle;
+	}
+
+	//Read only opens the overlay sent to a layer file get their small reads served from a buffer
+	//Layer files are never written while the game runs, the write layer is the one exception so it is left out
+	HANDLE redirected(HANDLE handle, const hit_t& hit, DWORD access, DWORD disposition, DWORD flags, const scope& guard)
+	{
+		const bool layer_file = guard.outermost() && handle != INVALID_HANDLE_VALUE && hit.slot && !hit.written && hit.slot->layer != write_layer && !writes(access, disposition);
+
+		//Packed and archived files are only readable through the hooks, a handle they cannot serve is no use to the game
+		if (layer_file && served(hit.slot))
+		{
+			if (!readahead::unpack(handle, hit.slot))
+			{
+				CloseHandle(handle);
+				SetLastError(ERROR_FILE_CORRUPT);
+				return INVALID_HANDLE_VALUE;
+			}
+		}
+		else if (layer_file && !(flags & (FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING)))
+		{
+			readahead::track(handle, overlay::target(hit.slot));
+		}
+
+		return opened(handle, guard);
+	}
+
+	HANDLE __stdcall create_file_a(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+		DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+	{
+		trace::span span("CreateFileA", "files", lpFileName ? lpFileName : "", &trace::file_events);
+		scope guard;
+
+		//Every layer was flattened into the overlay index at startup, the write layer, _global, then the pack and its parents
+		const auto hit = guard.outermost() ? resolve(lpFileName) : hit_t{};
+		LPCWSTR file = destination(hit);
+
+		if (guard.outermost() && lpFileName && writes(dwDesiredAccess, dwCreationDisposition))
+		{
+			wchar_t wide[MAX_PATH * 2];
+			const int length = MultiByteToWideChar(CP_ACP, 0, lpFileName, -1, wide, MAX_PATH * 2);
+
+			if (const auto moved = length > 1 ? copy_up(wide, length - 1, hit, dwCreationDisposition == CREATE_ALWAYS) : nullptr)
+			{
+				file = moved;
+			}
+		}
+
+		if (file)
+		{
+			return redirected(oCreateFileW(file, dwDesiredAccess, share_mode(hit, file, dwShareMode), lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile), hit, dwDesiredAccess, dwCreationDisposition, dwFlagsAndAttributes, guard);
+		}
+
+		if (hit.hidden && opens_existing(dwCreationDisposition))
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return INVALID_HANDLE_VALUE;
+		}
+
+		//Then original if nothing found
+		return opened(oCreateFileA(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile), guard);
+	}
+
+	HANDLE __stdcall create_file_w(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+		DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+	{
+		trace::span span("CreateFileW", "files", {}, &trace::file_events);
+		scope guard;
+
+		if (span.enabled() && lpFileName)
+		{
+			char name[MAX_PATH * 3];
+			span.describe(std::string_view(name, std::max(WideCharToMultiByte(CP_UTF8, 0, lpFileName, -1, name, sizeof(name), nullptr, nullptr) - 1, 0)));
+		}
+
+		const auto hit = guard.outermost() ? resolve(lpFileName) : hit_t{};
+		LPCWSTR file = destination(hit);
+
+		if (guard.outermost() && lpFileName && writes(dwDesiredAccess, dwCreationDisposition))
+		{
+			if (const auto moved = copy_up(lpFileName, wcslen(lpFileName), hit, dwCreationDisposition == CREATE_ALWAYS))
+			{
+				file = moved;
+			}
+		}
+
+		if (file)
+		{
+			lpFileName = file;
+		}
+		else if (hit.hidden && opens_existing(dwCreationDisposition))
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return INVALID_HANDLE_VALUE;
+		}
+
+		return redirected(oCreateFileW(lpFileName, dwDesiredAccess, share_mode(hit, lpFileName, dwShareMode), lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile), hit, dwDesiredAccess, dwCreationDisposition, dwFlagsAndAttributes, guard);
+	}
+
+	DWORD __stdcall get_file_attributes_a(LPCSTR lpFileName)
+	{
+		scope guard;
+
+		const auto hit = guard.outermost() ? resolve(lpFileName) : hit_t{};
+
+		if (hit.hidden)
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return INVALID_FILE_ATTRIBUTES;
+		}
+
+		if (hit.written)
+		{
+			return oGetFileAttributesW(hit.written);
+		}
+
+		return hit.slot ? hit.slot->attributes : oGetFileAttributesA(lpFileName);
+	}
+
+	DWORD __stdcall get_file_attributes_w(LPCWSTR lpFileName)
+	{
+		scope guard;
+
+		const auto hit = guard.outermost() ? resolve(lpFileName) : hit_t{};
+
+		if (hit.hidden)
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return INVALID_FILE_ATTRIBUTES;
+		}
+
+		if (hit.written)
+		{
+			return oGetFileAttributesW(hit.written);
+		}
+
+		return hit.slot ? hit.slot->attributes : oGetFileAttributesW(lpFileName);
+	}
+
+	BOOL __stdcall get_file_attributes_ex_a(LPCSTR lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, LPVOID lpFileInformation)
+	{
+		scope guard;
+
+		const auto hit = guard.outermost() && fInfoLevelId == GetFileExInfoStandard ? resolve(lpFileName) : hit_t{};
+
+		if (hit.written)
+		{
+			return oGetFileAttributesExW(hit.written, fInfoLevelId, lpFileInformation);
+		}
+
+		if (hit.slot)
+		{
+			fill(hit.slot, static_cast<WIN32_FILE_ATTRIBUTE_DATA*>(lpFileInformation));
+			return TRUE;
+		}
+
+		if (hit.hidden)
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return FALSE;
+		}
+
+		return oGetFileAttributesExA(lpFileName, fInfoLevelId, lpFileInformation);
+	}
+
+	BOOL __stdcall get_file_attributes_ex_w(LPCWSTR lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, LPVOID lpFileInformation)
+	{
+		scope guard;
+
+		const auto hit = guard.outermost() && fInfoLevelId == GetFileExInfoStandard ? resolve(lpFileName) : hit_t{};
+
+		if (hit.written)
+		{
+			return oGetFileAttributesExW(hit.written, fInfoLevelId, lpFileInformation);
+		}
+
+		if (hit.slot)
+		{
+			fill(hit.slot, static_cast<WIN32_FILE_ATTRIBUTE_DATA*>(lpFileInformation));
+			return TRUE;
+		}
+
+		if (hit.hidden)
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return FALSE;
+		}
+
+		return oGetFileAttributesExW(lpFileName, fInfoLevelId, lpFileInformation);
+	}
+
+	//Points an NT open at a Win32 path, left as it was if the path does not fit
+	//Write layer paths come with "\\?\" for the Win32 calls, the NT name takes the same path behind "\??\" instead
+	struct retarget
+	{
+		retarget(POBJECT_ATTRIBUTES& attributes, LPCWSTR file)
+		{
+			if (!std::wcsncmp(file, L"\\\\?\\", 4))
+			{
+				file += 4;
+			}
+
+			const std::size_t length = wcslen(file) + 4;
+
+			if (length < MAX_PATH * 2)
+			{
+				std::memcpy(this->buffer, L"\\??\\", 4 * sizeof(wchar_t));
+				std::memcpy(this->buffer + 4, file, (length - 4) * sizeof(wchar_t));
+
+				this->name.Buffer = this->buffer;
+				this->name.Length = static_cast<USHORT>(length * sizeof(wchar_t));
+				this->name.MaximumLength = this->name.Length;
+
+				this->redirected = *attributes;
+				this->redirected.ObjectName = &this->name;
+				attributes = &this->redirected;
+			}
+		}
+
+		OBJECT_ATTRIBUTES redirected;
+		UNICODE_STRING name;
+		wchar_t buffer[MAX_PATH * 2];
+	};
+
+	NTSTATUS __stdcall nt_create_file(PHANDLE FileHandle, ACCESS_MASK DesiredAccess, POBJECT_ATTRIBUTES ObjectAttributes, PIO_STATUS_BLOCK IoStatusBlock,
+		PLARGE_INTEGER AllocationSize, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions, PVOID EaBuffer, ULONG EaLength)
+	{
+		scope guard;
+
+		const auto hit = guard.outermost() ? resolve(ObjectAttributes) : hit_t{};
+
+		//Reads on NT handles never reach the ReadFile hook, so packed and archived layer files are not served down here and the game sees its own file
+		LPCWSTR file = !hit.written && served(hit.slot) ? nullptr : destination(hit);
+
+		//Only opens resolve() accepted, their name is "\??\" and a DOS path, which is a Win32 path again as "\\?\"
+		const bool changes = (DesiredAccess & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA | FILE_APPEND_DATA)) || CreateDisposition != FILE_OPEN;
+
+		if (guard.outermost() && changes && !(CreateOptions & FILE_DIRECTORY_FILE)
+			&& ObjectAttributes && ObjectAttributes->ObjectName && ObjectAttributes->ObjectName->Buffer)
+		{
+			const auto& name = *ObjectAttributes->ObjectName;
+			const std::size_t length = name.Length / sizeof(wchar_t);
+
+			if (!ObjectAttributes->RootDirectory && length > 4 && length < MAX_PATH * 2 && !std::wcsncmp(name.Buffer, L"\\??\\", 4))
+			{
+				wchar_t dos[MAX_PATH * 2];
+				std::memcpy(dos, name.Buffer, length * sizeof(wchar_t));
+				dos[1] = L'\\';
+				dos[length] = L'\0';
+
+				if (const auto moved = copy_up(dos, length, hit, CreateDisposition == FILE_SUPERSEDE || CreateDisposition == FILE_OVERWRITE_IF))
+				{
+					file = moved;
+				}
+			}
+		}
+
+		if (!file && hit.hidden && (CreateDisposition == FILE_OPEN || CreateDisposition == FILE_OVERWRITE))
+		{
+			return status_object_name_not_found;
+		}
+
+		std::optional<retarget> redirect;
+		if (file)
+		{
+			redirect.emplace(ObjectAttributes, file);
+		}
+
+		return oNtCreateFile(FileHandle, DesiredAccess, ObjectAttributes, IoStatusBlock, AllocationSize, FileAttributes, ShareAccess, CreateDisposition, CreateOptions, EaBuffer, EaLength);
+	}
+
+	NTSTATUS __stdcall nt_query_attributes_file(POBJECT_ATTRIBUTES ObjectAttributes, basic_information_t* FileInformation)
+	{
+		scope guard;
+
+		const auto hit = guard.outermost() ? resolve(ObjectAttributes) : hit_t{};
+
+		if (hit.hidden)
+		{
+			return status_object_name_not_found;
+		}
+
+		if (hit.written)
+		{
+			retarget redirect(ObjectAttributes, hit.written);
+			return oNtQueryAttributesFile(ObjectAttributes, FileInformation);
+		}
+
+		if (auto slot = hit.slot)
+		{
+			FileInformation->creation_time.QuadPart = static_cast<LONGLONG>(slot->time);
+			FileInformation->last_access_time.QuadPart = static_cast<LONGLONG>(slot->time);
+			FileInformation->last_write_time.QuadPart = static_cast<LONGLONG>(slot->time);
+			FileInformation->change_time.QuadPart = static_cast<LONGLONG>(slot->time);
+			FileInformation->attributes = slot->attributes;
+			return status_success;
+		}
+
+		return oNtQueryAttributesFile(ObjectAttributes, FileInformation);
+	}
+
+	//A directory enumeration we serve ourselves
+	//Overlay entries come straight from the listing precomputed in the index, then the real directory minus anything a layer overrides
+	class listing
+	{
+	public:
+		listing(std::wstring_view pattern, std::string_view directory, std::string_view wildcard, const std::uint32_t* entries, std::uint32_t count,
+			std::vector<std::wstring>&& files, bool replaced, FINDEX_INFO_LEVELS level, FINDEX_SEARCH_OPS op, DWORD flags) : pattern(pattern), directory(directory),
+			wildcard(wildcard), entries(entries), count(count), files(std::move(files)), level(level), op(op), flags(flags)
+		{
+			//A layer replaced the whole directory, the real one never shows through
+			if (replaced)
+			{
+				this->real = INVALID_HANDLE_VALUE;
+			}
+		}
+
+		~listing()
+		{
+			if (this->real && this->real != INVALID_HANDLE_VALUE)
+			{
+				oFindClose(this->real);
+			}
+		}
+
+		bool next(WIN32_FIND_DATAW* data)
+		{
+			while (this->cursor < this->count)
+			{
+				const auto slot = overlay::at(this->entries[this->cursor++]);
+				const auto key = overlay::key(slot);
+
+				//Copied up this session, listed below with what the write layer has now
+				if (path::match(this->wildcard, key.substr(key.rfind('\\') + 1)) && !find_written(key))
+				{
+					listing::fill(slot, data);
+					return true;
+				}
+			}
+
+			while (this->file_cursor < this->files.size())
+			{
+				const auto handle = oFindFirstFileExW(this->files[this->file_cursor++].c_str(), this->level, data, FindExSearchNameMatch, nullptr, 0);
+
+				if (handle != INVALID_HANDLE_VALUE)
+				{
+					oFindClose(handle);
+					return true;
+				}
+			}
+
+			//The real directory is only opened once the overlay side ran out, a mod only folder may not have one at all
+			while (this->real != INVALID_HANDLE_VALUE)
+			{
+				bool found = false;
+
+				if (!this->real)
+				{
+					this->real = oFindFirstFileExW(this->pattern.c_str(), this->level, data, this->op, nullptr, this->flags);
+					found = this->real != INVALID_HANDLE_VALUE;
+				}
+				else if (!(found = oFindNextFileW(this->real, data)))
+				{
+					oFindClose(this->real);
+					this->real = INVALID_HANDLE_VALUE;
+				}
+
+				if (found && !this->overridden(data->cFileName))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		std::wstring pattern;
+		std::string directory;
+		std::string wildcard;
+
+		const std::uint32_t* entries;
+		std::uint32_t count;
+		std::uint32_t cursor = 0;
+
+		std::vector<std::wstring> files;
+		std::size_t file_cursor = 0;
+
+		HANDLE real = nullptr;
+		FINDEX_INFO_LEVELS level;
+		FINDEX_SEARCH_OPS op;
+		DWORD flags;
+
+		//Real entries a layer also provides were already listed from the overlay side
+		bool overridden(const wchar_t* name) const
+		{
+			if (!wcscmp(name, L".") || !wcscmp(name, L".."))
+			{
+				return false;
+			}
+
+			char buffer[MAX_PATH * 4];
+			std::memcpy(buffer, this->directory.data(), this->directory.size());
+
+			const std::size_t length = path::fold_wide(name, buffer + this->directory.size(), sizeof(buffer) - this->directory.size());
+			const std::string_view key(buffer, this->directory.size() + length);
+
+			return length && (overlay::find(key) || find_written(key));
+		}
+
+		static void fill(const overlay::slot_t* slot, WIN32_FIND_DATAW* data)
+		{
+			const FILETIME time{ static_cast<DWORD>(slot->time), static_cast<DWORD>(slot->time >> 32) };
+
+			*data = {};
+			data->dwFileAttributes = slot->attributes;
+			data->ftCreationTime = time;
+			data->ftLastAccessTime = time;
+			data->ftLastWriteTime = time;
+			data->nFileSizeHigh = static_cast<DWORD>(slot->size >> 32);
+			data->nFileSizeLow = static_cast<DWORD>(slot->size);
+
+			std::memcpy(data->cFileName, overlay::name(slot), std::min<std::size_t>(slot->name_len, MAX_PATH - 1) * sizeof(wchar_t));
+		}
+	};
+
+	//Handles we gave out for our own listings, anything else goes to the real Find functions
+	std::mutex listings_mutex;
+	std::unordered_set<HANDLE> listings;
+
+	listing* find_listing(HANDLE handle)
+	{
+		std::lock_guard<std::mutex> lock(listings_mutex);
+		return listings.count(handle) ? static_cast<listing*>(handle) : nullptr;
+	}
+
+	//Write layer files directly inside a directory, their paths in the write layer
+	std::vector<std::wstring> written_in(std::string_view prefix, std::string_view wildcard)
+	{
+		std::vector<std::wstring> retn;
+
+		if (!writing.load(std::memory_order_acquire))
+		{
+			return retn;
+		}
+
+		AcquireSRWLockShared(&written_lock);
+
+		for (const auto& [key, file] : written)
+		{
+			if (key.size() > prefix.size() && !key.compare(0, prefix.size(), prefix) && key.find('\\', prefix.size()) == std::string_view::npos
+				&& path::match(wildcard, key.substr(prefix.size())))
+			{
+				retn.emplace_back(file);
+			}
+		}
+
+		ReleaseSRWLockShared(&written_lock);
+		return retn;
+	}
+
+	//Returns nullptr when no layer has anything in or replaced the directory the pattern points into
+	listing* open_listing(LPCWSTR file_name, FINDEX_INFO_LEVELS level, FINDEX_SEARCH_OPS op, DWORD flags)
+	{
+		if (!file_name)
+		{
+			return nullptr;
+		}
+
+		const std::wstring_view pattern(file_name);
+		const auto separator = pattern.find_last_of(L"\\/");
+
+		char directory[MAX_PATH * 4];
+		char wildcard[MAX_PATH * 4];
+		std::size_t length = 0;
+
+		if (separator != std::wstring_view::npos)
+		{
+			length = path::fold_wide(pattern.substr(0, separator + 1), directory, sizeof(directory));
+
+			if (!length)
+			{
+				return nullptr;
+			}
+		}
+
+		std::string_view key(directory, length);
+		const std::size_t wildcard_len = path::fold_wide(separator == std::wstring_view::npos ? pattern : pattern.substr(separator + 1), wildcard, sizeof(wildcard));
+
+		if (!wildcard_len || !paths.locate(key))
+		{
+			return nullptr;
+		}
+
+		const overlay::slot_t* slot = key.empty() ? nullptr : overlay::find(key);
+		const bool directory = key.empty() || (slot && (slot->flags & overlay::flag_directory));
+
+		std::string prefix(key);
+		if (!prefix.empty())
+		{
+			prefix.push_back('\\');
+		}
+
+		const bool replaced = !prefix.empty() && paths.hidden(prefix);
+
+		const std::uint32_t* entries = nullptr;
+		const std::uint32_t count = directory ? overlay::children(slot, entries) : 0;
+		auto files = written_in(prefix, std::string_view(wildcard, wildcard_len));
+
+		if (!count && !replaced && files.empty())
+		{
+			return nullptr;
+		}
+
+		return new listing(pattern, prefix, std::string_view(wildcard, wildcard_len), entries, count, std::move(files), replaced, level, op, flags);
+	}
+
+	//Hands out the first entry, the handle only exists if there was one
+	HANDLE start_listing(listing* list, WIN32_FIND_DATAW* data)
+	{
+		if (!list->next(data))
+		{
+			delete list;
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return INVALID_HANDLE_VALUE;
+		}
+
+		std::lock_guard<std::mutex> lock(listings_mutex);
+		listings.emplace(list);
+		return list;
+	}
+
+	void narrow(const WIN32_FIND_DATAW& wide, WIN32_FIND_DATAA* data)
+	{
+		data->dwFileAttributes = wide.dwFileAttributes;
+		data->ftCreationTime = wide.ftCreationTime;
+		data->ftLastAccessTime = wide.ftLastAccessTime;
+		data->ftLastWriteTime = wide.ftLastWriteTime;
+		data->nFileSizeHigh = wide.nFileSizeHigh;
+		data->nFileSizeLow = wide.nFileSizeLow;
+		data->dwReserved0 = wide.dwReserved0;
+		data->dwReserved1 = wide.dwReserved1;
+
+		WideCharToMultiByte(CP_ACP, 0, wide.cFileName, -1, data->cFileName, MAX_PATH, nullptr, nullptr);
+		WideCharToMultiByte(CP_ACP, 0, wide.cAlternateFileName, -1, data->cAlternateFileName, 14, nullptr, nullptr);
+	}
+
+	listing* open_listing(LPCSTR file_name, FINDEX_INFO_LEVELS level, FINDEX_SEARCH_OPS op, DWORD flags)
+	{
+		wchar_t wide[MAX_PATH * 2];
+		return file_name && MultiByteToWideChar(CP_ACP, 0, file_name, -1, wide, MAX_PATH * 2) ? open_listing(wide, level, op, flags) : nullptr;
+	}
+
+	HANDLE start_listing(listing* list, WIN32_FIND_DATAA* data)
+	{
+		WIN32_FIND_DATAW wide;
+		const auto handle = start_listing(list, &wide);
+
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			narrow(wide, data);
+		}
+
+		return handle;
+	}
+
+	HANDLE __stdcall find_first_file_ex_a(LPCSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId, LPVOID lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+		LPVOID lpSearchFilter, DWORD dwAdditionalFlags)
+	{
+		scope guard;
+
+		if (auto list = guard.outermost() ? open_listing(lpFileName, fInfoLevelId, fSearchOp, dwAdditionalFlags) : nullptr)
+		{
+			return start_listing(list, static_cast<WIN32_FIND_DATAA*>(lpFindFileData));
+		}
+
+		return oFindFirstFileExA(lpFileName, fInfoLevelId, lpFindFileData, fSearchOp, lpSearchFilter, dwAdditionalFlags);
+	}
+
+	HANDLE __stdcall find_first_file_ex_w(LPCWSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId, LPVOID lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+		LPVOID lpSearchFilter, DWORD dwAdditionalFlags)
+	{
+		scope guard;
+
+		if (auto list = guard.outermost() ? open_listing(lpFileName, fInfoLevelId, fSearchOp, dwAdditionalFlags) : nullptr)
+		{
+			return start_listing(list, static_cast<WIN32_FIND_DATAW*>(lpFindFileData));
+		}
+
+		return oFindFirstFileExW(lpFileName, fInfoLevelId, lpFindFileData, fSearchOp, lpSearchFilter, dwAdditionalFlags);
+	}
+
+	HANDLE __stdcall find_first_file_a(LPCSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData)
+	{
+		scope guard;
+
+		if (auto list = guard.outermost() ? open_listing(lpFileName, FindExInfoStandard, FindExSearchNameMatch, 0) : nullptr)
+		{
+			return start_listing(list, lpFindFileData);
+		}
+
+		return oFindFirstFileA(lpFileName, lpFindFileData);
+	}
+
+	HANDLE __stdcall find_first_file_w(LPCWSTR lpFileName, LPWIN32_FIND_DATAW lpFindFileData)
+	{
+		scope guard;
+
+		if (auto list = guard.outermost() ? open_listing(lpFileName, FindExInfoStandard, FindExSearchNameMatch, 0) : nullptr)
+		{
+			return start_listing(list, lpFindFileData);
+		}
+
+		return oFindFirstFileW(lpFileName, lpFindFileData);
+	}
+
+	BOOL __stdcall find_next_file_a(HANDLE hFindFile, LPWIN32_FIND_DATAA lpFindFileData)
+	{
+		scope guard;
+
+		if (auto list = find_listing(hFindFile))
+		{
+			WIN32_FIND_DATAW wide;
+
+			if (!list->next(&wide))
+			{
+				SetLastError(ERROR_NO_MORE_FILES);
+				return FALSE;
+			}
+
+			narrow(wide, lpFindFileData);
+			return TRUE;
+		}
+
+		return oFindNextFileA(hFindFile, lpFindFileData);
+	}
+
+	BOOL __stdcall find_next_file_w(HANDLE hFindFile, LPWIN32_FIND_DATAW lpFindFileData)
+	{
+		scope guard;
+
+		if (auto list = find_listing(hFindFile))
+		{
+			if (!list->next(lpFindFileData))
+			{
+				SetLastError(ERROR_NO_MORE_FILES);
+				return FALSE;
+			}
+
+			return TRUE;
+		}
+
+		return oFindNextFileW(hFindFile, lpFindFileData);
+	}
+
+	BOOL __stdcall find_close(HANDLE hFindFile)
+	{
+		scope guard;
+
+		if (auto list = find_listing(hFindFile))
+		{
+			{
+				std::lock_guard<std::mutex> lock(listings_mutex);
+				listings.erase(hFindFile);
+			}
+
+			delete list;
+			return TRUE;
+		}
+
+		return oFindClose(hFindFile);
+	}
+}
+
+//Expects the overlay index to be attached already
+void files::init(const std::string& cwd, const std::string& saves)
+{
+	nesting = TlsAlloc();
+
+	char buffer[MAX_PATH * 4];
+	const std::string dir = cwd + "\\";
+
+	wchar_t wide[MAX_PATH * 2];
+	const int length = MultiByteToWideChar(CP_ACP, 0, dir.data(), static_cast<int>(dir.size()), wide, MAX_PATH * 2);
+
+	const std::string root(buffer, length ? path::fold_wide(std::wstring_view(wide, length), buffer, sizeof(buffer)) : 0);
+
+	paths.init(root, overlay::replaced());
+
+	//Created when the first file is copied up, a pack the game never writes to leaves nothing behind
+	const int size = MultiByteToWideChar(CP_UTF8, 0, saves.data(), static_cast<int>(saves.size()), wide, MAX_PATH * 2);
+	write_root = size ? L"\\\\?\\" + std::wstring(wide, size) : L"";
+
+	for (std::uint16_t i = 0; i < overlay::layer_count(); i++)
+	{
+		if (!std::strcmp(overlay::layer(i), overlay::write_layer))
+		{
+			write_layer = i;
+		}
+	}
+}
+
+//Expects MinHook to be initialized, hooks are enabled by the caller
+void files::install()
+{
+	MH_CreateHookApi(L"kernel32.dll", "CreateFileA", (void**)&create_file_a, (void**)&oCreateFileA);
+	MH_CreateHookApi(L"kernel32.dll", "CreateFileW", (void**)&create_file_w, (void**)&oCreateFileW);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileAttributesA", (void**)&get_file_attributes_a, (void**)&oGetFileAttributesA);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileAttributesW", (void**)&get_file_attributes_w, (void**)&oGetFileAttributesW);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileAttributesExA", (void**)&get_file_attributes_ex_a, (void**)&oGetFileAttributesExA);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileAttributesExW", (void**)&get_file_attributes_ex_w, (void**)&oGetFileAttributesExW);
+	MH_CreateHookApi(L"ntdll.dll", "NtCreateFile", (void**)&nt_create_file, (void**)&oNtCreateFile);
+	MH_CreateHookApi(L"ntdll.dll", "NtQueryAttributesFile", (void**)&nt_query_attributes_file, (void**)&oNtQueryAttributesFile);
+	MH_CreateHookApi(L"kernel32.dll", "FindFirstFileA", (void**)&find_first_file_a, (void**)&oFindFirstFileA);
+	MH_CreateHookApi(L"kernel32.dll", "FindFirstFileW", (void**)&find_first_file_w, (void**)&oFindFirstFileW);
+	MH_CreateHookApi(L"kernel32.dll", "FindFirstFileExA", (void**)&find_first_file_ex_a, (void**)&oFindFirstFileExA);
+	MH_CreateHookApi(L"kernel32.dll", "FindFirstFileExW", (void**)&find_first_file_ex_w, (void**)&oFindFirstFileExW);
+	MH_CreateHookApi(L"kernel32.dll", "FindNextFileA", (void**)&find_next_file_a, (void**)&oFindNextFileA);
+	MH_CreateHookApi(L"kernel32.dll", "FindNextFileW", (void**)&find_next_file_w, (void**)&oFindNextFileW);
+	MH_CreateHookApi(L"kernel32.dll", "FindClose", (void**)&find_close, (void**)&oFindClose);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+//Redirects the game's file API into the overlay
+//Every entry point, ANSI, wide or NT, folds its path once and shares the same resolver
+//Writes under the game dir are moved into the pack's write layer, saves is its absolute path with a trailing separator
+class files
+{
+public:
+	static void init(const std::string& cwd, const std::string& saves);
+	static void install();
+};
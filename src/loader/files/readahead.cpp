@@ -0,0 +1,737 @@
+#include "loader.hpp"
+#include "readahead.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include "logger/logger.hpp"
+#include "chunk/chunk.hpp"
+#include "zip/zip.hpp"
+#include "overlay/overlay.hpp"
+
+#undef min
+#undef max
+
+namespace
+{
+	//One buffer worth of the file, either filled or with a read still in flight
+	struct window_t
+	{
+		std::vector<char> data;
+		long long offset = 0;
+		DWORD size = 0;
+		DWORD requested = 0;
+		OVERLAPPED overlapped{};
+		bool pending = false;
+	};
+
+	//Our reads go through a second, overlapped handle on the same file, so the buffers never move the game's file pointer
+	//The game's position is kept here and the pointer calls are answered from it, the real pointer is only moved along after them
+	struct state_t
+	{
+		HANDLE shadow;
+		std::string name;
+		long long size;
+		long long base = 0; //Where the file starts in the one the shadow is open on, past 0 only for entries stored in a zip
+		long long position = 0;
+		long long last_end = 0;
+		DWORD window = readahead::min_window;
+		window_t current, next;
+		CRITICAL_SECTION lock;
+
+		//The first error of the read in progress, reads that stop short because of it fail like the real call would
+		DWORD error = NO_ERROR;
+
+		//Set for .mmz layer files and deflated zip entries, every read is answered from them and the window buffers stay unused
+		std::unique_ptr<chunk::reader> packed;
+		std::unique_ptr<zip::reader> archived;
+
+		//The handle is not on the file the game sees, reads and sizes never go to the real API
+		bool served = false;
+
+		std::uint32_t reads = 0;
+		std::uint32_t syscalls = 0;
+		std::uint64_t bytes = 0;
+	};
+
+	BOOL(__stdcall* oReadFile)(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped);
+	DWORD(__stdcall* oSetFilePointer)(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod);
+	BOOL(__stdcall* oSetFilePointerEx)(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod);
+	BOOL(__stdcall* oCloseHandle)(HANDLE hObject);
+	DWORD(__stdcall* oGetFileSize)(HANDLE hFile, LPDWORD lpFileSizeHigh);
+	BOOL(__stdcall* oGetFileSizeEx)(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+	BOOL(__stdcall* oGetFileInformationByHandle)(HANDLE hFile, LPBY_HANDLE_FILE_INFORMATION lpFileInformation);
+
+	SRWLOCK handles_lock = SRWLOCK_INIT;
+	std::unordered_map<HANDLE, state_t*> handles;
+	std::atomic<bool> tracking{ false };
+
+	std::atomic<long long> reserved{ 0 };
+	std::atomic<std::uint64_t> total_reads{ 0 };
+	std::atomic<std::uint64_t> total_syscalls{ 0 };
+
+	state_t* find(HANDLE handle)
+	{
+		if (!tracking.load(std::memory_order_acquire))
+		{
+			return nullptr;
+		}
+
+		AcquireSRWLockShared(&handles_lock);
+		const auto it = handles.find(handle);
+		const auto retn = it != handles.end() ? it->second : nullptr;
+		ReleaseSRWLockShared(&handles_lock);
+
+		return retn;
+	}
+
+	//Grows a window's buffer, false once every handle together holds the whole budget
+	bool reserve(window_t& window, DWORD size)
+	{
+		if (window.data.size() >= size)
+		{
+			return true;
+		}
+
+		const long long grow = size - static_cast<long long>(window.data.size());
+		if (reserved.fetch_add(grow) + grow > readahead::budget && !window.data.empty())
+		{
+			reserved.fetch_sub(grow);
+			return false;
+		}
+
+		window.data.resize(size);
+		return true;
+	}
+
+	//Reading past the end is not an error, the read just comes back short
+	void failed(state_t* state, DWORD error)
+	{
+		if (error != ERROR_HANDLE_EOF && state->error == NO_ERROR)
+		{
+			state->error = error;
+		}
+	}
+
+	//Starts a read of size bytes at offset into a window, completed later by finish
+	void fetch(state_t* state, window_t& window, long long offset, DWORD size)
+	{
+		if (!reserve(window, size))
+		{
+			size = static_cast<DWORD>(window.data.size());
+		}
+
+		if (!window.overlapped.hEvent)
+		{
+			window.overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		}
+
+		window.offset = offset;
+		window.size = 0;
+		window.requested = static_cast<DWORD>(std::min<long long>(size, state->size - offset));
+		window.overlapped.Offset = static_cast<DWORD>(offset + state->base);
+		window.overlapped.OffsetHigh = static_cast<DWORD>((offset + state->base) >> 32);
+		ResetEvent(window.overlapped.hEvent);
+
+		state->syscalls++;
+		window.pending = oReadFile(state->shadow, window.data.data(), window.requested, nullptr, &window.overlapped) || GetLastError() == ERROR_IO_PENDING;
+
+		if (!window.pending)
+		{
+			failed(state, GetLastError());
+		}
+	}
+
+	void finish(state_t* state, window_t& window)
+	{
+		if (window.pending)
+		{
+			DWORD read = 0;
+			const BOOL result = GetOverlappedResult(state->shadow, &window.overlapped, &read, TRUE);
+			window.size = result ? read : 0;
+			window.pending = false;
+
+			if (!result)
+			{
+				failed(state, GetLastError());
+			}
+		}
+	}
+
+	void drop(state_t* state, window_t& window)
+	{
+		//A cancelled read fails with ERROR_OPERATION_ABORTED, that is ours and not the game's to see
+		if (window.pending)
+		{
+			DWORD read;
+			CancelIoEx(state->shadow, &window.overlapped);
+			GetOverlappedResult(state->shadow, &window.overlapped, &read, TRUE);
+			window.pending = false;
+		}
+
+		window.size = 0;
+	}
+
+	bool inside(const window_t& window, long long position)
+	{
+		return position >= window.offset && position < window.offset + (window.pending ? window.requested : window.size);
+	}
+
+	//One read at offset on a shadow handle, safe to run from several threads at once since every call waits on its own event
+	//error gets what the read failed with, NO_ERROR when it did not
+	DWORD positioned(HANDLE shadow, void* out, DWORD size, long long offset, DWORD* error = nullptr)
+	{
+		OVERLAPPED overlapped{};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+		DWORD read = 0, result = NO_ERROR;
+
+		if (!(oReadFile(shadow, out, size, nullptr, &overlapped) || GetLastError() == ERROR_IO_PENDING) || !GetOverlappedResult(shadow, &overlapped, &read, TRUE))
+		{
+			result = GetLastError();
+		}
+
+		oCloseHandle(overlapped.hEvent);
+
+		if (error)
+		{
+			*error = result;
+		}
+
+		return read;
+	}
+
+	//Big reads skip the buffer and land in the caller's memory directly
+	DWORD direct(state_t* state, char* out, DWORD size, long long offset)
+	{
+		DWORD error;
+		state->syscalls++;
+
+		const DWORD read = positioned(state->shadow, out, size, offset + state->base, &error);
+		failed(state, error);
+		return read;
+	}
+
+	//A read that picks up where the last one ended grows the window and queues the one after it
+	//Anything else shrinks it back and throws the queued read away
+	//false when the disk failed before size bytes came in, the position stays where it was and state->error says why
+	bool read(state_t* state, char* out, DWORD size, DWORD& copied)
+	{
+		const bool sequential = state->position == state->last_end;
+		long long position = state->position;
+
+		copied = 0;
+		state->error = NO_ERROR;
+		state->reads++;
+
+		if (!sequential)
+		{
+			state->window = readahead::min_window;
+			drop(state, state->next);
+		}
+
+		size = static_cast<DWORD>(std::max<long long>(std::min<long long>(size, state->size - position), 0));
+
+		while (copied < size)
+		{
+			if (inside(state->current, position))
+			{
+				const auto& current = state->current;
+				const DWORD count = static_cast<DWORD>(std::min<long long>(size - copied, current.offset + current.size - position));
+
+				std::memcpy(out + copied, current.data.data() + (position - current.offset), count);
+				position += count;
+				copied += count;
+				continue;
+			}
+
+			if (inside(state->next, position))
+			{
+				finish(state, state->next);
+				std::swap(state->current, state->next);
+				state->window = std::min(state->window * 2, readahead::max_window);
+
+				if (!inside(state->current, position))
+				{
+					break;
+				}
+
+				continue;
+			}
+
+			if (size - copied >= state->window)
+			{
+				const DWORD count = direct(state, out + copied, size - copied, position);
+				position += count;
+				copied += count;
+				break;
+			}
+
+			drop(state, state->next);
+			fetch(state, state->current, position, state->window);
+			finish(state, state->current);
+
+			if (!state->current.size)
+			{
+				break;
+			}
+		}
+
+		if (copied < size && state->error != NO_ERROR)
+		{
+			state->window = readahead::min_window;
+			return false;
+		}
+
+		const auto& current = state->current;
+		const long long end = current.offset + current.size;
+
+		if (sequential && current.size && !state->next.pending && !(state->next.size && state->next.offset == end) && end < state->size)
+		{
+			fetch(state, state->next, end, state->window);
+		}
+
+		//A queued read that fails is only an error once the game reads that far
+		state->error = NO_ERROR;
+		state->position = position;
+		state->last_end = position;
+		state->bytes += copied;
+		return true;
+	}
+
+	//The game's handle keeps its real file pointer where ours is, for reads that reach the file without passing our hooks
+	//NtReadFile, ReadFileEx or a kernelbase import would otherwise read from wherever the handle was opened
+	void sync(HANDLE handle, const state_t* state)
+	{
+		LARGE_INTEGER position;
+		position.QuadPart = state->position;
+		oSetFilePointerEx(handle, position, nullptr, FILE_BEGIN);
+	}
+
+	//Same rules as SetFilePointerEx, the position may go past the end but not before the start
+	bool seek(state_t* state, long long distance, DWORD method, long long& out)
+	{
+		const long long base = method == FILE_BEGIN ? 0 : method == FILE_CURRENT ? state->position : method == FILE_END ? state->size : -1;
+
+		if (base < 0 || base + distance < 0)
+		{
+			SetLastError(base < 0 ? ERROR_INVALID_PARAMETER : ERROR_NEGATIVE_SEEK);
+			return false;
+		}
+
+		out = state->position = base + distance;
+		return true;
+	}
+
+	BOOL __stdcall read_file(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
+	{
+		const auto state = find(hFile);
+
+		if (!state)
+		{
+			return oReadFile(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+		}
+
+		EnterCriticalSection(&state->lock);
+
+		//Served files only ever have the bytes we give them, overlapped reads included, those complete before we return
+		//Stored zip entries are a plain range of the archive and go through the window like any other file
+		if (state->served)
+		{
+			const long long offset = lpOverlapped ? (static_cast<long long>(lpOverlapped->OffsetHigh) << 32) | lpOverlapped->Offset : state->position;
+			DWORD count, error = NO_ERROR;
+
+			if (state->packed || state->archived)
+			{
+				count = static_cast<DWORD>(state->packed ? state->packed->read(offset, lpBuffer, nNumberOfBytesToRead) : state->archived->read(offset, lpBuffer, nNumberOfBytesToRead));
+				state->reads++;
+				state->bytes += count;
+				state->position = offset + count;
+
+				if (!count && nNumberOfBytesToRead && offset < state->size)
+				{
+					error = ERROR_FILE_CORRUPT;
+				}
+			}
+			else
+			{
+				state->position = offset;
+				error = read(state, static_cast<char*>(lpBuffer), nNumberOfBytesToRead, count) ? NO_ERROR : state->error;
+			}
+
+			LeaveCriticalSection(&state->lock);
+
+			if (error != NO_ERROR)
+			{
+				if (lpNumberOfBytesRead)
+				{
+					*lpNumberOfBytesRead = 0;
+				}
+
+				SetLastError(error);
+				return FALSE;
+			}
+
+			if (lpNumberOfBytesRead)
+			{
+				*lpNumberOfBytesRead = count;
+			}
+
+			if (lpOverlapped)
+			{
+				lpOverlapped->Internal = 0;
+				lpOverlapped->InternalHigh = count;
+
+				if (lpOverlapped->hEvent)
+				{
+					SetEvent(lpOverlapped->hEvent);
+				}
+			}
+
+			return TRUE;
+		}
+
+		//A positioned read on a synchronous handle, it leaves the file pointer after what it read
+		if (lpOverlapped)
+		{
+			const auto offset = (static_cast<long long>(lpOverlapped->OffsetHigh) << 32) | lpOverlapped->Offset;
+			const BOOL result = oReadFile(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+
+			if (result)
+			{
+				state->position = offset + static_cast<long long>(lpOverlapped->InternalHigh);
+			}
+
+			LeaveCriticalSection(&state->lock);
+			return result;
+		}
+
+		DWORD count;
+		const bool success = read(state, static_cast<char*>(lpBuffer), nNumberOfBytesToRead, count);
+		const DWORD error = state->error;
+
+		if (success)
+		{
+			sync(hFile, state);
+		}
+
+		LeaveCriticalSection(&state->lock);
+
+		if (!success)
+		{
+			if (lpNumberOfBytesRead)
+			{
+				*lpNumberOfBytesRead = 0;
+			}
+
+			SetLastError(error);
+			return FALSE;
+		}
+
+		if (lpNumberOfBytesRead)
+		{
+			*lpNumberOfBytesRead = count;
+		}
+
+		return TRUE;
+	}
+
+	DWORD __stdcall set_file_pointer(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod)
+	{
+		const auto state = find(hFile);
+
+		if (!state)
+		{
+			return oSetFilePointer(hFile, lDistanceToMove, lpDistanceToMoveHigh, dwMoveMethod);
+		}
+
+		const long long distance = lpDistanceToMoveHigh ? static_cast<long long>((static_cast<unsigned long long>(*lpDistanceToMoveHigh) << 32) | static_cast<DWORD>(lDistanceToMove)) : lDistanceToMove;
+		long long position;
+
+		EnterCriticalSection(&state->lock);
+		const bool moved = seek(state, distance, dwMoveMethod, position);
+
+		if (moved && !state->served)
+		{
+			sync(hFile, state);
+		}
+
+		LeaveCriticalSection(&state->lock);
+
+		if (!moved)
+		{
+			return INVALID_SET_FILE_POINTER;
+		}
+
+		if (lpDistanceToMoveHigh)
+		{
+			*lpDistanceToMoveHigh = static_cast<LONG>(position >> 32);
+		}
+
+		//INVALID_SET_FILE_POINTER is also a valid low half, callers tell the two apart by the last error
+		SetLastError(NO_ERROR);
+		return static_cast<DWORD>(position);
+	}
+
+	BOOL __stdcall set_file_pointer_ex(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod)
+	{
+		const auto state = find(hFile);
+
+		if (!state)
+		{
+			return oSetFilePointerEx(hFile, liDistanceToMove, lpNewFilePointer, dwMoveMethod);
+		}
+
+		long long position;
+
+		EnterCriticalSection(&state->lock);
+		const bool moved = seek(state, liDistanceToMove.QuadPart, dwMoveMethod, position);
+
+		if (moved && !state->served)
+		{
+			sync(hFile, state);
+		}
+
+		LeaveCriticalSection(&state->lock);
+
+		if (moved && lpNewFilePointer)
+		{
+			lpNewFilePointer->QuadPart = position;
+		}
+
+		return moved;
+	}
+
+	//Served files report the size the game sees, not the size of the .mmz or zip the handle is really open on
+	DWORD __stdcall get_file_size(HANDLE hFile, LPDWORD lpFileSizeHigh)
+	{
+		const auto state = find(hFile);
+
+		if (!state || !state->served)
+		{
+			return oGetFileSize(hFile, lpFileSizeHigh);
+		}
+
+		if (lpFileSizeHigh)
+		{
+			*lpFileSizeHigh = static_cast<DWORD>(state->size >> 32);
+		}
+
+		SetLastError(NO_ERROR);
+		return static_cast<DWORD>(state->size);
+	}
+
+	BOOL __stdcall get_file_size_ex(HANDLE hFile, PLARGE_INTEGER lpFileSize)
+	{
+		const auto state = find(hFile);
+
+		if (!state || !state->served)
+		{
+			return oGetFileSizeEx(hFile, lpFileSize);
+		}
+
+		lpFileSize->QuadPart = state->size;
+		return TRUE;
+	}
+
+	BOOL __stdcall get_file_information_by_handle(HANDLE hFile, LPBY_HANDLE_FILE_INFORMATION lpFileInformation)
+	{
+		const auto state = find(hFile);
+
+		if (!oGetFileInformationByHandle(hFile, lpFileInformation))
+		{
+			return FALSE;
+		}
+
+		if (state && state->served)
+		{
+			lpFileInformation->nFileSizeHigh = static_cast<DWORD>(state->size >> 32);
+			lpFileInformation->nFileSizeLow = static_cast<DWORD>(state->size);
+		}
+
+		return TRUE;
+	}
+
+	BOOL __stdcall close_handle(HANDLE hObject)
+	{
+		state_t* state = nullptr;
+
+		//Every handle the game closes comes through here, only tracked ones take the exclusive lock
+		if (find(hObject))
+		{
+			AcquireSRWLockExclusive(&handles_lock);
+
+			if (const auto it = handles.find(hObject); it != handles.end())
+			{
+				state = it->second;
+				handles.erase(it);
+			}
+
+			ReleaseSRWLockExclusive(&handles_lock);
+		}
+
+		if (state)
+		{
+			for (auto window : { &state->current, &state->next })
+			{
+				drop(state, *window);
+				reserved.fetch_sub(static_cast<long long>(window->data.size()));
+
+				if (window->overlapped.hEvent)
+				{
+					oCloseHandle(window->overlapped.hEvent);
+				}
+			}
+
+			//The reader waits for its queued chunks, those still read through the shadow handle
+			state->packed.reset();
+			state->archived.reset();
+			oCloseHandle(state->shadow);
+			DeleteCriticalSection(&state->lock);
+
+			total_reads += state->reads;
+			total_syscalls += state->syscalls;
+
+			//Only files the game really streamed, most handles see a read or two
+			if (state->reads >= 64 && state->served)
+			{
+				logger::log_info(logger::va("Served %s: %u reads, %llu KB", state->name.c_str(), state->reads, state->bytes >> 10));
+			}
+			else if (state->reads >= 64)
+			{
+				logger::log_info(logger::va("Read-ahead %s: %u reads served with %u from disk, %llu KB", state->name.c_str(), state->reads, state->syscalls, state->bytes >> 10));
+			}
+
+			delete state;
+		}
+
+		return oCloseHandle(hObject);
+	}
+
+	void insert(HANDLE handle, state_t* state)
+	{
+		InitializeCriticalSection(&state->lock);
+
+		AcquireSRWLockExclusive(&handles_lock);
+		handles[handle] = state;
+		ReleaseSRWLockExclusive(&handles_lock);
+
+		tracking.store(true, std::memory_order_release);
+	}
+}
+
+void readahead::track(HANDLE handle, const char* name)
+{
+	LARGE_INTEGER size;
+	const auto shadow = ReOpenFile(handle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN);
+
+	if (shadow == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	if (!GetFileSizeEx(shadow, &size))
+	{
+		CloseHandle(shadow);
+		return;
+	}
+
+	insert(handle, new state_t{ shadow, name, size.QuadPart });
+}
+
+bool readahead::unpack(HANDLE handle, const overlay::slot_t* slot)
+{
+	const bool stored = (slot->flags & overlay::flag_archived) && !(slot->flags & overlay::flag_deflated);
+	const auto shadow = ReOpenFile(handle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_FLAG_OVERLAPPED | (stored ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS));
+
+	if (shadow == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	const auto source = [shadow](std::uint64_t offset, void* out, std::uint32_t size)
+	{
+		return positioned(shadow, out, size, static_cast<long long>(offset)) == size;
+	};
+
+	const std::string name = (slot->flags & overlay::flag_archived) ? logger::va("%s in %s", std::string(overlay::key(slot)).c_str(), overlay::target(slot)) : overlay::target(slot);
+
+	if (slot->flags & overlay::flag_packed)
+	{
+		auto packed = std::make_unique<chunk::reader>();
+
+		if (!packed->open(source))
+		{
+			logger::log_error(logger::va("%s is not a packed file this version can read", name.c_str()));
+			oCloseHandle(shadow);
+			return false;
+		}
+
+		auto state = new state_t{ shadow, name, static_cast<long long>(packed->size()) };
+		state->packed = std::move(packed);
+		state->served = true;
+
+		insert(handle, state);
+		return true;
+	}
+
+	//The index already checked the entry fits in the archive, a stored one is read straight out of it at its offset
+	auto state = new state_t{ shadow, name, static_cast<long long>(slot->size) };
+	state->served = true;
+
+	if (stored)
+	{
+		state->base = static_cast<long long>(slot->offset);
+	}
+	else
+	{
+		state->archived = std::make_unique<zip::reader>();
+
+		if (!state->archived->open(source, logger::va("%s:%llu", overlay::target(slot), static_cast<unsigned long long>(slot->offset)), slot->offset, slot->stored, slot->size, zip::method_deflated))
+		{
+			logger::log_error(logger::va("%s could not be read", name.c_str()));
+			oCloseHandle(shadow);
+			delete state;
+			return false;
+		}
+	}
+
+	insert(handle, state);
+	return true;
+}
+
+void readahead::install()
+{
+	MH_CreateHookApi(L"kernel32.dll", "ReadFile", (void**)&read_file, (void**)&oReadFile);
+	MH_CreateHookApi(L"kernel32.dll", "SetFilePointer", (void**)&set_file_pointer, (void**)&oSetFilePointer);
+	MH_CreateHookApi(L"kernel32.dll", "SetFilePointerEx", (void**)&set_file_pointer_ex, (void**)&oSetFilePointerEx);
+	MH_CreateHookApi(L"kernel32.dll", "CloseHandle", (void**)&close_handle, (void**)&oCloseHandle);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileSize", (void**)&get_file_size, (void**)&oGetFileSize);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileSizeEx", (void**)&get_file_size_ex, (void**)&oGetFileSizeEx);
+	MH_CreateHookApi(L"kernel32.dll", "GetFileInformationByHandle", (void**)&get_file_information_by_handle, (void**)&oGetFileInformationByHandle);
+}
+
+void readahead::report()
+{
+	auto reads = total_reads.load();
+	auto syscalls = total_syscalls.load();
+
+	//Handles the game never closed are still in the map, their counts only reach the totals in close_handle
+	AcquireSRWLockShared(&handles_lock);
+	for (const auto& [handle, state] : handles)
+	{
+		EnterCriticalSection(&state->lock);
+		reads += state->reads;
+		syscalls += state->syscalls;
+		LeaveCriticalSection(&state->lock);
+	}
+	ReleaseSRWLockShared(&handles_lock);
+
+	if (reads)
+	{
+		logger::log_info(logger::va("Read-ahead: %llu reads on redirected files, %llu went to disk", reads, syscalls));
+	}
+}
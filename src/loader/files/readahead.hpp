@@ -0,0 +1,29 @@
+#pragma once
+
+#include "overlay/overlay.hpp"
+
+//Serves small sequential reads on redirected files out of a read-ahead buffer
+//Old games walk their archives a few KB at a time, without this every one of those reads is a trip into the kernel
+//Only read only handles the overlay redirected are tracked, anything else goes straight to the real API
+//Packed .mmz layer files and entries of mounted zips go through the same hooks, their reads and sizes are answered with the entry's bytes
+class readahead
+{
+public:
+	//name is the layer file the handle was opened on, only used for the report
+	static void track(HANDLE handle, const char* name);
+
+	//For a handle on a .mmz or on the zip an archived slot lives in, false when it cannot be read and the game must not get the handle
+	static bool unpack(HANDLE handle, const overlay::slot_t* slot);
+
+	//Expects MinHook to be initialized, hooks are enabled by the caller
+	static void install();
+
+	//Logs how many reads on redirected files were served and how many went to disk, called on ExitProcess
+	static void report();
+
+	static constexpr DWORD min_window = 64 * 1024;
+	static constexpr DWORD max_window = 512 * 1024;
+
+	//What every tracked handle together may hold in buffers, a 32 bit game has little address space to spare
+	static constexpr long long budget = 64ll * 1024 * 1024;
+};
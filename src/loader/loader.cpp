@@ -3,24 +3,70 @@
 #include "logger/logger.hpp"
 #include "fs/fs.hpp"
 #include "hook/hook.hpp"
+#include "overlay/overlay.hpp"
+#include "pe/pe.hpp"
+#include "pe/exports.hpp"
+#include "pe/prelink.hpp"
+#include "files/files.hpp"
+#include "files/readahead.hpp"
+#include "trace/trace.hpp"
+#include "mods/mods.hpp"
+#include "prefetch/prefetch.hpp"
 
 bool has_tls = false;
 unsigned long entry_point = 0;
 
+extern "C" IMAGE_DOS_HEADER __ImageBase;
+
+//Startup phases in the order they ran, reported once right before the game takes over
+std::vector<std::pair<const char*, double>> timings;
+
+class phase
+{
+public:
+    phase(const char* name) : name(name), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~phase()
+    {
+        const auto end = std::chrono::steady_clock::now();
+        timings.emplace_back(this->name, std::chrono::duration<double, std::milli>(end - this->start).count());
+
+        if (trace::active)
+        {
+            trace::complete(this->name, "startup", this->start, end);
+        }
+    }
+
+private:
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+void log_timings()
+{
+    std::string report;
+
+    for (const auto& timing : timings)
+    {
+        report += logger::va("%s%s %.2f ms", report.empty() ? "" : ", ", timing.first, timing.second);
+    }
+
+    logger::log_info("Startup timing: " + report);
+}
+
 #undef min
 #undef max
 
-#pragma comment(linker, "/base:0x400000")
+//The loader sits high so the game can be mapped at its own ImageBase below it, 0x400000 for nearly every x86 exe
+#pragma comment(linker, "/base:0x72000000")
 #pragma comment(linker, "/merge:.data=.cld")
 #pragma comment(linker, "/merge:.rdata=.clr")
 #pragma comment(linker, "/merge:.cl=.main")
 #pragma comment(linker, "/merge:.text=.main")
 #pragma comment(linker, "/section:.main,re")
 
-#pragma bss_seg(".payload")
-//Max we can load without crashing, maybe look into automatic data size
-char payload_data[0x70FFFFFF];
-
 #pragma data_seg(".main")
 char main_data[0x1000] = { 1 };
 
@@ -28,57 +74,238 @@ char main_data[0x1000] = { 1 };
 __declspec(thread) char tls_data[0x10000];
 #pragma optimize( "", on )
 
-void load_section(const HMODULE target, const HMODULE source, IMAGE_SECTION_HEADER* section)
+void load_sections(const HMODULE target, const pe& image)
+{
+    image.copy(reinterpret_cast<std::uint8_t*>(target));
+}
+
+HMODULE find_library(LPCSTR library)
 {
-    void* target_ptr = reinterpret_cast<void*>(reinterpret_cast<std::uint32_t>(target) + section->VirtualAddress);
-    const void* source_ptr = reinterpret_cast<void*>(reinterpret_cast<std::uint32_t>(source) + section->PointerToRawData);
+    auto handle = GetModuleHandleA(library);
 
-    if (section->SizeOfRawData > 0)
+    if (!handle)
     {
-        const auto size_of_data = std::min(section->SizeOfRawData, section->Misc.VirtualSize);
+        handle = LoadLibraryA(library);
+    }
 
-        DWORD old_protect;
-        VirtualProtect(target_ptr, size_of_data, PAGE_EXECUTE_READWRITE, &old_protect);
+    return handle;
+}
+
+//A module imports were resolved against, its export table is parsed once and shared by every descriptor naming it
+struct library_t
+{
+    HMODULE handle;
+    exports table;
+};
+
+struct import_stats_t
+{
+    std::uint32_t imports;
+    std::uint32_t modules;
+    std::uint32_t forwarded;
+    std::uint32_t fallbacks;
+    std::uint32_t deferred;
+} import_stats{};
+
+std::unordered_map<std::string, std::unique_ptr<library_t>> libraries;
 
-        std::memmove(target_ptr, source_ptr, size_of_data);
+//Lazy binds look libraries up from any thread, the lock only ever covers the map and never a LoadLibrary
+SRWLOCK libraries_lock = SRWLOCK_INIT;
+
+library_t* find_exports(std::string name)
+{
+    std::transform(name.begin(), name.end(), name.begin(), [](char c)
+    {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+
+    //Forwarders name the module without its extension
+    if (name.find('.') == std::string::npos)
+    {
+        name += ".dll";
     }
 
-    if (!strcmp((char*)(section->Name), ".tls"))
+    AcquireSRWLockShared(&libraries_lock);
+    const auto it = libraries.find(name);
+    const auto found = it != libraries.end() ? it->second.get() : nullptr;
+    ReleaseSRWLockShared(&libraries_lock);
+
+    if (found)
     {
-        has_tls = true;
+        return found;
     }
+
+    const auto handle = find_library(name.c_str());
+
+    if (!handle)
+    {
+        return nullptr;
+    }
+
+    auto library = std::make_unique<library_t>(library_t{ handle, exports(reinterpret_cast<const std::uint8_t*>(handle)) });
+
+    //Another thread may have parsed the same module in the meantime, the first one in is kept
+    AcquireSRWLockExclusive(&libraries_lock);
+    const auto emplaced = libraries.emplace(name, std::move(library));
+    import_stats.modules += emplaced.second ? 1 : 0;
+    const auto retn = emplaced.first->second.get();
+    ReleaseSRWLockExclusive(&libraries_lock);
+
+    return retn;
 }
 
-void load_sections(const HMODULE target, const HMODULE source)
+//Owner is the module the function lives in after forwarders, nullptr when only GetProcAddress knew
+FARPROC resolve_import(library_t* library, const char* name, std::uint16_t ordinal, library_t*& owner, int depth = 0)
 {
-    const auto dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(source);
-    const auto nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(reinterpret_cast<std::uint32_t>(source) + dos_header->e_lfanew);
-
-    auto section = IMAGE_FIRST_SECTION(nt_headers);
+    exports::export_t found;
+    owner = nullptr;
 
-    for (auto i = 0u; i < nt_headers->FileHeader.NumberOfSections; ++i, ++section)
+    if (name ? library->table.find(name, found) : library->table.find(ordinal, found))
     {
-        if (section)
+        if (!found.forward)
+        {
+            owner = library;
+            return reinterpret_cast<FARPROC>(reinterpret_cast<std::uintptr_t>(library->handle) + found.rva);
+        }
+
+        const char* separator = std::strrchr(found.forward, '.');
+        library_t* target = separator && depth < 8 ? find_exports(std::string(found.forward, separator)) : nullptr;
+
+        if (target)
         {
-            load_section(target, source, section);
+            const bool by_ordinal = separator[1] == '#';
+            const auto function = resolve_import(target, by_ordinal ? nullptr : separator + 1, by_ordinal ? static_cast<std::uint16_t>(std::atoi(separator + 2)) : 0, owner, depth + 1);
+
+            if (function)
+            {
+                import_stats.forwarded++;
+                return function;
+            }
         }
     }
+
+    //API set forwarders and anything else the table alone cannot answer go through the system
+    import_stats.fallbacks++;
+    return GetProcAddress(library->handle, name ? name : MAKEINTRESOURCEA(ordinal));
 }
 
-HMODULE find_library(LPCSTR library)
+//--lazy-imports points every import of a module not matched here at a stub that binds it on the first call
+//Matched by prefix, the CRTs are in by default because they export data like _iob that games read through the IAT and a stub is not data
+bool lazy_imports = false;
+std::vector<std::string> eager_imports = { "kernel32", "kernelbase", "ntdll", "msvcr", "msvcp", "ucrtbase", "vcruntime", "api-ms-win-crt" };
+
+struct lazy_t
 {
-    auto handle = GetModuleHandleA(library);
+    library_t* library;
+    const char* module;
+    const char* name; //nullptr when imported by ordinal
+    std::uint16_t ordinal;
+    std::uintptr_t* slot;
+    FARPROC function; //Set on the first call, also what stubs taken before the slot was patched jump to
+};
 
-    if (!handle)
+std::deque<lazy_t> lazy_records;
+std::mutex lazy_lock;
+
+std::uint8_t* lazy_block = nullptr;
+std::size_t lazy_block_used = 0;
+
+constexpr std::size_t lazy_stub_size = 16;
+constexpr std::size_t lazy_block_size = 0x10000;
+
+bool is_eager(std::string name)
+{
+    logger::to_lower(name);
+
+    return std::any_of(eager_imports.begin(), eager_imports.end(), [&](const std::string& prefix)
     {
-        handle = LoadLibraryA(library);
+        return !name.compare(0, prefix.size(), prefix);
+    });
+}
+
+//Resolving can load a library and wait on the loader lock, so it runs before lazy_lock is taken
+//A TLS callback or DllMain calling through a stub already holds the loader lock and would wait on us forever otherwise
+//Two threads may both resolve the same record, the first one to publish wins and the other result is the same function anyway
+extern "C" FARPROC __cdecl bind_lazy(lazy_t* record)
+{
+    library_t* owner;
+    const auto function = resolve_import(record->library, record->name, record->ordinal, owner);
+
+    //No lock may be held here, the hooked ExitProcess writes the import report and that takes lazy_lock
+    if (!function)
+    {
+        MessageBoxA(nullptr, logger::va("Unresolved import %s!%s", record->module, record->name ? record->name : logger::va("#%u", record->ordinal).c_str()).c_str(), "Loader", 0);
+        ExitProcess(1);
     }
 
-    return handle;
+    std::lock_guard<std::mutex> lock(lazy_lock);
+
+    if (!record->function)
+    {
+        record->function = function;
+        InterlockedExchange(reinterpret_cast<volatile LONG*>(record->slot), reinterpret_cast<LONG>(record->function));
+    }
+
+    return record->function;
+}
+
+//Stubs push their record and jump here, the function replaces the record on the stack so ret enters it with the caller's frame untouched
+//Every general register survives, arguments in XMM registers (__vectorcall) would not but nothing exported by a DLL uses that
+__declspec(naked) void lazy_entry()
+{
+    __asm
+    {
+        pushad
+        push dword ptr [esp + 32]
+        call bind_lazy
+        add esp, 4
+        mov [esp + 32], eax
+        popad
+        ret
+    }
+}
+
+//push record, jmp lazy_entry
+std::uintptr_t lazy_stub(lazy_t* record)
+{
+    if (!lazy_block || lazy_block_used == lazy_block_size)
+    {
+        lazy_block = static_cast<std::uint8_t*>(VirtualAlloc(nullptr, lazy_block_size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+        lazy_block_used = 0;
+    }
+
+    const auto stub = lazy_block + lazy_block_used;
+    lazy_block_used += lazy_stub_size;
+
+    const auto jump = reinterpret_cast<std::uint32_t>(&lazy_entry) - reinterpret_cast<std::uint32_t>(stub + 10);
+    stub[0] = 0x68;
+    std::memcpy(stub + 1, &record, 4);
+    stub[5] = 0xE9;
+    std::memcpy(stub + 6, &jump, 4);
+
+    return reinterpret_cast<std::uintptr_t>(stub);
+}
+
+std::unordered_map<HMODULE, std::uint32_t> recorded;
+
+//Module index in the prelink record, modules are kept by the path they were actually loaded from
+std::uint32_t record_module(prelink::builder& record, HMODULE handle)
+{
+    if (auto it = recorded.find(handle); it != recorded.end())
+    {
+        return it->second;
+    }
+
+    char path[MAX_PATH];
+    GetModuleFileNameA(handle, path, sizeof(path));
+    return recorded.emplace(handle, record.module(path, prelink::identity(reinterpret_cast<const std::uint8_t*>(handle)))).first->second;
 }
 
-void load_imports(const HMODULE target, const HMODULE source)
+//Returns false when a function could not be pinned to a module or was deferred, the record is incomplete then and must not be saved
+bool load_imports(const HMODULE target, const HMODULE source, prelink::builder& record)
 {
+    bool complete = true;
+
     const auto dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(source);
     const auto nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(reinterpret_cast<std::uint32_t>(source) + dos_header->e_lfanew);
 
@@ -87,7 +314,18 @@ void load_imports(const HMODULE target, const HMODULE source)
 
     while (descriptor->Name)
     {
-        std::string library_name = LPSTR(reinterpret_cast<std::uint32_t>(target) + descriptor->Name);
+        const auto library_name = LPCSTR(reinterpret_cast<std::uint32_t>(target) + descriptor->Name);
+        const auto library = find_exports(library_name);
+
+        if (!library)
+        {
+            throw std::runtime_error(logger::va("missing import library %s!", library_name));
+        }
+
+        //Loaded on a hit even if every function it names is forwarded elsewhere
+        record_module(record, library->handle);
+
+        const bool lazy = lazy_imports && !is_eager(library_name);
 
         auto name_table_entry = reinterpret_cast<uintptr_t*>(reinterpret_cast<std::uint32_t>(target) + descriptor->OriginalFirstThunk);
         auto address_table_entry = reinterpret_cast<uintptr_t*>(reinterpret_cast<std::uint32_t>(target) + descriptor->FirstThunk);
@@ -97,27 +335,30 @@ void load_imports(const HMODULE target, const HMODULE source)
             name_table_entry = reinterpret_cast<uintptr_t*>(reinterpret_cast<std::uint32_t>(target) + descriptor->FirstThunk);
         }
 
-        while (*name_table_entry)
+        for (; *name_table_entry; name_table_entry++, address_table_entry++)
         {
+            if (lazy)
+            {
+                const bool by_ordinal = IMAGE_SNAP_BY_ORDINAL(*name_table_entry);
+                const auto name = by_ordinal ? nullptr : PIMAGE_IMPORT_BY_NAME(reinterpret_cast<std::uint32_t>(target) + *name_table_entry)->Name;
+
+                lazy_records.push_back({ library, library_name, name, by_ordinal ? static_cast<std::uint16_t>(IMAGE_ORDINAL(*name_table_entry)) : std::uint16_t(0), address_table_entry, nullptr });
+                *address_table_entry = lazy_stub(&lazy_records.back());
+                import_stats.deferred++;
+                continue;
+            }
+
             FARPROC function = nullptr;
+            library_t* owner = nullptr;
 
             if (IMAGE_SNAP_BY_ORDINAL(*name_table_entry))
             {
-                auto module = find_library(library_name.data());
-                if (module)
-                {
-                    function = GetProcAddress(module, MAKEINTRESOURCEA(IMAGE_ORDINAL(*name_table_entry)));
-                }
+                function = resolve_import(library, nullptr, static_cast<std::uint16_t>(IMAGE_ORDINAL(*name_table_entry)), owner);
             }
             else
             {
                 auto import = PIMAGE_IMPORT_BY_NAME(reinterpret_cast<std::uint32_t>(target) + *name_table_entry);
-
-                auto module = find_library(library_name.data());
-                if (module)
-                {
-                    function = GetProcAddress(module, import->Name);
-                }
+                function = resolve_import(library, import->Name, 0, owner);
             }
 
             if (!function)
@@ -126,18 +367,38 @@ void load_imports(const HMODULE target, const HMODULE source)
             }
 
             *address_table_entry = reinterpret_cast<uintptr_t>(function);
+            import_stats.imports++;
 
-            name_table_entry++;
-            address_table_entry++;
+            HMODULE owner_handle = owner ? owner->handle : nullptr;
+
+            if (!owner_handle)
+            {
+                GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, reinterpret_cast<LPCSTR>(function), &owner_handle);
+            }
+
+            if (owner_handle)
+            {
+                record.bind(reinterpret_cast<std::uint32_t>(address_table_entry) - reinterpret_cast<std::uint32_t>(target), record_module(record, owner_handle),
+                    reinterpret_cast<std::uint32_t>(function) - reinterpret_cast<std::uint32_t>(owner_handle));
+            }
+            else
+            {
+                complete = false;
+            }
         }
 
         descriptor++;
     }
+
+    logger::log_info(logger::va("Resolved %u imports from %u modules, %u forwarded, %u through GetProcAddress, %u deferred",
+        import_stats.imports, import_stats.modules, import_stats.forwarded, import_stats.fallbacks, import_stats.deferred));
+
+    return complete && !import_stats.deferred;
 }
 
 void verify_tls()
 {
-    const auto self = GetModuleHandleA(nullptr);
+    const auto self = reinterpret_cast<HMODULE>(&__ImageBase);
     const auto dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(self);
     const auto nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(reinterpret_cast<std::uint32_t>(self) + dos_header->e_lfanew);
 
@@ -156,53 +417,293 @@ void verify_tls()
     }
 }
 
+//Reserves exactly SizeOfImage at the game's preferred base, only the headers and the sections are committed
+std::uint8_t* map_image(const pe& image)
+{
+    const auto base = reinterpret_cast<std::uint8_t*>(static_cast<std::uintptr_t>(image.image_base()));
+
+    if (!VirtualAlloc(base, image.size_of_image(), MEM_RESERVE, PAGE_NOACCESS))
+    {
+        return nullptr;
+    }
+
+    const auto headers = std::min<std::size_t>({ image.size_of_headers(), image.size_of_image(), image.size() });
+    VirtualAlloc(base, headers, MEM_COMMIT, PAGE_READWRITE);
+    std::memcpy(base, image.bytes(), headers);
+
+    for (const auto& section : image.section_list())
+    {
+        const auto size = std::max(section.virtual_size, section.raw_size);
+
+        if (size && section.virtual_address < image.size_of_image())
+        {
+            VirtualAlloc(base + section.virtual_address, std::min(size, image.size_of_image() - section.virtual_address), MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+        }
+    }
+
+    return base;
+}
+
+std::string prelink_path(std::uint64_t key)
+{
+    return fs::get_pref_dir() + logger::va("cache\\images\\%016llX.img", key);
+}
+
+//Lays the game out from a prelink cache entry, nullptr if there is none or any module it was bound against changed
+//Modules are checked before anything is reserved so a stale entry costs nothing but the loads the normal path does anyway
+std::uint8_t* load_cached(const pe& image, std::uint64_t key)
+{
+    const auto file = CreateFileA(prelink_path(key).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER size;
+    const auto mapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+
+    if (!mapping)
+    {
+        return nullptr;
+    }
+
+    const auto view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+
+    if (!view)
+    {
+        return nullptr;
+    }
+
+    const auto header = prelink::open(view, static_cast<std::size_t>(size.QuadPart), key);
+
+    if (!header || header->image_base != image.image_base() || header->image_size != image.size_of_image())
+    {
+        UnmapViewOfFile(view);
+        return nullptr;
+    }
+
+    std::vector<std::uintptr_t> handles;
+
+    for (std::uint32_t i = 0; i < header->module_count; i++)
+    {
+        const auto& expected = prelink::modules(header)[i];
+        const auto handle = find_library(prelink::name(header, expected));
+        const auto found = handle ? prelink::identity(reinterpret_cast<const std::uint8_t*>(handle)) : prelink::module_t{};
+
+        if (!handle || found.time_stamp != expected.time_stamp || found.size_of_image != expected.size_of_image || found.checksum != expected.checksum)
+        {
+            logger::log_info(logger::va("Prelinked image is stale, %s changed", prelink::name(header, expected)));
+            UnmapViewOfFile(view);
+            return nullptr;
+        }
+
+        handles.emplace_back(reinterpret_cast<std::uintptr_t>(handle));
+    }
+
+    const auto base = reinterpret_cast<std::uint8_t*>(static_cast<std::uintptr_t>(header->image_base));
+
+    if (!VirtualAlloc(base, header->image_size, MEM_RESERVE, PAGE_NOACCESS))
+    {
+        UnmapViewOfFile(view);
+        return nullptr;
+    }
+
+    for (std::uint32_t i = 0; i < header->range_count; i++)
+    {
+        const auto& range = prelink::ranges(header)[i];
+
+        if (range.commit)
+        {
+            VirtualAlloc(base + range.rva, range.commit, MEM_COMMIT, range.rva ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE);
+            std::memcpy(base + range.rva, view + range.offset, range.data);
+        }
+    }
+
+    for (std::uint32_t i = 0; i < header->binding_count; i++)
+    {
+        const auto& binding = prelink::bindings(header)[i];
+        *reinterpret_cast<std::uintptr_t*>(base + binding.iat) = handles[binding.module] + binding.rva;
+    }
+
+    logger::log_info(logger::va("Prelinked image: %u ranges, %u bindings against %u modules", header->range_count, header->binding_count, header->module_count));
+    UnmapViewOfFile(view);
+    return base;
+}
+
+//Makes the mapped game the process image for GetModuleHandle(nullptr), resource lookups and the loader's module list
+void adopt_image(std::uint8_t* base, const pe& image)
+{
+    const auto peb = __readfsdword(0x30);
+    *reinterpret_cast<void**>(peb + 0x8) = base; //ImageBaseAddress
+
+    //First entry in load order is the exe
+    const auto ldr = *reinterpret_cast<std::uintptr_t*>(peb + 0xC);
+    const auto entry = *reinterpret_cast<std::uintptr_t*>(ldr + 0xC);
+    *reinterpret_cast<void**>(entry + 0x18) = base; //DllBase
+    *reinterpret_cast<ULONG*>(entry + 0x20) = image.size_of_image(); //SizeOfImage
+}
+
+void log_address_space()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    std::uint64_t reserved = 0, committed = 0, available = 0, largest = 0;
+    auto address = reinterpret_cast<std::uintptr_t>(info.lpMinimumApplicationAddress);
+    MEMORY_BASIC_INFORMATION region;
+
+    while (address < reinterpret_cast<std::uintptr_t>(info.lpMaximumApplicationAddress) && VirtualQuery(reinterpret_cast<void*>(address), &region, sizeof(region)))
+    {
+        switch (region.State)
+        {
+        case MEM_RESERVE:
+            reserved += region.RegionSize;
+            break;
+        case MEM_COMMIT:
+            committed += region.RegionSize;
+            break;
+        case MEM_FREE:
+            available += region.RegionSize;
+            largest = std::max<std::uint64_t>(largest, region.RegionSize);
+            break;
+        }
+
+        const auto next = reinterpret_cast<std::uintptr_t>(region.BaseAddress) + region.RegionSize;
+
+        if (next <= address)
+        {
+            break;
+        }
+
+        address = next;
+    }
+
+    logger::log_info(logger::va("Address space: %llu MB reserved, %llu MB committed, %llu MB free, largest free block %llu MB",
+        reserved >> 20, committed >> 20, available >> 20, largest >> 20));
+}
+
 void loader::load(const char* bin_name)
 {
     memset(tls_data, 0, sizeof tls_data);
 
-    std::ifstream bin(bin_name, std::ifstream::binary);
+    std::optional<phase> reading(std::in_place, "read");
+
+    //The exe is read through a mapped view so sections go from the page cache straight into the reserved image, no heap copy of the file
+    const auto file = CreateFileA(bin_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    LARGE_INTEGER binary_size;
+    FILETIME write_time{};
+    const auto mapping = GetFileSizeEx(file, &binary_size) && GetFileTime(file, nullptr, nullptr, &write_time) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
 
-    if (!bin.is_open())
+    if (!mapping)
     {
         return;
     }
 
-    bin.seekg(0, bin.end);
-    auto binary_size = bin.tellg();
-    bin.seekg(0, bin.beg);
+    const auto view = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+
+    if (!view)
+    {
+        return;
+    }
 
-    std::vector<std::uint8_t> executable_buffer;
-    executable_buffer.resize(binary_size);
+    const pe image(view, static_cast<std::size_t>(binary_size.QuadPart));
+    reading.reset();
 
-    bin.read(reinterpret_cast<char*>(&executable_buffer[0]), binary_size);
+    if (!image.valid())
+    {
+        UnmapViewOfFile(view);
+        return;
+    }
 
-    const auto module = GetModuleHandleA(nullptr);
+    const auto module = reinterpret_cast<HMODULE>(&__ImageBase);
     const auto module_dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(module);
     const auto module_nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(reinterpret_cast<uint32_t>(module) + module_dos_header->e_lfanew);
 
-    const auto source = reinterpret_cast<HMODULE>(&executable_buffer[0]);
+    const auto source = reinterpret_cast<HMODULE>(const_cast<std::uint8_t*>(view));
     const auto source_dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(source);
     const auto source_nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(reinterpret_cast<uint32_t>(source) + source_dos_header->e_lfanew);
 
-    if (source_nt_headers->FileHeader.Machine == IMAGE_FILE_MACHINE_AMD64)
+    if (image.machine() == pe::machine_amd64)
     {
         MessageBoxA(nullptr, "This binary is x64, this loader only supports x86 binaires!", "Loader", 0);
         exit(0);
     }
 
-    load_sections(module, source);
-    load_imports(module, source);
+    for (const auto& section : image.section_list())
+    {
+        if (section.named(".tls"))
+        {
+            has_tls = true;
+        }
+    }
+
+    const auto key = prelink::key(view, std::min<std::size_t>(image.size(), 0x1000), binary_size.QuadPart, (std::uint64_t(write_time.dwHighDateTime) << 32) | write_time.dwLowDateTime);
+
+    //Lazy slots are not bindings, a cached image could not recreate their stubs
+    std::uint8_t* base = nullptr;
+    if (!lazy_imports)
+    {
+        phase timing("prelink");
+        base = load_cached(image, key);
+    }
+
+    if (!base)
+    {
+        {
+            phase timing("map");
+            base = map_image(image);
+        }
+
+        if (!base)
+        {
+            MessageBoxA(nullptr, logger::va("Could not reserve 0x%X bytes at 0x%08X for the game image!", image.size_of_image(), static_cast<std::uint32_t>(image.image_base())).c_str(), "Loader", 0);
+            exit(0);
+        }
+
+        {
+            phase timing("sections");
+            load_sections(reinterpret_cast<HMODULE>(base), image);
+        }
+
+        prelink::builder record;
+        bool complete;
+        {
+            phase timing("imports");
+            complete = load_imports(reinterpret_cast<HMODULE>(base), source, record);
+        }
+
+        //Next launch of this exe skips mapping and import resolution
+        if (complete)
+        {
+            phase timing("prelink save");
+            prelink::save(prelink_path(key), record.finish(key, image));
+        }
+    }
+
+    const auto target = reinterpret_cast<HMODULE>(base);
 
     if (source_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].Size)
     {
+        phase timing("tls");
+
         if (!module_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress)
         {
             __debugbreak();
         }
 
-
         const auto target_tls = reinterpret_cast<PIMAGE_TLS_DIRECTORY>(reinterpret_cast<uint32_t>(module) + module_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress);
-        const auto source_tls = reinterpret_cast<PIMAGE_TLS_DIRECTORY>(reinterpret_cast<uint32_t>(module) + source_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress);
+        const auto source_tls = reinterpret_cast<PIMAGE_TLS_DIRECTORY>(reinterpret_cast<uint32_t>(target) + source_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress);
 
         const auto source_tls_size = source_tls->EndAddressOfRawData - source_tls->StartAddressOfRawData;
         const auto target_tls_size = target_tls->EndAddressOfRawData - target_tls->StartAddressOfRawData;
@@ -221,86 +722,65 @@ void loader::load(const char* bin_name)
 
     entry_point = (source_nt_headers->OptionalHeader.ImageBase + source_nt_headers->OptionalHeader.AddressOfEntryPoint);
 
-    DWORD old_protect;
-    VirtualProtect(module_nt_headers, 0x1000, PAGE_EXECUTE_READWRITE, &old_protect);
-
-    module_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT] = source_nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
-    std::memmove(module_nt_headers, source_nt_headers, sizeof(IMAGE_NT_HEADERS) + (module_nt_headers->FileHeader.NumberOfSections * (sizeof(IMAGE_SECTION_HEADER))));
+    adopt_image(base, image);
+    UnmapViewOfFile(view);
 
     if (has_tls)
     {
         verify_tls();
     }
+
+    logger::log_info(logger::va("Mapped %s at 0x%08X, 0x%X bytes", bin_name, reinterpret_cast<std::uint32_t>(base), image.size_of_image()));
+    log_address_space();
 }
 
 std::string game_name;
 std::string pack_name;
 std::string cwd;
 
-static HANDLE(__stdcall* oCreateFile)(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
-	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
-
-HANDLE __stdcall create_file(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
-	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+//Which deferred imports the game actually called, cache\<game>\lazy_imports.txt
+void write_import_report()
 {
-	//Convert to string for easier string ops
-	//Would def be fast to use C
-	std::string file_name = lpFileName;
-
-	//If we found a file that is read from the game dir
-	if (file_name.find(cwd) != std::string::npos)
-	{
-		//Shorten the filename to the game dir
-		file_name = logger::replace(file_name, "/", "\\").erase(0, cwd.length());
-
-		//Global comes first
-		std::string global = fs::get_pref_dir().append("mods\\" + game_name + "\\_global" + file_name);
-		if (fs::exists(file_name))
-		{
-			//logger::log("GLOBAL", global);
-			return oCreateFile(global.c_str(), dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
-		}
-
-		//Then pack
-		std::string pack = fs::get_pref_dir().append("mods\\" + game_name + "\\" + pack_name + file_name);
-		if (fs::exists(pack))
-		{
-			//logger::log("PACK", pack);
-			return oCreateFile(pack.c_str(), dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
-		}
-	}
-	//Or potentially relative
-	else
-	{
-		if (file_name.find(getenv("LOCALAPPDATA")) == std::string::npos)
-		{
-			//Global comes first
-			std::string global = fs::get_pref_dir().append("mods\\" + game_name + "\\_global\\" + file_name);
-			if (fs::exists(file_name))
-			{
-				//logger::log("GLOBAL", global);
-				return oCreateFile(global.c_str(), dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
-			}
-
-			//Then pack
-			std::string pack = fs::get_pref_dir().append("mods\\" + game_name + "\\" + pack_name + "\\" + file_name);
-			if (fs::exists(pack))
-			{
-				//logger::log("PACK", pack);
-				return oCreateFile(pack.c_str(), dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
-			}
-		}
-	}
-
-	//Then original if nothing found
-	return oCreateFile(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+    std::lock_guard<std::mutex> lock(lazy_lock);
+
+    std::string used, unused;
+    std::uint32_t count = 0;
+
+    for (const auto& record : lazy_records)
+    {
+        const auto line = logger::va("%s!%s\r\n", record.module, record.name ? record.name : logger::va("#%u", record.ordinal).c_str());
+        (record.function ? used : unused).append(line);
+        count += record.function ? 1 : 0;
+    }
+
+    const auto folder = fs::get_pref_dir().append(logger::va("cache\\%s\\", game_name.c_str()));
+    fs::mkdir(folder);
+    fs::write(folder + "lazy_imports.txt", logger::va("%u of %u deferred imports were called\r\n\r\n[used]\r\n", count, lazy_records.size()) + used + "\r\n[unused]\r\n" + unused, false);
+
+    logger::log_info(logger::va("Lazy imports: %u of %u deferred imports were called", count, lazy_records.size()));
 }
 
-std::initializer_list<std::string> ext_whitelist
+//Reports have to be written however the game quits, its own CRT ends in ExitProcess and never runs our atexit
+void(WINAPI* exit_process_original)(UINT);
+
+void WINAPI exit_process(UINT code)
 {
-    ".dll",
-    ".asi",
-};
+    if (lazy_imports)
+    {
+        write_import_report();
+    }
+
+    if (overlay::counting)
+    {
+        logger::log_info(logger::va("Overlay lookups: %llu, filtered: %llu, hits: %llu, false positives: %llu",
+            overlay::stats.lookups.load(), overlay::stats.rejected.load(), overlay::stats.hits.load(), overlay::stats.false_positives.load()));
+    }
+
+    readahead::report();
+    trace::write();
+    prefetch::save();
+    exit_process_original(code);
+}
 
 int init()
 {
@@ -312,11 +792,19 @@ int init()
     std::freopen("CONIN$", "r", stdin);
 #endif
 
+    const char* exe = nullptr;
+    const char* manifest = nullptr;
+    const char* parents = nullptr;
+    bool tracing = false;
+    bool parallel_mods = false;
+    bool replay = true;
+    int trace_files = 256;
+
     for (auto i = 0; i < __argc; i++)
     {
         if (!strcmp("--exe", __argv[i]))
         {
-            loader::load(__argv[i + 1]);
+            exe = __argv[i + 1];
         }
         else if (!strcmp("--cwd", __argv[i]))
         {
@@ -331,43 +819,115 @@ int init()
         {
             pack_name = __argv[i + 1];
         }
-    }
-
-    //Load _global
-    std::string global = fs::get_pref_dir().append(logger::va("mods\\%s\\_global\\", game_name.c_str()));
-    for (auto bin : fs::get_all_files(global))
-    {
-        for (auto ext : ext_whitelist)
+        else if (!strcmp("--manifest", __argv[i]))
+        {
+            manifest = __argv[i + 1];
+        }
+        else if (!strcmp("--parents", __argv[i]))
+        {
+            parents = __argv[i + 1];
+        }
+        else if (!strcmp("--trace", __argv[i]))
         {
-            if (logger::ends_with(bin, ext))
+            tracing = true;
+        }
+        else if (!strcmp("--trace-files", __argv[i]))
+        {
+            trace_files = std::atoi(__argv[i + 1]);
+        }
+        else if (!strcmp("--parallel-mods", __argv[i]))
+        {
+            parallel_mods = true;
+        }
+        else if (!strcmp("--no-prefetch", __argv[i]))
+        {
+            replay = false;
+        }
+        else if (!strcmp("--lazy-imports", __argv[i]))
+        {
+            lazy_imports = true;
+        }
+        else if (!strcmp("--eager", __argv[i]))
+        {
+            for (auto name : logger::split(__argv[i + 1], ","))
             {
-                std::string to_load = global + bin;
-                LoadLibraryA(to_load.c_str());
+                name.erase(0, name.find_first_not_of(' '));
+                name.erase(name.find_last_not_of(' ') + 1);
+                logger::to_lower(name);
+
+                if (!name.empty())
+                {
+                    eager_imports.emplace_back(name);
+                }
             }
         }
     }
 
-    //Load pack
-    std::string pack = fs::get_pref_dir().append(logger::va("mods\\%s\\%s\\", game_name.c_str(), pack_name.c_str()));
-    for (auto bin : fs::get_all_files(fs::get_pref_dir().append(logger::va("mods\\%s\\%s\\", game_name.c_str(), pack_name.c_str()))))
+    //Written next to the pack folder, inside it the trace would be indexed as a mod file on the next launch
+    if (tracing)
+    {
+        trace::enable(fs::get_pref_dir().append(logger::va("mods\\%s\\%s.trace.json", game_name.c_str(), pack_name.c_str())),
+            logger::va("%s (%s)", game_name.c_str(), pack_name.c_str()), trace_files);
+    }
+
+    //The last launch's files are read in the background while the exe is mapped, this launch is recorded for the next one
+    prefetch::start(fs::get_pref_dir().append(logger::va("cache\\%s\\%s.prefetch", game_name.c_str(), pack_name.c_str())),
+        fs::get_pref_dir().append(logger::va("cache\\%s\\%s.launches.csv", game_name.c_str(), pack_name.c_str())), replay);
+
+    if (exe)
+    {
+        loader::load(exe);
+    }
+
+    //The app hands us a prebuilt manifest, only walk the mod trees ourselves if it is missing or stale
+    std::optional<phase> timing(std::in_place, "overlay");
+
+    //What the game writes lands here, above every mod layer, so switching packs never touches the install
+    const std::string saves = fs::get_pref_dir().append(logger::va("saves\\%s\\%s\\", game_name.c_str(), pack_name.c_str()));
+
+    if (!manifest || !overlay::load(manifest))
     {
-        for (auto ext : ext_whitelist)
+        std::string mods = fs::get_pref_dir().append(logger::va("mods\\%s\\", game_name.c_str()));
+
+        overlay::builder builder;
+        builder.walk(saves, overlay::write_layer);
+        builder.walk(mods + "_global", "_global");
+        builder.walk(mods + pack_name, pack_name);
+
+        //Already flattened by the app, nearest parent first
+        for (const auto& parent : parents ? logger::split(parents, ",") : std::vector<std::string>())
         {
-            if (logger::ends_with(bin, ext))
-            {
-                std::string to_load = pack + bin;
-                LoadLibraryA(to_load.c_str());
-            }
+            builder.walk(mods + parent, parent);
         }
+
+        overlay::use(builder.finish(0));
     }
 
+    overlay::build_filter();
+    files::init(cwd, saves);
+    logger::log_info(logger::va("Indexed %i overlay entries", overlay::size()));
+    timing.emplace("mods");
+
+    //Profiling the mods hooks CreateThread and VirtualProtect, so MinHook is up before they load
 	MH_Initialize();
 
-	//MH_CreateHookApi(L"kernel32.dll", "ReadFile", (void**)&read_file, (void**)&oReadFile);
-	MH_CreateHookApi(L"kernel32.dll", "CreateFileA", (void**)&create_file, (void**)&oCreateFile);
+    //Load _global then pack, the app shows the report in its Mods windows
+    mods::load(overlay::modules(), fs::get_pref_dir().append(logger::va("cache\\%s\\%s.mods.csv", game_name.c_str(), pack_name.c_str())), parallel_mods);
+
+    timing.emplace("hooks");
+
+	files::install();
+	readahead::install();
+    prefetch::install();
+
+    MH_CreateHookApi(L"kernel32.dll", "ExitProcess", &exit_process, reinterpret_cast<void**>(&exit_process_original));
 
 	MH_EnableHook(MH_ALL_HOOKS);
 
+    timing.reset();
+
+    log_timings();
+
     return loader::run(entry_point);
 }
 
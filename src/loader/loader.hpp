@@ -6,6 +6,12 @@
 #include <vector>
 #include <fstream>
 #include <functional>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <unordered_map>
 
 //Deps
 #include "MinHook.h"
@@ -0,0 +1,339 @@
+#include "loader.hpp"
+#include "mods.hpp"
+
+#include <psapi.h>
+
+#include "logger/logger.hpp"
+#include "fs/fs.hpp"
+#include "trace/trace.hpp"
+#include "pe/mapper.hpp"
+#include "pe/exports.hpp"
+
+namespace
+{
+	struct cost_t
+	{
+		std::string path; //layer\name
+		double milliseconds;
+		long long private_bytes;
+		std::uint32_t threads;
+		std::uint32_t hooks;
+		bool loaded;
+		std::string error; //Why it was not mapped, empty when it was or when mods load serially
+	};
+
+	//Only counted while a mod is loading, the hooks stay installed afterwards so a mod hooking the same functions is never undone
+	std::atomic<bool> profiling{ false };
+	std::atomic<std::uint32_t> threads{ 0 };
+	std::atomic<std::uint32_t> patches{ 0 };
+
+	decltype(&CreateThread) oCreateThread;
+	decltype(&VirtualProtect) oVirtualProtect;
+
+	HANDLE __stdcall create_thread(LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter,
+		DWORD dwCreationFlags, LPDWORD lpThreadId)
+	{
+		if (profiling)
+		{
+			threads++;
+		}
+
+		return oCreateThread(lpThreadAttributes, dwStackSize, lpStartAddress, lpParameter, dwCreationFlags, lpThreadId);
+	}
+
+	//Writable code is what MinHook and every other patcher asks for right before it writes a jump
+	BOOL __stdcall virtual_protect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, PDWORD lpflOldProtect)
+	{
+		if (profiling && (flNewProtect & (PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)))
+		{
+			patches++;
+		}
+
+		return oVirtualProtect(lpAddress, dwSize, flNewProtect, lpflOldProtect);
+	}
+
+	long long private_bytes()
+	{
+		PROCESS_MEMORY_COUNTERS_EX counters{};
+		GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters));
+		return static_cast<long long>(counters.PrivateUsage);
+	}
+
+	//Overlay targets are UTF-8, they have to go through the wide API to survive codepages that cannot represent them
+	const wchar_t* widen(const char* target, wchar_t* buffer, int size)
+	{
+		return MultiByteToWideChar(CP_UTF8, 0, target, -1, buffer, size) ? buffer : nullptr;
+	}
+
+	//A mod laid out by a worker thread, waiting for its turn to run DllMain
+	struct image_t
+	{
+		std::uint8_t* base = nullptr;
+		std::uint32_t size = 0;
+		std::uint32_t entry = 0;
+		double milliseconds = 0;
+		std::string error; //Why it goes through LoadLibrary instead
+	};
+
+	//Mods are mapped privately and never show up in the module list, an import naming one would pull in a second copy
+	std::vector<std::string> mod_names;
+
+	std::mutex library_lock;
+	std::unordered_map<std::string, std::pair<HMODULE, std::unique_ptr<exports>>> libraries;
+
+	//Called from every worker at once, only the library table is shared
+	std::uint64_t resolve(const char* module, const char* name, std::uint16_t ordinal)
+	{
+		std::string key(module);
+		logger::to_lower(key);
+
+		if (std::find(mod_names.begin(), mod_names.end(), key) != mod_names.end())
+		{
+			return 0;
+		}
+
+		HMODULE handle;
+		const exports* table;
+		{
+			std::lock_guard<std::mutex> lock(library_lock);
+			auto it = libraries.find(key);
+
+			if (it == libraries.end())
+			{
+				handle = GetModuleHandleA(module);
+				handle = handle ? handle : LoadLibraryA(module);
+
+				if (!handle)
+				{
+					return 0;
+				}
+
+				it = libraries.emplace(key, std::make_pair(handle, std::make_unique<exports>(reinterpret_cast<const std::uint8_t*>(handle)))).first;
+			}
+
+			handle = it->second.first;
+			table = it->second.second.get();
+		}
+
+		exports::export_t found;
+
+		if ((name ? table->find(name, found) : table->find(ordinal, found)) && !found.forward)
+		{
+			return reinterpret_cast<std::uintptr_t>(handle) + found.rva;
+		}
+
+		return reinterpret_cast<std::uintptr_t>(GetProcAddress(handle, name ? name : MAKEINTRESOURCEA(ordinal)));
+	}
+
+	//Read, place, relocate and bind one mod, anything unusual is left to LoadLibrary
+	image_t map(const char* module)
+	{
+		trace::span span("map", "mods", module);
+
+		image_t retn;
+		const auto start = std::chrono::steady_clock::now();
+
+		wchar_t wide[MAX_PATH * 2];
+		const auto file = widen(module, wide, MAX_PATH * 2) ? CreateFileW(wide, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) : INVALID_HANDLE_VALUE;
+
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			retn.error = "cannot be opened";
+			return retn;
+		}
+
+		LARGE_INTEGER size;
+		const auto mapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		CloseHandle(file);
+
+		const auto view = mapping ? static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+		if (mapping)
+		{
+			CloseHandle(mapping);
+		}
+
+		if (!view)
+		{
+			retn.error = "cannot be mapped";
+			return retn;
+		}
+
+		const pe image(view, static_cast<std::size_t>(size.QuadPart));
+
+		//Static TLS needs a slot only the system loader hands out
+		if (!image.valid() || image.machine() != pe::machine_i386)
+		{
+			retn.error = "is not an x86 image";
+		}
+		else if (image.directory(pe::directory_tls).size)
+		{
+			retn.error = "has TLS";
+		}
+		//x86 only dispatches to handlers inside registered images, a mod in private memory could never catch an exception
+		//Only images that have no handlers at all, either marked so or with an empty SafeSEH table, are safe to map
+		else if (!(image.dll_characteristics() & pe::dll_no_seh) && image.safe_handlers() != 0)
+		{
+			retn.error = "has exception handlers";
+		}
+		else
+		{
+			auto base = static_cast<std::uint8_t*>(VirtualAlloc(reinterpret_cast<void*>(static_cast<std::uintptr_t>(image.image_base())), image.size_of_image(), MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE));
+			base = base ? base : static_cast<std::uint8_t*>(VirtualAlloc(nullptr, image.size_of_image(), MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE));
+
+			if (base && mapper::map(image, base, reinterpret_cast<std::uintptr_t>(base), resolve, retn.error))
+			{
+				retn.base = base;
+				retn.size = image.size_of_image();
+				retn.entry = image.entry_point();
+			}
+			else if (base)
+			{
+				VirtualFree(base, 0, MEM_RELEASE);
+			}
+			else
+			{
+				retn.error = "has no room";
+			}
+		}
+
+		UnmapViewOfFile(view);
+		retn.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return retn;
+	}
+
+	//DllMain of a mapped mod, on the main thread and in load order like LoadLibrary would
+	bool attach(image_t& image)
+	{
+		FlushInstructionCache(GetCurrentProcess(), image.base, image.size);
+
+		if (!image.entry)
+		{
+			return true;
+		}
+
+		const auto entry = reinterpret_cast<BOOL(WINAPI*)(HINSTANCE, DWORD, LPVOID)>(image.base + image.entry);
+
+		if (!entry(reinterpret_cast<HINSTANCE>(image.base), DLL_PROCESS_ATTACH, nullptr))
+		{
+			VirtualFree(image.base, 0, MEM_RELEASE);
+			image.base = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+	//The kernelbase export is where kernel32's stub and every api-set import of a ucrt built mod end up, std::thread included
+	//Windows 7 and older have neither there, kernel32 still is where the work happens on those
+	void hook(LPCSTR name, LPVOID detour, LPVOID* original)
+	{
+		LPVOID target;
+
+		for (auto module : { L"kernelbase.dll", L"kernel32.dll" })
+		{
+			if (GetModuleHandleW(module) && MH_CreateHookApiEx(module, name, detour, original, &target) == MH_OK)
+			{
+				MH_EnableHook(target);
+				return;
+			}
+		}
+	}
+}
+
+//Mods sit at the root of their layer, the report names them by layer and file so the app can match its own listing
+void mods::load(const std::vector<const char*>& modules, const std::string& report, bool parallel)
+{
+	std::vector<image_t> images(modules.size());
+
+	//Reading, relocating and binding overlap on a pool, DllMain still runs below in the same order as before
+	if (parallel)
+	{
+		for (auto module : modules)
+		{
+			const std::string_view path(module);
+			std::string name(path.substr(path.find_last_of("\\/") + 1));
+			logger::to_lower(name);
+			mod_names.emplace_back(name);
+		}
+
+		trace::span span("map mods", "startup");
+		mapper::parallel(modules.size(), std::thread::hardware_concurrency(), [&](std::size_t i)
+		{
+			images[i] = map(modules[i]);
+		});
+	}
+
+	hook("CreateThread", &create_thread, reinterpret_cast<LPVOID*>(&oCreateThread));
+	hook("VirtualProtect", &virtual_protect, reinterpret_cast<LPVOID*>(&oVirtualProtect));
+
+	std::vector<cost_t> costs;
+
+	for (std::size_t i = 0; i < modules.size(); i++)
+	{
+		const auto module = modules[i];
+		auto& image = images[i];
+
+		trace::span span(image.base ? "DllMain" : "LoadLibrary", "mods", module);
+
+		wchar_t wide[MAX_PATH * 2];
+		if (!widen(module, wide, MAX_PATH * 2))
+		{
+			continue;
+		}
+
+		if (parallel && !image.base)
+		{
+			logger::log_info(logger::va("%s %s, loading it normally", module, image.error.c_str()));
+		}
+
+		const std::string_view path(module);
+		const auto name = path.find_last_of("\\/");
+		const auto layer = name == std::string_view::npos || !name ? std::string_view::npos : path.find_last_of("\\/", name - 1);
+
+		cost_t cost{ std::string(layer == std::string_view::npos ? path : path.substr(layer + 1)) };
+		cost.error = parallel && !image.base ? image.error : "";
+		std::replace(cost.error.begin(), cost.error.end(), ',', ' ');
+
+		threads = 0;
+		patches = 0;
+		const auto memory = private_bytes();
+		const auto start = std::chrono::steady_clock::now();
+
+		profiling = true;
+		cost.loaded = image.base ? attach(image) : LoadLibraryW(wide) != nullptr;
+		profiling = false;
+
+		const auto error = GetLastError();
+
+		//A mapped mod was read and bound on a worker, its share of that is part of what it costs
+		cost.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() + image.milliseconds;
+		cost.private_bytes = private_bytes() - memory + (image.base ? image.size : 0);
+		cost.threads = threads;
+		cost.hooks = patches;
+
+		if (!cost.loaded)
+		{
+			logger::log_warning(logger::va("Could not load %s, error %u", module, error));
+		}
+
+		costs.emplace_back(std::move(cost));
+	}
+
+	std::stable_sort(costs.begin(), costs.end(), [](const cost_t& a, const cost_t& b)
+	{
+		return a.milliseconds > b.milliseconds;
+	});
+
+	//Path last so it can hold commas
+	std::string csv = "ms,private_kb,threads,hooks,loaded,error,path\r\n";
+
+	for (const auto& cost : costs)
+	{
+		csv.append(logger::va("%.2f,%lld,%u,%u,%u,%s,%s\r\n", cost.milliseconds, cost.private_bytes / 1024, cost.threads, cost.hooks, cost.loaded ? 1u : 0u, cost.error.c_str(), cost.path.c_str()));
+		logger::log_info(logger::va("Mod %s: %.2f ms, %lld KB private, %u threads, %u hooks", cost.path.c_str(), cost.milliseconds, cost.private_bytes / 1024, cost.threads, cost.hooks));
+	}
+
+	fs::mkdir(std::filesystem::u8path(report).parent_path().u8string());
+	fs::write(report, csv, false);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//Loads the mod binaries of every layer and measures what each one cost
+//Wall time covers LoadLibrary including DllMain, private bytes is the growth of committed private memory
+//Threads and hooks are the CreateThread calls and writable code protections seen while the mod was loading
+//In parallel mode the images are read, relocated and bound on a thread pool first and only DllMain runs in order
+//Manually mapped mods are not in the module list, GetModuleFileName and GetModuleHandle do not know them
+//Mods that are not x86, have static TLS or have exception handlers, which x86 refuses outside a registered image, go through LoadLibrary
+//The error column of the report says why a mod was not mapped
+class mods
+{
+public:
+	static void load(const std::vector<const char*>& modules, const std::string& report, bool parallel);
+};
@@ -0,0 +1,299 @@
+#include "loader.hpp"
+#include "prefetch.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <unordered_set>
+
+#include "logger/logger.hpp"
+#include "fs/fs.hpp"
+#include "trace/trace.hpp"
+
+#undef min
+#undef max
+
+namespace
+{
+	struct entry_t
+	{
+		std::wstring path;
+		long long size;
+	};
+
+	constexpr auto record_window = std::chrono::seconds(60);
+	constexpr std::size_t record_limit = 8192;
+
+	//Big archives are only read ahead as far as their index and first assets usually go
+	constexpr long long file_budget = 32ll << 20;
+	constexpr long long total_budget = 1ll << 30;
+
+	std::string list_path;
+	std::string report_path;
+	std::chrono::steady_clock::time_point started;
+
+	std::mutex lock;
+	std::vector<entry_t> entries;
+	std::unordered_set<std::wstring> seen;
+	bool saved = false;
+
+	DWORD replay_thread = 0;
+	std::atomic<unsigned> replayed{ 0 };
+	std::atomic<bool> shown{ false };
+
+	BOOL(__stdcall* oPeekMessageA)(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
+	BOOL(__stdcall* oPeekMessageW)(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
+	BOOL(__stdcall* oGetMessageA)(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
+	BOOL(__stdcall* oGetMessageW)(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
+
+	std::string narrow(const std::wstring& text)
+	{
+		std::string retn(text.size() * 3, '\0');
+		retn.resize(WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &retn[0], static_cast<int>(retn.size()), nullptr, nullptr));
+		return retn;
+	}
+
+	void create_parent(const std::string& path)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::u8path(path).parent_path(), ec);
+	}
+
+	std::wstring widen(const std::string& text)
+	{
+		std::wstring retn(text.size(), L'\0');
+		retn.resize(MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &retn[0], static_cast<int>(retn.size())));
+		return retn;
+	}
+
+	//Reads the files of the last launch in the order it opened them, the data only has to land in the system cache
+	DWORD __stdcall read_ahead(LPVOID parameter)
+	{
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+		const std::unique_ptr<std::vector<entry_t>> list(static_cast<std::vector<entry_t>*>(parameter));
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<char> buffer(1 << 20);
+		long long total = 0;
+
+		for (const auto& entry : *list)
+		{
+			if (total >= total_budget)
+			{
+				break;
+			}
+
+			const auto file = CreateFileW(entry.path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				continue;
+			}
+
+			DWORD read;
+			for (long long left = std::min(entry.size, file_budget); left > 0 && ReadFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &read, nullptr) && read; left -= read)
+			{
+				total += read;
+			}
+
+			CloseHandle(file);
+			replayed++;
+		}
+
+		logger::log_info(logger::va("Prefetched %u files, %llu MB in %.0f ms", replayed.load(), total >> 20,
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()));
+		return 0;
+	}
+
+	BOOL __stdcall find_visible(HWND window, LPARAM found)
+	{
+		if (IsWindowVisible(window))
+		{
+			*reinterpret_cast<bool*>(found) = true;
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	//Measured from process creation so the loader's own startup is part of it
+	void first_frame()
+	{
+		bool found = false;
+		EnumThreadWindows(GetCurrentThreadId(), find_visible, reinterpret_cast<LPARAM>(&found));
+
+		if (!found || shown.exchange(true))
+		{
+			return;
+		}
+
+		FILETIME creation, exit, kernel, user, now;
+		GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+		GetSystemTimeAsFileTime(&now);
+
+		const auto ticks = [](const FILETIME& time)
+		{
+			return (static_cast<long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+		};
+
+		const double milliseconds = (ticks(now) - ticks(creation)) / 10000.0;
+		logger::log_info(logger::va("First frame %.0f ms after launch, %u files prefetched", milliseconds, replayed.load()));
+
+		if (trace::active)
+		{
+			const auto at = std::chrono::steady_clock::now();
+			trace::complete("first frame", "startup", at, at);
+		}
+
+		create_parent(report_path);
+		const bool header = !fs::exists(report_path);
+		fs::write(report_path, (header ? std::string("first_frame_ms,prefetched_files\r\n") : std::string()) + logger::va("%.0f,%u\r\n", milliseconds, replayed.load()), true);
+	}
+
+	BOOL __stdcall peek_message_a(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg)
+	{
+		if (!shown)
+		{
+			first_frame();
+		}
+
+		return oPeekMessageA(lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax, wRemoveMsg);
+	}
+
+	BOOL __stdcall peek_message_w(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg)
+	{
+		if (!shown)
+		{
+			first_frame();
+		}
+
+		return oPeekMessageW(lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax, wRemoveMsg);
+	}
+
+	BOOL __stdcall get_message_a(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax)
+	{
+		if (!shown)
+		{
+			first_frame();
+		}
+
+		return oGetMessageA(lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax);
+	}
+
+	BOOL __stdcall get_message_w(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax)
+	{
+		if (!shown)
+		{
+			first_frame();
+		}
+
+		return oGetMessageW(lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax);
+	}
+}
+
+//Lines of "size<tab>path", UTF-8, in the order the files were first opened
+void prefetch::start(const std::string& list, const std::string& report, bool replay)
+{
+	list_path = list;
+	report_path = report;
+	started = std::chrono::steady_clock::now();
+	prefetch::recording = true;
+
+	if (!replay || !fs::exists(list))
+	{
+		return;
+	}
+
+	auto previous = std::make_unique<std::vector<entry_t>>();
+
+	for (auto& line : logger::split(fs::read(list), "\n"))
+	{
+		const auto tab = line.find('\t');
+
+		if (tab == std::string::npos)
+		{
+			continue;
+		}
+
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+
+		previous->push_back({ widen(line.substr(tab + 1)), std::atoll(line.c_str()) });
+	}
+
+	if (previous->empty())
+	{
+		return;
+	}
+
+	const auto thread = CreateThread(nullptr, 0, read_ahead, previous.get(), 0, &replay_thread);
+
+	if (thread)
+	{
+		previous.release();
+		CloseHandle(thread);
+	}
+}
+
+//Files are keyed by their final path, whatever spelling the game used and wherever the overlay sent it
+void prefetch::record(HANDLE handle)
+{
+	if (GetCurrentThreadId() == replay_thread || GetFileType(handle) != FILE_TYPE_DISK)
+	{
+		return;
+	}
+
+	if (std::chrono::steady_clock::now() - started > record_window)
+	{
+		prefetch::recording = false;
+		prefetch::save();
+		return;
+	}
+
+	wchar_t path[MAX_PATH * 2];
+	const auto length = GetFinalPathNameByHandleW(handle, path, MAX_PATH * 2, FILE_NAME_NORMALIZED);
+
+	LARGE_INTEGER size;
+	if (!length || length >= MAX_PATH * 2 || !GetFileSizeEx(handle, &size) || !size.QuadPart)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::wstring key(path, length);
+
+	if (entries.size() < record_limit && seen.insert(key).second)
+	{
+		entries.push_back({ std::move(key), size.QuadPart });
+	}
+}
+
+//Once per launch, when the record window closes or the game exits first
+void prefetch::save()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (saved || entries.empty())
+	{
+		return;
+	}
+
+	std::string out;
+	for (const auto& entry : entries)
+	{
+		out.append(logger::va("%lld\t", entry.size)).append(narrow(entry.path)).append("\r\n");
+	}
+
+	create_parent(list_path);
+	fs::write(list_path, out, false);
+	saved = true;
+}
+
+void prefetch::install()
+{
+	MH_CreateHookApi(L"user32.dll", "PeekMessageA", (void**)&peek_message_a, (void**)&oPeekMessageA);
+	MH_CreateHookApi(L"user32.dll", "PeekMessageW", (void**)&peek_message_w, (void**)&oPeekMessageW);
+	MH_CreateHookApi(L"user32.dll", "GetMessageA", (void**)&get_message_a, (void**)&oGetMessageA);
+	MH_CreateHookApi(L"user32.dll", "GetMessageW", (void**)&get_message_w, (void**)&oGetMessageW);
+}
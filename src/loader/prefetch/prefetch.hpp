@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+//Remembers which files a launch opened and reads them ahead on the next one
+//The first minute of a launch is recorded, the list is replayed on a background thread at low I/O priority while the exe is still being mapped
+//Also times the first frame, the first message pump with a visible window, so launches with and without a warm list can be compared
+class prefetch
+{
+public:
+	static inline bool recording = false;
+
+	//list is both what gets replayed and where this launch's record goes, report collects the first frame times
+	static void start(const std::string& list, const std::string& report, bool replay);
+	static void record(HANDLE handle);
+	static void save();
+
+	//Expects MinHook to be initialized, hooks are enabled by the caller
+	static void install();
+};
@@ -0,0 +1,154 @@
+#include "loader.hpp"
+#include "trace.hpp"
+
+#include "logger/logger.hpp"
+#include "fs/fs.hpp"
+
+namespace
+{
+	struct event_t
+	{
+		std::atomic<bool> ready;
+		const char* name;
+		const char* category;
+		trace::clock::time_point start, end;
+		DWORD thread;
+		std::uint8_t length;
+		char detail[96];
+	};
+
+	constexpr std::size_t capacity = 32768;
+
+	std::unique_ptr<event_t[]> events;
+	std::atomic<std::size_t> next{ 0 };
+	std::atomic<std::size_t> dropped{ 0 };
+
+	std::string output;
+	std::string process_name;
+	trace::clock::time_point origin;
+	std::mutex write_lock;
+
+	void escape(std::string& out, std::string_view text)
+	{
+		for (auto c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				out.push_back('\\');
+				out.push_back(c);
+			}
+			else if (static_cast<std::uint8_t>(c) < 0x20)
+			{
+				out.append(logger::va("\\u%04X", static_cast<std::uint8_t>(c)));
+			}
+			else
+			{
+				out.push_back(c);
+			}
+		}
+	}
+
+	double micros(trace::clock::duration duration)
+	{
+		return std::chrono::duration<double, std::micro>(duration).count();
+	}
+
+	//Ctrl+Shift+F12 writes what was recorded so far without waiting for the game to quit
+	DWORD __stdcall hotkey(LPVOID)
+	{
+		for (bool held = false;; Sleep(100))
+		{
+			const bool down = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_SHIFT) & 0x8000) && (GetAsyncKeyState(VK_F12) & 0x8000);
+
+			if (down && !held)
+			{
+				trace::write();
+			}
+
+			held = down;
+		}
+	}
+}
+
+void trace::enable(const std::string& path, const std::string& process, int files)
+{
+	events.reset(new event_t[capacity]());
+	output = path;
+	process_name = process;
+	origin = trace::clock::now();
+	trace::file_events = files;
+	trace::active = true;
+
+	CloseHandle(CreateThread(nullptr, 0, hotkey, nullptr, 0, nullptr));
+}
+
+void trace::complete(const char* name, const char* category, clock::time_point start, clock::time_point end, std::string_view detail)
+{
+	const auto index = next++;
+
+	if (index >= capacity)
+	{
+		dropped++;
+		return;
+	}
+
+	auto& event = events[index];
+	event.name = name;
+	event.category = category;
+	event.start = start;
+	event.end = end;
+	event.thread = GetCurrentThreadId();
+	event.length = static_cast<std::uint8_t>(std::min(detail.size(), sizeof(event.detail)));
+	std::memcpy(event.detail, detail.data(), event.length);
+	event.ready.store(true, std::memory_order_release);
+}
+
+//Complete ("X") events in microseconds from when tracing was enabled, slots still being filled are skipped
+void trace::write()
+{
+	if (!trace::active)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(write_lock);
+
+	const auto pid = GetCurrentProcessId();
+	const auto count = std::min(next.load(), capacity);
+
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	json.append(logger::va("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"", pid));
+	escape(json, process_name);
+	json.append("\"}}");
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		const auto& event = events[i];
+
+		if (!event.ready.load(std::memory_order_acquire))
+		{
+			continue;
+		}
+
+		json.append(",\n{\"name\":\"");
+		escape(json, event.name);
+		json.append("\",\"cat\":\"");
+		escape(json, event.category);
+		json.append(logger::va("\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u",
+			micros(event.start - origin), micros(event.end - event.start), pid, event.thread));
+
+		if (event.length)
+		{
+			json.append(",\"args\":{\"detail\":\"");
+			escape(json, std::string_view(event.detail, event.length));
+			json.append("\"}");
+		}
+
+		json.append("}");
+	}
+
+	json.append("\n]}\n");
+	fs::write(output, json, false);
+
+	logger::log_info(logger::va("Trace written to %s, %u events, %u dropped", output.c_str(), count, dropped.load()));
+}
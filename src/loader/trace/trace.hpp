@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+//Timestamped loader events written as a Chrome trace, chrome://tracing and ui.perfetto.dev both open it
+//The buffer is allocated once when tracing is turned on, recording an event is a slot claim and a copy
+//With tracing off an event site costs one branch on trace::active
+class trace
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	static inline bool active = false;
+
+	//Budget the files hooks draw from, only the first calls of a launch are interesting
+	static inline std::atomic<int> file_events{ 0 };
+
+	static void enable(const std::string& path, const std::string& process, int files);
+	static void complete(const char* name, const char* category, clock::time_point start, clock::time_point end, std::string_view detail = {});
+	static void write();
+
+	//Records its own lifetime as one event
+	class span
+	{
+	public:
+		span(const char* name, const char* category, std::string_view detail = {}, std::atomic<int>* budget = nullptr)
+			: on(trace::active && (!budget || budget->fetch_sub(1) > 0)), name(name), category(category)
+		{
+			if (this->on)
+			{
+				this->describe(detail);
+				this->start = clock::now();
+			}
+		}
+
+		~span()
+		{
+			if (this->on)
+			{
+				trace::complete(this->name, this->category, this->start, clock::now(), std::string_view(this->text, this->length));
+			}
+		}
+
+		bool enabled() const
+		{
+			return this->on;
+		}
+
+		//Long details keep their end, for a path that is the part that tells files apart
+		void describe(std::string_view detail)
+		{
+			if (detail.size() > sizeof(this->text))
+			{
+				detail.remove_prefix(detail.size() - sizeof(this->text));
+
+				//Never start in the middle of a UTF-8 sequence
+				while (!detail.empty() && (static_cast<std::uint8_t>(detail.front()) & 0xC0) == 0x80)
+				{
+					detail.remove_prefix(1);
+				}
+			}
+
+			this->length = detail.size();
+			std::memcpy(this->text, detail.data(), this->length);
+		}
+
+	private:
+		bool on;
+		const char* name;
+		const char* category;
+		clock::time_point start;
+		char text[96];
+		std::size_t length = 0;
+	};
+};
@@ -0,0 +1,384 @@
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "overlay/overlay.hpp"
+#include "overlay/resolver.hpp"
+
+//LD_PRELOAD counterpart of the loader's file hooks, for native Linux games and for Proton, whose ntdll ends up in these same libc calls
+//Configured from the environment before the game starts:
+//MODMAN_MODS    mods folder of the game, the one holding _global and the packs
+//MODMAN_PACK    pack to apply on top of _global
+//MODMAN_PARENTS comma separated parents of the pack, nearest first
+//MODMAN_GAME    game dir the paths are relative to, the working directory if unset
+//Layers are walked in the same order the loader walks them, so _global wins over the pack like it does on Windows
+
+namespace
+{
+	resolver paths;
+
+	//Set once the overlay is built, until then every call goes straight through, the build itself opens files
+	std::atomic<bool> ready{ false };
+
+	int(*o_open)(const char* file, int flags, ...);
+	int(*o_open64)(const char* file, int flags, ...);
+	int(*o_openat)(int directory, const char* file, int flags, ...);
+	int(*o_openat64)(int directory, const char* file, int flags, ...);
+	FILE*(*o_fopen)(const char* file, const char* mode);
+	FILE*(*o_fopen64)(const char* file, const char* mode);
+	int(*o_stat)(const char* file, struct stat* info);
+	int(*o_lstat)(const char* file, struct stat* info);
+	int(*o_stat64)(const char* file, struct stat64* info);
+	int(*o_lstat64)(const char* file, struct stat64* info);
+	int(*o_fstatat)(int directory, const char* file, struct stat* info, int flags);
+	int(*o_fstatat64)(int directory, const char* file, struct stat64* info, int flags);
+	int(*o_xstat)(int version, const char* file, struct stat* info);
+	int(*o_lxstat)(int version, const char* file, struct stat* info);
+	int(*o_xstat64)(int version, const char* file, struct stat64* info);
+	int(*o_lxstat64)(int version, const char* file, struct stat64* info);
+
+	//Looked up on first use, a hook can run before our constructor when another library's constructor opens files
+	//Newer glibc keeps the __xstat family as compat symbols only, dlsym does not see those without the x86-64 base version
+	template <typename T> T real(T& original, const char* name)
+	{
+		if (!original)
+		{
+			original = reinterpret_cast<T>(dlsym(RTLD_NEXT, name));
+		}
+
+		if (!original)
+		{
+			original = reinterpret_cast<T>(dlvsym(RTLD_NEXT, name, "GLIBC_2.2.5"));
+		}
+
+		if (!original)
+		{
+			std::fprintf(stderr, "[mr.modman] no %s to forward to\n", name);
+			std::abort();
+		}
+
+		return original;
+	}
+
+	//The layer file to use instead, or the path itself when no layer has it
+	//hidden is set when a replace rule punched a hole where the game's own file would be
+	//Opens that may change the file pass reads as false, they keep the game's path so a mod's files are never written through
+	const char* redirect(const char* file, bool& hidden, bool reads = true)
+	{
+		hidden = false;
+
+		if (!file || !ready.load(std::memory_order_acquire))
+		{
+			return file;
+		}
+
+		const auto hit = paths.resolve_utf8(file);
+
+		//Nothing on this side can serve a .mmz or a zip entry behind a plain descriptor, the game keeps its own file
+		if (reads && hit.slot && !(hit.slot->flags & (overlay::flag_packed | overlay::flag_archived)))
+		{
+			return overlay::target(hit.slot);
+		}
+
+		hidden = hit.hidden;
+		return file;
+	}
+
+	//Opens relative to a directory descriptor are left alone like the loader leaves RootDirectory opens alone
+	const char* redirect_at(int directory, const char* file, bool& hidden, bool reads = true)
+	{
+		if (directory != AT_FDCWD && file && file[0] != '/')
+		{
+			hidden = false;
+			return file;
+		}
+
+		return redirect(file, hidden, reads);
+	}
+
+	//A hidden path still lets the game create files there, it just never finds the originals
+	bool creates(int flags)
+	{
+		return (flags & O_CREAT) != 0;
+	}
+
+	bool creates(const char* mode)
+	{
+		return mode && mode[0] != 'r';
+	}
+
+	bool reads_only(int flags)
+	{
+		return (flags & O_ACCMODE) == O_RDONLY && !(flags & O_TRUNC);
+	}
+
+	bool reads_only(const char* mode)
+	{
+		return mode && mode[0] == 'r' && !std::strchr(mode, '+');
+	}
+
+	mode_t mode_of(int flags, va_list args)
+	{
+		return (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE ? static_cast<mode_t>(va_arg(args, int)) : 0;
+	}
+
+	int missing()
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	std::string environment(const char* name, const char* fallback = "")
+	{
+		const char* value = std::getenv(name);
+		return value ? value : fallback;
+	}
+
+	std::string folded(const std::string& path)
+	{
+		char buffer[resolver::buffer_size];
+		return std::string(buffer, path::fold_utf8(path, buffer, sizeof(buffer)));
+	}
+
+	//A static object rather than a constructor function, C++ only orders it after the overlay's own statics that way
+	struct attach_t
+	{
+		attach_t()
+		{
+			const std::string mods = environment("MODMAN_MODS");
+
+			if (mods.empty())
+			{
+				return;
+			}
+
+			std::string game = environment("MODMAN_GAME");
+			if (game.empty())
+			{
+				char cwd[4096];
+				game = getcwd(cwd, sizeof(cwd)) ? cwd : "";
+			}
+
+			overlay::builder builder;
+			builder.walk(mods + "/_global", "_global");
+
+			//Without a pack only _global applies, walking "mods/" would mount every pack at once
+			const std::string pack = environment("MODMAN_PACK");
+			if (!pack.empty())
+			{
+				builder.walk(mods + "/" + pack, pack);
+			}
+
+			const std::string parents = environment("MODMAN_PARENTS");
+			for (std::size_t start = 0; start < parents.size();)
+			{
+				auto end = parents.find(',', start);
+				end = end == std::string::npos ? parents.size() : end;
+
+				if (end > start)
+				{
+					const auto parent = parents.substr(start, end - start);
+					builder.walk(mods + "/" + parent, parent);
+				}
+
+				start = end + 1;
+			}
+
+			overlay::use(builder.finish(0));
+			overlay::build_filter();
+			paths.init(folded(game + "/"), overlay::replaced());
+
+			ready.store(true, std::memory_order_release);
+
+			if (!environment("MODMAN_VERBOSE").empty())
+			{
+				std::fprintf(stderr, "[mr.modman] %zu overlay entries over %s\n", overlay::size(), game.c_str());
+			}
+		}
+	} attached;
+}
+
+extern "C"
+{
+	int open(const char* file, int flags, ...)
+	{
+		va_list args;
+		va_start(args, flags);
+		const mode_t mode = mode_of(flags, args);
+		va_end(args);
+
+		bool hidden;
+		file = redirect(file, hidden, reads_only(flags));
+
+		if (hidden && !creates(flags))
+		{
+			return missing();
+		}
+
+		return real(o_open, "open")(file, flags, mode);
+	}
+
+	int open64(const char* file, int flags, ...)
+	{
+		va_list args;
+		va_start(args, flags);
+		const mode_t mode = mode_of(flags, args);
+		va_end(args);
+
+		bool hidden;
+		file = redirect(file, hidden, reads_only(flags));
+
+		if (hidden && !creates(flags))
+		{
+			return missing();
+		}
+
+		return real(o_open64, "open64")(file, flags, mode);
+	}
+
+	int openat(int directory, const char* file, int flags, ...)
+	{
+		va_list args;
+		va_start(args, flags);
+		const mode_t mode = mode_of(flags, args);
+		va_end(args);
+
+		bool hidden;
+		file = redirect_at(directory, file, hidden, reads_only(flags));
+
+		if (hidden && !creates(flags))
+		{
+			return missing();
+		}
+
+		return real(o_openat, "openat")(directory, file, flags, mode);
+	}
+
+	int openat64(int directory, const char* file, int flags, ...)
+	{
+		va_list args;
+		va_start(args, flags);
+		const mode_t mode = mode_of(flags, args);
+		va_end(args);
+
+		bool hidden;
+		file = redirect_at(directory, file, hidden, reads_only(flags));
+
+		if (hidden && !creates(flags))
+		{
+			return missing();
+		}
+
+		return real(o_openat64, "openat64")(directory, file, flags, mode);
+	}
+
+	//glibc's fopen opens through its internal open, it never reaches the hooks above
+	FILE* fopen(const char* file, const char* mode)
+	{
+		bool hidden;
+		file = redirect(file, hidden, reads_only(mode));
+
+		if (hidden && !creates(mode))
+		{
+			errno = ENOENT;
+			return nullptr;
+		}
+
+		return real(o_fopen, "fopen")(file, mode);
+	}
+
+	FILE* fopen64(const char* file, const char* mode)
+	{
+		bool hidden;
+		file = redirect(file, hidden, reads_only(mode));
+
+		if (hidden && !creates(mode))
+		{
+			errno = ENOENT;
+			return nullptr;
+		}
+
+		return real(o_fopen64, "fopen64")(file, mode);
+	}
+
+	//Layer files report their own size and times, nothing is cached on this side since the real call is only a syscall
+	int stat(const char* file, struct stat* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_stat, "stat")(file, info);
+	}
+
+	int lstat(const char* file, struct stat* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_lstat, "lstat")(file, info);
+	}
+
+	int stat64(const char* file, struct stat64* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_stat64, "stat64")(file, info);
+	}
+
+	int lstat64(const char* file, struct stat64* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_lstat64, "lstat64")(file, info);
+	}
+
+	int fstatat(int directory, const char* file, struct stat* info, int flags)
+	{
+		bool hidden;
+		file = redirect_at(directory, file, hidden);
+		return hidden ? missing() : real(o_fstatat, "fstatat")(directory, file, info, flags);
+	}
+
+	int fstatat64(int directory, const char* file, struct stat64* info, int flags)
+	{
+		bool hidden;
+		file = redirect_at(directory, file, hidden);
+		return hidden ? missing() : real(o_fstatat64, "fstatat64")(directory, file, info, flags);
+	}
+
+	//glibc before 2.33 only exports the stat family under these names, games built against it still call them
+	int __xstat(int version, const char* file, struct stat* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_xstat, "__xstat")(version, file, info);
+	}
+
+	int __lxstat(int version, const char* file, struct stat* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_lxstat, "__lxstat")(version, file, info);
+	}
+
+	int __xstat64(int version, const char* file, struct stat64* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_xstat64, "__xstat64")(version, file, info);
+	}
+
+	int __lxstat64(int version, const char* file, struct stat64* info)
+	{
+		bool hidden;
+		file = redirect(file, hidden);
+		return hidden ? missing() : real(o_lxstat64, "__lxstat64")(version, file, info);
+	}
+}
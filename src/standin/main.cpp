@@ -0,0 +1,149 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//Stand-in for a game, opens a list of files the way games do so the preload shim can be checked and timed without one
+//usage: standin <list> [passes] [--print]
+//Run it from the game dir with and without LD_PRELOAD, --print output shows what every path resolved to and the timings show what the shim adds per call
+
+namespace
+{
+	typedef std::chrono::steady_clock clock;
+
+	//First line of the file, enough to tell a mod's copy from the game's own
+	std::string head(FILE* file)
+	{
+		char line[128];
+
+		if (!std::fgets(line, sizeof(line), file))
+		{
+			return "";
+		}
+
+		line[std::strcspn(line, "\r\n")] = '\0';
+		return line;
+	}
+
+	template <typename T> double time(const std::vector<std::string>& paths, std::size_t passes, T&& fn)
+	{
+		const auto start = clock::now();
+
+		for (std::size_t pass = 0; pass < passes; pass++)
+		{
+			for (const auto& path : paths)
+			{
+				fn(path.c_str());
+			}
+		}
+
+		return std::chrono::duration<double, std::nano>(clock::now() - start).count() / (passes * paths.size());
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::printf("usage: standin <list> [passes] [--print]\n");
+		return 1;
+	}
+
+	std::vector<std::string> paths;
+	std::ifstream list(argv[1]);
+
+	for (std::string line; std::getline(list, line);)
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+
+		if (!line.empty())
+		{
+			paths.emplace_back(line);
+		}
+	}
+
+	if (paths.empty())
+	{
+		std::printf("no paths in %s\n", argv[1]);
+		return 1;
+	}
+
+	std::size_t passes = 1000;
+	bool print = false;
+
+	for (int i = 2; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--print"))
+		{
+			print = true;
+		}
+		else
+		{
+			passes = std::max<std::size_t>(std::strtoul(argv[i], nullptr, 10), 1);
+		}
+	}
+
+	if (print)
+	{
+		for (const auto& path : paths)
+		{
+			struct stat info;
+			FILE* file = std::fopen(path.c_str(), "rb");
+
+			if (!file || stat(path.c_str(), &info))
+			{
+				std::printf("%s: missing\n", path.c_str());
+			}
+			else
+			{
+				std::printf("%s: %lld bytes, \"%s\"\n", path.c_str(), static_cast<long long>(info.st_size), head(file).c_str());
+			}
+
+			if (file)
+			{
+				std::fclose(file);
+			}
+		}
+	}
+
+	std::size_t found = 0;
+
+	const double stat_ns = time(paths, passes, [&](const char* path)
+	{
+		struct stat info;
+		found += !stat(path, &info);
+	});
+
+	const double open_ns = time(paths, passes, [&](const char* path)
+	{
+		const int file = open(path, O_RDONLY);
+
+		if (file >= 0)
+		{
+			close(file);
+		}
+	});
+
+	const double fopen_ns = time(paths, passes, [&](const char* path)
+	{
+		if (FILE* file = std::fopen(path, "rb"))
+		{
+			std::fclose(file);
+		}
+	});
+
+	std::printf("%zu paths, %zu found, %zu passes\n", paths.size(), found / passes, passes);
+	std::printf("  stat          %10.1f ns/call\n", stat_ns);
+	std::printf("  open + close  %10.1f ns/call\n", open_ns);
+	std::printf("  fopen + close %10.1f ns/call\n", fopen_ns);
+	return 0;
+}
@@ -0,0 +1,544 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lz4.hpp"
+
+//Compressed layer files, stored as name.mmz next to where name would be and served as name
+//The file is cut into fixed size chunks that are compressed on their own, an index after the header maps every chunk to its bytes
+//Any offset is one index lookup and one chunk away, so a reader can seek around a multi GB archive without decoding what comes before
+//Nothing in here touches the OS, the bytes come from a callback so the loader and the bench share the same reader
+//Pack Files in the Mods window writes them for a whole layer, bench chunk <file> --pack does it for one file
+class chunk
+{
+public:
+	static constexpr std::uint32_t magic = 0x315A4D4D; //MMZ1
+	static constexpr std::uint32_t version = 1;
+	static constexpr const char* extension = ".mmz";
+
+	//Big enough to compress well, small enough that a random 4 KB read does not decode much it throws away
+	static constexpr std::uint32_t default_chunk_size = 64 * 1024;
+	static constexpr std::uint32_t max_chunk_size = 16 * 1024 * 1024;
+
+	enum entry_flags_t : std::uint32_t
+	{
+		entry_stored = 1 << 0, //Did not compress, kept as is
+	};
+
+	struct header_t
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t chunk_size;
+		std::uint32_t chunk_count;
+		std::uint64_t size; //Of the file it decompresses to
+	};
+
+	struct entry_t
+	{
+		std::uint64_t offset;
+		std::uint32_t size;
+		std::uint32_t flags;
+	};
+
+	//Reads size bytes at offset of the .mmz, has to be safe to call from several threads at once
+	typedef std::function<bool(std::uint64_t offset, void* out, std::uint32_t size)> source_fn;
+
+	//Workers shared by every reader, they decode the chunks a reader expects to need next
+	class pool
+	{
+	public:
+		//Never torn down, at process exit the threads are gone before any destructor could join them
+		static pool& shared()
+		{
+			static pool* instance = new pool(std::clamp<unsigned>(std::thread::hardware_concurrency(), 2, 5) - 1);
+			return *instance;
+		}
+
+		void submit(std::function<void()> job)
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->jobs.emplace_back(std::move(job));
+			}
+
+			this->wake.notify_one();
+		}
+
+		unsigned size() const
+		{
+			return this->threads;
+		}
+
+	private:
+		pool(unsigned threads) : threads(threads)
+		{
+			for (unsigned i = 0; i < threads; i++)
+			{
+				std::thread([this]()
+				{
+					for (;;)
+					{
+						std::function<void()> job;
+
+						{
+							std::unique_lock<std::mutex> lock(this->mutex);
+							this->wake.wait(lock, [this]() { return !this->jobs.empty(); });
+							job = std::move(this->jobs.front());
+							this->jobs.pop_front();
+						}
+
+						job();
+					}
+				}).detach();
+			}
+		}
+
+		unsigned threads;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::function<void()>> jobs;
+	};
+
+	//Decompressed view of one .mmz, reads at any offset from any thread
+	//Decoded chunks sit in a small cache, a read that keeps going forward has the chunks after it decoded on the pool ahead of time
+	class reader
+	{
+	public:
+		//Chunks kept decoded per reader and how many of them a forward read queues up
+		static constexpr std::size_t cache_slots = 12;
+		static constexpr std::size_t ahead = 4;
+
+		struct stats_t
+		{
+			std::atomic<std::uint64_t> reads{ 0 };
+			std::atomic<std::uint64_t> hits{ 0 };
+			std::atomic<std::uint64_t> decoded{ 0 };
+			std::atomic<std::uint64_t> decoded_ahead{ 0 };
+		};
+
+		reader() = default;
+		reader(const reader&) = delete;
+		reader& operator=(const reader&) = delete;
+
+		//Outstanding pool jobs point at this reader, they have to finish first
+		~reader()
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->changed.wait(lock, [this]() { return !this->queued; });
+		}
+
+		//Reads the header and the index, false for anything that is not a .mmz this version understands
+		bool open(source_fn source)
+		{
+			header_t header;
+
+			if (!source(0, &header, sizeof(header)) || header.magic != chunk::magic || header.version != chunk::version || !header.chunk_size
+				|| header.chunk_size > chunk::max_chunk_size || header.chunk_count != (header.size + header.chunk_size - 1) / header.chunk_size)
+			{
+				return false;
+			}
+
+			this->index.resize(header.chunk_count);
+
+			if (header.chunk_count && !source(sizeof(header), this->index.data(), static_cast<std::uint32_t>(header.chunk_count * sizeof(entry_t))))
+			{
+				return false;
+			}
+
+			for (const auto& entry : this->index)
+			{
+				if (entry.size > lz4::bound(header.chunk_size))
+				{
+					return false;
+				}
+			}
+
+			this->source = std::move(source);
+			this->header = header;
+			this->slots.resize(reader::cache_slots);
+			return true;
+		}
+
+		std::uint64_t size() const
+		{
+			return this->header.size;
+		}
+
+		std::uint32_t chunk_size() const
+		{
+			return this->header.chunk_size;
+		}
+
+		const stats_t& stats() const
+		{
+			return this->counters;
+		}
+
+		//Same contract as a file read, fewer bytes than asked for only at the end of the file, 0 past it or when a chunk is corrupt
+		std::size_t read(std::uint64_t offset, void* out, std::size_t size)
+		{
+			if (offset >= this->header.size)
+			{
+				return 0;
+			}
+
+			size = static_cast<std::size_t>(std::min<std::uint64_t>(size, this->header.size - offset));
+
+			const std::uint32_t first = static_cast<std::uint32_t>(offset / this->header.chunk_size);
+			const std::uint32_t last = static_cast<std::uint32_t>((offset + size - 1) / this->header.chunk_size);
+			const bool forward = offset == this->last_end.exchange(offset + size, std::memory_order_relaxed) || last > first;
+
+			this->counters.reads.fetch_add(1, std::memory_order_relaxed);
+
+			auto data = static_cast<char*>(out);
+			std::size_t copied = 0;
+
+			for (std::uint32_t index = first; index <= last; index++)
+			{
+				//What this read still needs after the current chunk goes to the pool first, it decodes while we do this one
+				if (forward)
+				{
+					this->queue(index + 1, std::min<std::uint32_t>(last, index + static_cast<std::uint32_t>(reader::ahead)) + 1);
+				}
+
+				const std::uint64_t start = std::uint64_t(index) * this->header.chunk_size;
+				const std::size_t skip = static_cast<std::size_t>(offset + copied - start);
+				const std::size_t count = std::min<std::size_t>(size - copied, this->raw_size(index) - skip);
+
+				if (!this->copy(index, skip, data + copied, count))
+				{
+					return 0;
+				}
+
+				copied += count;
+			}
+
+			//Streaming callers come back for what follows, it is already being decoded by then
+			if (forward)
+			{
+				this->queue(last + 1, std::min<std::uint32_t>(this->header.chunk_count, last + 1 + static_cast<std::uint32_t>(reader::ahead)));
+			}
+
+			return copied;
+		}
+
+	private:
+		enum state_t
+		{
+			slot_empty,
+			slot_loading,
+			slot_ready,
+		};
+
+		struct slot_t
+		{
+			std::uint32_t index = 0;
+			state_t state = slot_empty;
+			std::uint32_t pins = 0;
+			std::uint64_t used = 0;
+			std::vector<char> data;
+		};
+
+		header_t header{};
+		std::vector<entry_t> index;
+		source_fn source;
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::vector<slot_t> slots;
+		std::uint64_t clock = 0;
+		std::uint32_t queued = 0;
+		std::atomic<std::uint64_t> last_end{ ~std::uint64_t(0) };
+
+		stats_t counters;
+
+		std::uint32_t raw_size(std::uint32_t index) const
+		{
+			return static_cast<std::uint32_t>(std::min<std::uint64_t>(this->header.chunk_size, this->header.size - std::uint64_t(index) * this->header.chunk_size));
+		}
+
+		//Fills out with the whole chunk, out has to hold raw_size(index) bytes
+		bool decode(std::uint32_t index, char* out, std::vector<char>& packed)
+		{
+			const auto& entry = this->index[index];
+			const std::uint32_t raw = this->raw_size(index);
+
+			if (entry.flags & entry_stored)
+			{
+				return entry.size == raw && this->source(entry.offset, out, raw);
+			}
+
+			packed.resize(entry.size);
+			return this->source(entry.offset, packed.data(), entry.size) && lz4::decompress(packed.data(), entry.size, out, raw);
+		}
+
+		//Under the lock, the slot holding index in any state
+		slot_t* lookup(std::uint32_t index)
+		{
+			for (auto& slot : this->slots)
+			{
+				if (slot.state != slot_empty && slot.index == index)
+				{
+					return &slot;
+				}
+			}
+
+			return nullptr;
+		}
+
+		//Under the lock, the least recently used slot nobody is reading or filling, nullptr when all of them are busy
+		slot_t* claim(std::uint32_t index)
+		{
+			slot_t* victim = nullptr;
+
+			for (auto& slot : this->slots)
+			{
+				if (slot.state != slot_loading && !slot.pins && (!victim || slot.used < victim->used))
+				{
+					victim = &slot;
+				}
+			}
+
+			if (victim)
+			{
+				victim->index = index;
+				victim->state = slot_loading;
+				victim->used = ++this->clock;
+				victim->data.resize(this->header.chunk_size);
+			}
+
+			return victim;
+		}
+
+		//Decodes into a claimed slot without the lock held, a corrupt chunk leaves the slot empty again
+		void fill(slot_t* slot, std::vector<char>& packed)
+		{
+			const bool decoded = this->decode(slot->index, slot->data.data(), packed);
+
+			std::lock_guard<std::mutex> lock(this->mutex);
+			slot->state = decoded ? slot_ready : slot_empty;
+			this->counters.decoded.fetch_add(1, std::memory_order_relaxed);
+			this->changed.notify_all();
+		}
+
+		void queue(std::uint32_t begin, std::uint32_t end)
+		{
+			auto& workers = pool::shared();
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			for (std::uint32_t index = begin; index < end && index < this->header.chunk_count; index++)
+			{
+				if (this->lookup(index))
+				{
+					continue;
+				}
+
+				auto slot = this->claim(index);
+
+				if (!slot)
+				{
+					return;
+				}
+
+				this->queued++;
+				this->counters.decoded_ahead.fetch_add(1, std::memory_order_relaxed);
+
+				workers.submit([this, slot]()
+				{
+					std::vector<char> packed;
+					this->fill(slot, packed);
+
+					std::lock_guard<std::mutex> lock(this->mutex);
+					this->queued--;
+					this->changed.notify_all();
+				});
+			}
+		}
+
+		bool copy(std::uint32_t index, std::size_t skip, char* out, std::size_t count)
+		{
+			std::vector<char> packed;
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			for (;;)
+			{
+				auto slot = this->lookup(index);
+
+				if (slot && slot->state == slot_loading)
+				{
+					this->changed.wait(lock);
+					continue;
+				}
+
+				if (slot)
+				{
+					//Pinned so it cannot be handed to another chunk while the copy runs unlocked
+					slot->pins++;
+					slot->used = ++this->clock;
+					this->counters.hits.fetch_add(1, std::memory_order_relaxed);
+					lock.unlock();
+
+					std::memcpy(out, slot->data.data() + skip, count);
+
+					lock.lock();
+					slot->pins--;
+					return true;
+				}
+
+				//A whole chunk the cache does not have goes straight to the caller, nothing would read it from the cache again soon
+				if (!skip && count == this->raw_size(index))
+				{
+					lock.unlock();
+					this->counters.decoded.fetch_add(1, std::memory_order_relaxed);
+					return this->decode(index, out, packed);
+				}
+
+				if (auto claimed = this->claim(index))
+				{
+					lock.unlock();
+					this->fill(claimed, packed);
+					lock.lock();
+
+					if (claimed->state == slot_empty)
+					{
+						return false;
+					}
+
+					continue;
+				}
+
+				//Every slot is busy, decode on the side and throw it away
+				std::vector<char> scratch(this->raw_size(index));
+				lock.unlock();
+				this->counters.decoded.fetch_add(1, std::memory_order_relaxed);
+
+				if (!this->decode(index, scratch.data(), packed))
+				{
+					return false;
+				}
+
+				std::memcpy(out, scratch.data() + skip, count);
+				return true;
+			}
+		}
+	};
+
+	//Compresses a whole buffer into the .mmz layout
+	static std::vector<char> pack(const char* data, std::uint64_t size, std::uint32_t chunk_size = chunk::default_chunk_size)
+	{
+		header_t header{ chunk::magic, chunk::version, chunk_size, static_cast<std::uint32_t>((size + chunk_size - 1) / chunk_size), size };
+		std::vector<entry_t> index(header.chunk_count);
+		std::vector<char> out(sizeof(header) + index.size() * sizeof(entry_t));
+		std::vector<char> buffer(lz4::bound(chunk_size));
+
+		for (std::uint32_t i = 0; i < header.chunk_count; i++)
+		{
+			const std::uint64_t start = std::uint64_t(i) * chunk_size;
+			const std::size_t raw = static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size, size - start));
+			const std::size_t packed = lz4::compress(data + start, raw, buffer.data(), buffer.size());
+
+			index[i].offset = out.size();
+
+			if (packed && packed < raw)
+			{
+				index[i].size = static_cast<std::uint32_t>(packed);
+				out.insert(out.end(), buffer.data(), buffer.data() + packed);
+			}
+			else
+			{
+				index[i].size = static_cast<std::uint32_t>(raw);
+				index[i].flags = entry_stored;
+				out.insert(out.end(), data + start, data + start + raw);
+			}
+		}
+
+		std::memcpy(out.data(), &header, sizeof(header));
+		std::memcpy(out.data() + sizeof(header), index.data(), index.size() * sizeof(entry_t));
+		return out;
+	}
+
+	//Writes file.mmz next to file, the original is left alone
+	static bool pack(const std::filesystem::path& file, std::uint32_t chunk_size = chunk::default_chunk_size)
+	{
+		std::ifstream in(file, std::ios::binary);
+		const std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+		if (!in.good() && !in.eof())
+		{
+			return false;
+		}
+
+		const auto packed = chunk::pack(data.data(), data.size(), chunk_size);
+
+		std::ofstream out(std::filesystem::path(file) += chunk::extension, std::ios::binary | std::ios::trunc);
+		out.write(packed.data(), packed.size());
+		return out.good();
+	}
+
+	//Size of what a .mmz decompresses to, the overlay lists that size for the file so the game never sees the packed one
+	static bool probe(const std::filesystem::path& file, std::uint64_t& size)
+	{
+		header_t header;
+		std::ifstream in(file, std::ios::binary);
+
+		if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != chunk::magic || header.version != chunk::version)
+		{
+			return false;
+		}
+
+		size = header.size;
+		return true;
+	}
+
+	//Decompresses a .mmz back into a plain file, for when the game wants to write to one
+	static bool unpack(const std::filesystem::path& file, const std::filesystem::path& to)
+	{
+		std::ifstream in(file, std::ios::binary);
+		std::mutex lock;
+		reader view;
+
+		const bool opened = view.open([&](std::uint64_t offset, void* out, std::uint32_t size)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			in.clear();
+			in.seekg(static_cast<std::streamoff>(offset));
+			return static_cast<bool>(in.read(static_cast<char*>(out), size));
+		});
+
+		if (!opened)
+		{
+			return false;
+		}
+
+		std::ofstream out(to, std::ios::binary | std::ios::trunc);
+		std::vector<char> buffer(view.chunk_size());
+
+		for (std::uint64_t offset = 0; offset < view.size(); offset += buffer.size())
+		{
+			const std::size_t count = view.read(offset, buffer.data(), buffer.size());
+
+			if (!count)
+			{
+				return false;
+			}
+
+			out.write(buffer.data(), count);
+		}
+
+		return out.good();
+	}
+};
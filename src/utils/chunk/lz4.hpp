@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//LZ4 block format, the raw blocks without the frame around them
+//Compression is the plain greedy single probe matcher, fast enough for packing a mod and a lot simpler than the reference one
+//Decompression checks every length and offset against both buffers, the input comes from files anyone can hand us
+class lz4
+{
+public:
+	//Worst case output for size bytes of input that does not compress at all
+	static constexpr std::size_t bound(std::size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	//Returns the compressed size, 0 when capacity is below bound(size)
+	static std::size_t compress(const char* source, std::size_t size, char* out, std::size_t capacity)
+	{
+		if (capacity < lz4::bound(size))
+		{
+			return 0;
+		}
+
+		const auto in = reinterpret_cast<const std::uint8_t*>(source);
+		auto op = reinterpret_cast<std::uint8_t*>(out);
+
+		std::size_t ip = 0, anchor = 0;
+
+		//The format wants the last 5 bytes as literals and no match starting in the last 12
+		if (size > lz4::min_match_input)
+		{
+			std::vector<std::uint32_t> table(std::size_t(1) << lz4::hash_bits, 0);
+			const std::size_t match_limit = size - lz4::min_match_input;
+			const std::size_t end_limit = size - lz4::last_literals;
+
+			while (ip < match_limit)
+			{
+				const std::uint32_t sequence = lz4::read32(in + ip);
+				const std::uint32_t hash = lz4::hash(sequence);
+				std::size_t ref = table[hash];
+				table[hash] = static_cast<std::uint32_t>(ip);
+
+				if (ref >= ip || ip - ref > lz4::max_offset || lz4::read32(in + ref) != sequence)
+				{
+					//Skips ahead faster the longer nothing matched, incompressible data would crawl otherwise
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+
+				std::size_t length = lz4::min_match;
+				while (ip + length < end_limit && in[ref + length] == in[ip + length])
+				{
+					length++;
+				}
+
+				while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1])
+				{
+					ip--;
+					ref--;
+					length++;
+				}
+
+				op = lz4::sequence(op, in + anchor, ip - anchor, static_cast<std::uint32_t>(ip - ref), length);
+				ip += length;
+				anchor = ip;
+
+				//One more entry from inside the match, cheap and it finds the next match in repeating data a lot sooner
+				if (ip - 2 < match_limit)
+				{
+					table[lz4::hash(lz4::read32(in + ip - 2))] = static_cast<std::uint32_t>(ip - 2);
+				}
+			}
+		}
+
+		op = lz4::literals(op, in + anchor, size - anchor);
+		return static_cast<std::size_t>(op - reinterpret_cast<std::uint8_t*>(out));
+	}
+
+	//Fills exactly size bytes of out, false for corrupt input or input that does not decode to exactly that much
+	static bool decompress(const char* source, std::size_t size, char* out, std::size_t expected)
+	{
+		const auto in = reinterpret_cast<const std::uint8_t*>(source);
+		auto op = reinterpret_cast<std::uint8_t*>(out);
+
+		std::size_t ip = 0, written = 0;
+
+		while (ip < size)
+		{
+			const std::uint8_t token = in[ip++];
+
+			std::size_t count = token >> 4;
+			if (count == 15 && !lz4::extend(in, size, ip, count))
+			{
+				return false;
+			}
+
+			if (count > size - ip || count > expected - written)
+			{
+				return false;
+			}
+
+			std::memcpy(op + written, in + ip, count);
+			ip += count;
+			written += count;
+
+			//The last sequence is literals only
+			if (ip == size)
+			{
+				break;
+			}
+
+			if (size - ip < 2)
+			{
+				return false;
+			}
+
+			const std::size_t offset = in[ip] | (in[ip + 1] << 8);
+			ip += 2;
+
+			if (!offset || offset > written)
+			{
+				return false;
+			}
+
+			count = token & 15;
+			if (count == 15 && !lz4::extend(in, size, ip, count))
+			{
+				return false;
+			}
+
+			count += lz4::min_match;
+			if (count > expected - written)
+			{
+				return false;
+			}
+
+			//Overlapping matches repeat the last offset bytes, copied forward in steps no longer than the offset
+			std::uint8_t* match = op + written - offset;
+			if (offset >= count)
+			{
+				std::memcpy(op + written, match, count);
+			}
+			else if (offset >= 8)
+			{
+				for (std::size_t i = 0; i < count; i += 8)
+				{
+					std::memcpy(op + written + i, match + i, std::min<std::size_t>(8, count - i));
+				}
+			}
+			else
+			{
+				for (std::size_t i = 0; i < count; i++)
+				{
+					op[written + i] = match[i];
+				}
+			}
+
+			written += count;
+		}
+
+		return written == expected;
+	}
+
+private:
+	static constexpr std::size_t min_match = 4;
+	static constexpr std::size_t last_literals = 5;
+	static constexpr std::size_t min_match_input = 12;
+	static constexpr std::size_t max_offset = 65535;
+	static constexpr unsigned hash_bits = 14;
+
+	static std::uint32_t read32(const std::uint8_t* in)
+	{
+		std::uint32_t value;
+		std::memcpy(&value, in, sizeof(value));
+		return value;
+	}
+
+	static std::uint32_t hash(std::uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - lz4::hash_bits);
+	}
+
+	//Lengths of 15 and up go on in bytes of 255 until one is smaller
+	static std::uint8_t* length(std::uint8_t* op, std::size_t count)
+	{
+		for (; count >= 255; count -= 255)
+		{
+			*op++ = 255;
+		}
+
+		*op++ = static_cast<std::uint8_t>(count);
+		return op;
+	}
+
+	static bool extend(const std::uint8_t* in, std::size_t size, std::size_t& ip, std::size_t& count)
+	{
+		std::uint8_t byte;
+
+		do
+		{
+			if (ip >= size)
+			{
+				return false;
+			}
+
+			byte = in[ip++];
+			count += byte;
+		} while (byte == 255);
+
+		return true;
+	}
+
+	static std::uint8_t* sequence(std::uint8_t* op, const std::uint8_t* literal, std::size_t count, std::uint32_t offset, std::size_t match)
+	{
+		std::uint8_t* token = op++;
+		match -= lz4::min_match;
+
+		*token = static_cast<std::uint8_t>(((count < 15 ? count : 15) << 4) | (match < 15 ? match : 15));
+
+		if (count >= 15)
+		{
+			op = lz4::length(op, count - 15);
+		}
+
+		std::memcpy(op, literal, count);
+		op += count;
+
+		*op++ = static_cast<std::uint8_t>(offset);
+		*op++ = static_cast<std::uint8_t>(offset >> 8);
+
+		return match >= 15 ? lz4::length(op, match - 15) : op;
+	}
+
+	static std::uint8_t* literals(std::uint8_t* op, const std::uint8_t* literal, std::size_t count)
+	{
+		*op++ = static_cast<std::uint8_t>((count < 15 ? count : 15) << 4);
+
+		if (count >= 15)
+		{
+			op = lz4::length(op, count - 15);
+		}
+
+		std::memcpy(op, literal, count);
+		return op + count;
+	}
+};
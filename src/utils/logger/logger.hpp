@@ -2,7 +2,11 @@
 
 #include <iostream>
 #include <cstdio>
-#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path/path.hpp"
 
 #ifndef LOADER
 #include "../app/menus/menus.hpp"
@@ -69,51 +73,63 @@ public:
 		}
 	}
 
-	static std::vector<std::string> split(const std::string& s, const std::string& seperator)
+	static std::vector<std::string> split(std::string_view s, std::string_view seperator)
 	{
 		std::vector<std::string> output;
 
-		std::string::size_type prev_pos = 0, pos = 0;
+		std::string_view::size_type prev_pos = 0, pos = 0;
 
-		while ((pos = s.find(seperator, pos)) != std::string::npos)
+		while ((pos = s.find(seperator, pos)) != std::string_view::npos)
 		{
-			std::string substring(s.substr(prev_pos, pos - prev_pos));
-
-			output.push_back(substring);
+			output.emplace_back(s.substr(prev_pos, pos - prev_pos));
 
 			prev_pos = ++pos;
 		}
 
-		output.push_back(s.substr(prev_pos, pos - prev_pos)); // Last word
+		output.emplace_back(s.substr(prev_pos, pos - prev_pos)); // Last word
 
 		return output;
 	}
 
 	static void to_lower(std::string& string)
 	{
-		std::for_each(string.begin(), string.end(), ([](char& c)
-		{
-			c = std::tolower(c);
-		}));
+		path::lower(&string[0], string.size());
 	}
 
 	static void to_upper(std::string& string)
 	{
-		std::for_each(string.begin(), string.end(), ([](char& c)
-		{
-			c = std::toupper(c);
-		}));
+		path::upper(&string[0], string.size());
 	}
 
-	static bool ends_with(std::string const& value, std::string const& ending)
+	static bool ends_with(std::string_view value, std::string_view ending)
 	{
-		if (ending.size() > value.size()) return false;
-		return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+		return path::ends_with(value, ending);
 	}
 
-	static std::string replace(std::string const& in, std::string const& from, std::string const& to)
+	//Plain substring replacement, callers only ever pass literals so there is no need for a regex
+	static std::string replace(std::string_view in, std::string_view from, std::string_view to)
 	{
-		return std::regex_replace(in, std::regex(from), to);
+		if (from.size() == 1 && to.size() == 1)
+		{
+			std::string out(in);
+			path::replace(&out[0], out.size(), from[0], to[0]);
+			return out;
+		}
+
+		std::string out;
+		out.reserve(in.size());
+
+		std::string_view::size_type prev_pos = 0, pos = 0;
+
+		while (!from.empty() && (pos = in.find(from, prev_pos)) != std::string_view::npos)
+		{
+			out.append(in.substr(prev_pos, pos - prev_pos));
+			out.append(to);
+			prev_pos = pos + from.size();
+		}
+
+		out.append(in.substr(prev_pos));
+		return out;
 	}
 
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Split block bloom filter, every key lives in a single 32 byte block so a query touches one cache line
+//A miss is definite, a hit still has to be confirmed against the index
+class filter
+{
+public:
+	void build(const std::vector<std::uint64_t>& hashes)
+	{
+		//Roughly 16 bits per key, which keeps false positives well under one percent
+		std::size_t count = hashes.size() / 16 + 1;
+
+		this->blocks.assign(count, block_t{});
+
+		for (auto key : hashes)
+		{
+			const auto hash = filter::mix(key);
+			auto& block = this->blocks[filter::block(hash, count)];
+
+			for (auto i = 0; i < 8; i++)
+			{
+				block.words[i] |= filter::bit(hash, i);
+			}
+		}
+	}
+
+	bool contains(std::uint64_t key) const
+	{
+		const auto hash = filter::mix(key);
+		const auto& block = this->blocks[filter::block(hash, this->blocks.size())];
+		std::uint32_t missing = 0;
+
+		for (auto i = 0; i < 8; i++)
+		{
+			missing |= filter::bit(hash, i) & ~block.words[i];
+		}
+
+		return !missing;
+	}
+
+	bool empty() const
+	{
+		return this->blocks.empty();
+	}
+
+	void clear()
+	{
+		this->blocks.clear();
+	}
+
+private:
+	struct alignas(32) block_t
+	{
+		std::uint32_t words[8];
+	};
+
+	std::vector<block_t> blocks;
+
+	//Index hashes are cheap string hashes with weak high bits, spread them before picking a block
+	static std::uint64_t mix(std::uint64_t x)
+	{
+		x ^= x >> 31;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 29;
+		return x;
+	}
+
+	static std::size_t block(std::uint64_t hash, std::size_t count)
+	{
+		return static_cast<std::size_t>(((hash >> 32) * count) >> 32);
+	}
+
+	static std::uint32_t bit(std::uint64_t hash, int i)
+	{
+		static constexpr std::uint32_t salts[8] =
+		{
+			0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+			0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u,
+		};
+
+		return 1u << ((static_cast<std::uint32_t>(hash) * salts[i]) >> 27);
+	}
+};
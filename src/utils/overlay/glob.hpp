@@ -0,0 +1,384 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+//Set of path globs compiled into a single DFA, answers "which is the first added pattern matching this whole path"
+//Patterns are folded like keys: * is any run inside a folder, ** any run across folders, **\ zero or more folders, ? one character
+//A match is one pass over the path bytes no matter how many patterns there are
+//States are built the first time a path reaches them and kept up to a cap, so rule sets whose full DFA would explode stay cheap
+class glob
+{
+public:
+	void add(std::string_view pattern, std::uint32_t value)
+	{
+		std::uint32_t current = this->state();
+		this->starts.emplace_back(current);
+
+		for (std::size_t i = 0; i < pattern.size();)
+		{
+			const char c = pattern[i];
+
+			if (c == '*')
+			{
+				const bool deep = i + 1 < pattern.size() && pattern[i + 1] == '*';
+				i += deep ? 2 : 1;
+
+				//**\ eats whole folders, including none at all so "video\**\*.bik" also covers "video\intro.bik"
+				if (deep && i < pattern.size() && pattern[i] == '\\')
+				{
+					const std::uint32_t inner = this->state();
+					const std::uint32_t next = this->state();
+
+					this->nfa[current].epsilon.emplace_back(next);
+					this->edge(current, set_t::any(), inner);
+					this->edge(inner, set_t::any(), inner);
+					this->edge(inner, set_t::single('\\'), next);
+
+					current = next;
+					i++;
+					continue;
+				}
+
+				const std::uint32_t loop = this->state();
+				this->nfa[current].epsilon.emplace_back(loop);
+				this->edge(loop, deep ? set_t::any() : set_t::component(), loop);
+				current = loop;
+				continue;
+			}
+
+			const std::uint32_t next = this->state();
+
+			if (c == '?')
+			{
+				//A lead byte, then whatever continuation bytes belong to it
+				this->edge(current, set_t::lead(), next);
+				this->edge(next, set_t::continuation(), next);
+			}
+			else
+			{
+				this->edge(current, set_t::single(c), next);
+			}
+
+			current = next;
+			i++;
+		}
+
+		this->nfa[current].accept = std::min(this->nfa[current].accept, static_cast<std::uint32_t>(this->values.size()));
+		this->values.emplace_back(value);
+		this->forget();
+	}
+
+	//Splits the bytes into classes no pattern tells apart and sets up the start state
+	//The rest of the DFA is built lazily, only the states paths actually walk into get a row in the table
+	void compile()
+	{
+		std::vector<set_t> sets;
+		for (const auto& state : this->nfa)
+		{
+			for (const auto& edge : state.edges)
+			{
+				if (std::find(sets.begin(), sets.end(), edge.on) == sets.end())
+				{
+					sets.emplace_back(edge.on);
+				}
+			}
+		}
+
+		std::map<std::vector<bool>, std::uint8_t> signatures;
+		this->representatives.clear();
+
+		for (std::uint32_t b = 0; b < 256; b++)
+		{
+			std::vector<bool> signature;
+			for (const auto& set : sets)
+			{
+				signature.emplace_back(set.has(static_cast<std::uint8_t>(b)));
+			}
+
+			auto it = signatures.find(signature);
+			if (it == signatures.end())
+			{
+				it = signatures.emplace(signature, static_cast<std::uint8_t>(this->representatives.size())).first;
+				this->representatives.emplace_back(static_cast<std::uint8_t>(b));
+			}
+
+			this->classes[b] = it->second;
+		}
+
+		this->class_count = static_cast<std::uint32_t>(this->representatives.size());
+		this->reset();
+	}
+
+	bool match(std::string_view path, std::uint32_t& value)
+	{
+		if (this->values.empty())
+		{
+			return false;
+		}
+
+		if (!this->compiled())
+		{
+			this->compile();
+		}
+
+		std::uint32_t current = 0;
+
+		for (auto c : path)
+		{
+			const std::uint32_t k = this->classes[static_cast<std::uint8_t>(c)];
+			std::uint32_t next = this->table[current + k];
+
+			if (next == unknown)
+			{
+				next = this->expand(current, k);
+			}
+
+			if (next == none)
+			{
+				return false;
+			}
+
+			current = next;
+		}
+
+		const std::uint32_t rule = this->accepts[current / this->class_count];
+
+		if (rule == none)
+		{
+			return false;
+		}
+
+		value = this->values[rule];
+		return true;
+	}
+
+	bool compiled() const
+	{
+		return !this->sets.empty();
+	}
+
+	std::size_t states() const
+	{
+		return this->sets.size();
+	}
+
+	bool empty() const
+	{
+		return this->values.empty();
+	}
+
+	void clear()
+	{
+		this->nfa.clear();
+		this->starts.clear();
+		this->values.clear();
+		this->forget();
+	}
+
+	static constexpr std::size_t state_cap = 4096;
+
+private:
+	static constexpr std::uint32_t none = ~0u;
+	static constexpr std::uint32_t unknown = ~1u;
+
+	struct set_t
+	{
+		std::uint64_t bits[4];
+
+		bool has(std::uint8_t c) const
+		{
+			return (this->bits[c >> 6] >> (c & 63)) & 1;
+		}
+
+		bool operator==(const set_t& other) const
+		{
+			return !std::memcmp(this->bits, other.bits, sizeof(this->bits));
+		}
+
+		static set_t range(std::uint32_t from, std::uint32_t to)
+		{
+			set_t set{};
+			for (auto c = from; c <= to; c++)
+			{
+				set.bits[c >> 6] |= 1ull << (c & 63);
+			}
+			return set;
+		}
+
+		static set_t single(char c)
+		{
+			return range(static_cast<std::uint8_t>(c), static_cast<std::uint8_t>(c));
+		}
+
+		static set_t any()
+		{
+			return range(0, 255);
+		}
+
+		//Anything that stays inside one folder name
+		static set_t component()
+		{
+			set_t set = any();
+			set.bits['\\' >> 6] &= ~(1ull << ('\\' & 63));
+			return set;
+		}
+
+		//Bytes that start a character, ASCII or a UTF-8 lead byte
+		static set_t lead()
+		{
+			set_t set = component();
+			set.bits[2] = 0;
+			return set;
+		}
+
+		static set_t continuation()
+		{
+			return range(0x80, 0xBF);
+		}
+	};
+
+	struct edge_t
+	{
+		set_t on;
+		std::uint32_t to;
+	};
+
+	struct state_t
+	{
+		std::vector<edge_t> edges;
+		std::vector<std::uint32_t> epsilon;
+		std::uint32_t accept = none;
+	};
+
+	std::vector<state_t> nfa;
+	std::vector<std::uint32_t> starts;
+	std::vector<std::uint32_t> values;
+
+	std::uint8_t classes[256]{};
+	std::uint32_t class_count = 0;
+	std::vector<std::uint8_t> representatives;
+
+	std::vector<std::vector<std::uint32_t>> sets;
+	std::map<std::vector<std::uint32_t>, std::uint32_t> ids;
+	std::vector<std::uint32_t> table;
+	std::vector<std::uint32_t> accepts;
+
+	void forget()
+	{
+		this->sets.clear();
+		this->ids.clear();
+		this->table.clear();
+		this->accepts.clear();
+	}
+
+	//Drops every built state and starts over from the start state
+	void reset()
+	{
+		this->forget();
+		this->intern(this->closure(this->starts));
+	}
+
+	//Hands out states as row offsets into the table, saves a multiply per byte in match
+	std::uint32_t intern(std::vector<std::uint32_t> set)
+	{
+		if (auto it = this->ids.find(set); it != this->ids.end())
+		{
+			return it->second;
+		}
+
+		const auto id = static_cast<std::uint32_t>(this->table.size());
+		this->accepts.emplace_back(this->accepting(set));
+		this->table.resize(this->table.size() + this->class_count, unknown);
+		this->ids.emplace(set, id);
+		this->sets.emplace_back(std::move(set));
+		return id;
+	}
+
+	//Fills in one missing transition, a full cache is flushed and rebuilt around the state the match is in
+	std::uint32_t expand(std::uint32_t& state, std::uint32_t k)
+	{
+		auto next = this->closure(this->step(this->sets[state / this->class_count], this->representatives[k]));
+		std::uint32_t id = none;
+
+		if (!next.empty())
+		{
+			if (this->ids.find(next) == this->ids.end() && this->sets.size() >= glob::state_cap)
+			{
+				auto from = this->sets[state / this->class_count];
+				this->reset();
+				state = this->intern(std::move(from));
+			}
+
+			id = this->intern(std::move(next));
+		}
+
+		this->table[state + k] = id;
+		return id;
+	}
+
+	std::uint32_t state()
+	{
+		this->nfa.emplace_back();
+		return static_cast<std::uint32_t>(this->nfa.size() - 1);
+	}
+
+	void edge(std::uint32_t from, const set_t& on, std::uint32_t to)
+	{
+		this->nfa[from].edges.push_back({ on, to });
+	}
+
+	std::vector<std::uint32_t> step(const std::vector<std::uint32_t>& states, std::uint8_t c) const
+	{
+		std::vector<std::uint32_t> retn;
+
+		for (auto state : states)
+		{
+			for (const auto& edge : this->nfa[state].edges)
+			{
+				if (edge.on.has(c))
+				{
+					retn.emplace_back(edge.to);
+				}
+			}
+		}
+
+		return retn;
+	}
+
+	//Sorted and deduplicated so equal state sets compare equal
+	std::vector<std::uint32_t> closure(std::vector<std::uint32_t> states) const
+	{
+		for (std::size_t i = 0; i < states.size(); i++)
+		{
+			for (auto next : this->nfa[states[i]].epsilon)
+			{
+				if (std::find(states.begin(), states.end(), next) == states.end())
+				{
+					states.emplace_back(next);
+				}
+			}
+		}
+
+		std::sort(states.begin(), states.end());
+		states.erase(std::unique(states.begin(), states.end()), states.end());
+		return states;
+	}
+
+	//Earliest pattern wins when several accept
+	std::uint32_t accepting(const std::vector<std::uint32_t>& states) const
+	{
+		std::uint32_t retn = none;
+
+		for (auto state : states)
+		{
+			retn = std::min(retn, this->nfa[state].accept);
+		}
+
+		return retn;
+	}
+};
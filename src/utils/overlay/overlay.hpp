@@ -0,0 +1,1125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include <chrono>
+
+#include "chunk/chunk.hpp"
+#include "zip/zip.hpp"
+#include "filter.hpp"
+#include "glob.hpp"
+#include "trie.hpp"
+#include "path/path.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//Index of every file the mod layers provide, keyed by normalized path relative to the game directory
+//The index is a flat image so the app can write it out as a manifest and the loader can map it as is
+//Lookups are a single perfect hash probe with no allocation
+//Keys are case folded UTF-8 and targets are UTF-8, callers on the ANSI side of the API have to convert
+class overlay
+{
+public:
+	static constexpr std::uint32_t magic = 0x464D4D4D; //MMMF
+	static constexpr std::uint32_t version = 9;
+
+	enum flags_t : std::uint32_t
+	{
+		flag_module = 1 << 0,
+		flag_directory = 1 << 1,
+		flag_packed = 1 << 2, //The target is a .mmz, size is what it decompresses to
+		flag_archived = 1 << 3, //The target is a zip, the data is stored bytes at offset, directories only exist in the index
+		flag_deflated = 1 << 4, //Archived and deflated, stored is the size of the compressed data
+	};
+
+	//Same values as the Win32 FILE_ATTRIBUTE_* bits so the loader can hand them out as is
+	enum attributes_t : std::uint32_t
+	{
+		attribute_readonly = 0x1,
+		attribute_directory = 0x10,
+		attribute_archive = 0x20,
+	};
+
+	//What a directory listing already knows about an entry, cached so attribute queries never touch the disk
+	struct meta_t
+	{
+		std::uint32_t attributes;
+		std::uint64_t size;
+		std::uint64_t time; //FILETIME ticks on Windows, nanoseconds of the file clock elsewhere
+		std::uint64_t offset; //Archived entries only, where the data starts in the archive
+		std::uint64_t stored; //Archived entries only, how many bytes the data takes there
+	};
+
+	struct header_t
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t fingerprint;
+		std::uint32_t seed;
+		std::uint32_t size;
+		std::uint32_t bucket_count, buckets;
+		std::uint32_t slot_count, slots;
+		std::uint32_t layer_count, layers;
+		std::uint32_t module_count, modules;
+		std::uint32_t child_total, children;
+		std::uint32_t root_children, root_child_count;
+		std::uint32_t rule_count, rules;
+		std::uint32_t file_count, pool;
+	};
+
+	struct slot_t
+	{
+		std::uint64_t hash;
+		std::uint32_t key;
+		std::uint32_t target;
+		std::uint32_t target_wide;
+		std::uint32_t name; //UTF-16 in its original case, for directory listings
+		std::uint16_t key_len;
+		std::uint16_t layer;
+		std::uint16_t name_len;
+		std::uint16_t shadowed; //How many lower layers provide the same path
+		std::uint32_t flags;
+		std::uint32_t attributes;
+		std::uint32_t children; //Directories only, range into the child table
+		std::uint32_t child_count;
+		std::uint64_t size;
+		std::uint64_t time;
+		std::uint64_t offset;
+		std::uint64_t stored;
+	};
+
+	//Lookup counters, relaxed since they are only read for reporting
+	//Every thread bumping the same cache lines costs the pass-through path more than the lookup itself, so only debug builds count
+	struct stats_t
+	{
+		std::atomic<std::uint64_t> lookups{ 0 };
+		std::atomic<std::uint64_t> rejected{ 0 };
+		std::atomic<std::uint64_t> hits{ 0 };
+		std::atomic<std::uint64_t> false_positives{ 0 };
+	};
+
+	//Collects the files of every layer and lays them out into an index image
+	class builder
+	{
+	public:
+		std::uint16_t layer(const std::string& name)
+		{
+			this->layers.emplace_back(name);
+			return static_cast<std::uint16_t>(this->layers.size() - 1);
+		}
+
+		//Earlier additions take precedence, later duplicates are dropped
+		void add(std::string_view relative, const std::string& target, std::uint16_t layer, const meta_t& meta = { attribute_archive, 0, 0, 0, 0 }, std::uint32_t extra = 0)
+		{
+			char buffer[1024];
+			std::size_t length = path::fold_utf8(relative, buffer, sizeof(buffer));
+
+			if (!length)
+			{
+				return;
+			}
+
+			//A layer above took over the whole directory, nothing below it shows through
+			std::uint32_t owner;
+			std::size_t covered;
+			if (this->replaced.longest(std::string_view(buffer, length), owner, covered) && owner < layer)
+			{
+				return;
+			}
+
+			//Glob rules are compiled once, on the first file after the last rule came in
+			bool pinned = false;
+			if (!this->globs.empty())
+			{
+				if (!this->globs.compiled())
+				{
+					this->globs.compile();
+				}
+
+				std::uint32_t index;
+				if (this->globs.match(std::string_view(buffer, length), index))
+				{
+					const auto& rule = this->glob_rules[index];
+
+					if (rule.ignore)
+					{
+						return;
+					}
+
+					pinned = rule.layer == layer;
+				}
+			}
+
+			std::string key(buffer, length);
+			std::uint32_t flags = ((meta.attributes & attribute_directory) ? std::uint32_t(flag_directory) : 0u) | extra;
+
+			//Mod binaries at the root of a layer always load, even when another layer has one with the same name
+			//The write layer holds what the game itself wrote, a DLL it saved there is its file and not a mod
+			if (!flags && key.find('\\') == std::string::npos && this->layers[layer] != overlay::write_layer)
+			{
+				for (auto ext : overlay::module_exts)
+				{
+					if (key.size() > ext.size() && !key.compare(key.size() - ext.size(), ext.size(), ext))
+					{
+						flags |= flag_module;
+						this->modules.emplace_back(target);
+					}
+				}
+			}
+
+			const auto separator = relative.find_last_of("\\/");
+			const auto name = separator == std::string_view::npos ? relative : relative.substr(separator + 1);
+
+			if (auto existing = this->lookup.find(key); existing != this->lookup.end())
+			{
+				auto& file = this->files[existing->second];
+				file.shadowed++;
+
+				//A layer that serves the path itself takes it over from the layers stacked above it
+				if (pinned && !file.pinned)
+				{
+					file.target = target;
+					file.name = std::string(name);
+					file.layer = layer;
+					file.flags = flags;
+					file.meta = meta;
+					file.pinned = true;
+				}
+
+				return;
+			}
+
+			this->lookup.emplace(key, this->files.size());
+			this->files.push_back({ std::move(key), target, std::string(name), layer, 0, flags, meta, pinned });
+		}
+
+		//Walks a layer directory once and adds every entry in it, the path is UTF-8 like everything else the app hands around
+		//Directories are indexed too so a folder only a mod provides still shows up as one
+		void walk(const std::string& path, const std::string& name)
+		{
+			auto id = this->layer(name);
+			const auto base = std::filesystem::u8path(path);
+
+			std::vector<std::string> kept;
+			std::vector<std::filesystem::path> archives;
+
+			for (const auto& rule : overlay::builder::read_rules(base / overlay::rules_file))
+			{
+				if (rule.verb == "keep")
+				{
+					kept.emplace_back(overlay::builder::folded(rule.argument));
+					continue;
+				}
+
+				this->rule(rule.verb, rule.argument, id);
+			}
+
+			std::error_code ec;
+			std::filesystem::recursive_directory_iterator it(base, std::filesystem::directory_options::skip_permission_denied, ec);
+
+			for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+			{
+				const auto relative = it->path().lexically_relative(base).u8string();
+
+				if (relative == overlay::rules_file)
+				{
+					continue;
+				}
+
+				auto meta = overlay::builder::stat(*it);
+
+				//Zips at the root of a layer are mounted after the walk, so loose files of the layer win over what they hold
+				if (!(meta.attributes & attribute_directory) && overlay::builder::archive(relative)
+					&& std::find(kept.begin(), kept.end(), overlay::builder::folded(relative)) == kept.end())
+				{
+					archives.emplace_back(it->path());
+					continue;
+				}
+
+				//name.mmz is served as name, listed with the size the game reads out of it
+				if (!(meta.attributes & attribute_directory) && overlay::builder::packed(relative) && chunk::probe(it->path(), meta.size))
+				{
+					this->add(std::string_view(relative).substr(0, relative.size() - std::strlen(chunk::extension)), it->path().u8string(), id, meta, flag_packed);
+					continue;
+				}
+
+				this->add(relative, it->path().u8string(), id, meta);
+			}
+
+			std::sort(archives.begin(), archives.end());
+
+			for (const auto& archive : archives)
+			{
+				this->mount(archive, id);
+			}
+		}
+
+		//Adds what a zip holds as if it was extracted into the layer, every entry points at the archive itself
+		//Zips often leave out their directory entries, those are made up from the file paths so listings still find the files
+		void mount(const std::filesystem::path& archive, std::uint16_t layer)
+		{
+			std::vector<zip::entry_t> entries;
+
+			if (!zip::list(archive, entries))
+			{
+				return;
+			}
+
+			std::error_code ec;
+			const auto meta = overlay::builder::stat(std::filesystem::directory_entry(archive, ec));
+			const auto target = archive.u8string();
+			std::unordered_set<std::string> directories;
+
+			//Loose files of the layer were added first and win, an entry under the same path is not a lower layer shadowed
+			const auto loose = [&](std::string_view name)
+			{
+				const auto existing = this->lookup.find(overlay::builder::folded(name));
+				return existing != this->lookup.end() && this->files[existing->second].layer == layer;
+			};
+
+			for (const auto& entry : entries)
+			{
+				const bool directory = entry.name.back() == '/' || entry.name.back() == '\\';
+				const auto name = std::string_view(entry.name).substr(0, entry.name.size() - directory);
+
+				for (auto separator = name.find_first_of("/\\"); separator != std::string_view::npos; separator = name.find_first_of("/\\", separator + 1))
+				{
+					if (directories.emplace(name.substr(0, separator)).second && !loose(name.substr(0, separator)))
+					{
+						this->add(name.substr(0, separator), target, layer, { attribute_directory, 0, meta.time, 0, 0 }, flag_archived);
+					}
+				}
+
+				if (directory)
+				{
+					if (directories.emplace(name).second && !loose(name))
+					{
+						this->add(name, target, layer, { attribute_directory, 0, meta.time, 0, 0 }, flag_archived);
+					}
+
+					continue;
+				}
+
+				if (loose(name))
+				{
+					continue;
+				}
+
+				const std::uint32_t flags = entry.method == zip::method_deflated ? flag_archived | flag_deflated : flag_archived;
+				this->add(name, target, layer, { attribute_archive, entry.size, meta.time, entry.offset, entry.stored }, flags);
+			}
+		}
+
+		//One line of a layer's rules file
+		//replace <dir>: the layer owns the directory, game files and lower layers under it are hidden
+		//serve <glob>: matching paths come from this layer even when a layer above has them too
+		//ignore <glob>: matching files of this layer and every layer below it are left out of the overlay
+		//keep <name.zip>: a zip at the root of the layer is served as the file it is instead of mounted, read by walk itself
+		//For globs the first matching rule decides, in layer order and then line order
+		bool rule(std::string_view verb, std::string_view argument, std::uint16_t layer)
+		{
+			char buffer[1024];
+			std::size_t length = path::fold_utf8(argument, buffer, sizeof(buffer) - 1);
+
+			if (length && (verb == "serve" || verb == "ignore"))
+			{
+				this->globs.add(std::string_view(buffer, length), static_cast<std::uint32_t>(this->glob_rules.size()));
+				this->glob_rules.push_back({ layer, verb == "ignore" });
+				return true;
+			}
+
+			while (length && buffer[length - 1] == '\\')
+			{
+				length--;
+			}
+
+			if (!length)
+			{
+				return false;
+			}
+
+			if (verb == "replace")
+			{
+				buffer[length++] = '\\';
+
+				std::uint32_t owner;
+				std::size_t covered;
+				if (!this->replaced.longest(std::string_view(buffer, length), owner, covered) || owner >= layer)
+				{
+					this->replaced.insert(std::string_view(buffer, length), layer);
+					this->rules.emplace_back(buffer, length);
+				}
+
+				return true;
+			}
+
+			return false;
+		}
+
+		std::vector<char> finish(std::uint64_t fingerprint) const
+		{
+			const std::uint32_t file_count = static_cast<std::uint32_t>(this->files.size());
+			const std::uint32_t bucket_count = file_count / 4 + 1;
+			const std::uint32_t slot_count = file_count + file_count / 4 + 1;
+
+			std::vector<std::uint64_t> hashes;
+			hashes.reserve(file_count);
+
+			for (const auto& file : this->files)
+			{
+				hashes.emplace_back(path::hash(file.key));
+			}
+
+			std::vector<std::uint32_t> displacements;
+			std::vector<std::uint32_t> placement;
+			std::uint32_t seed = 0;
+
+			while (!overlay::builder::place(hashes, seed, bucket_count, slot_count, displacements, placement))
+			{
+				seed++;
+			}
+
+			header_t header{};
+			header.magic = overlay::magic;
+			header.version = overlay::version;
+			header.fingerprint = fingerprint;
+			header.seed = seed;
+			header.file_count = file_count;
+			header.bucket_count = bucket_count;
+			header.slot_count = slot_count;
+			header.layer_count = static_cast<std::uint32_t>(this->layers.size());
+			header.module_count = static_cast<std::uint32_t>(this->modules.size());
+			header.rule_count = static_cast<std::uint32_t>(this->rules.size());
+
+			//Listings are resolved per directory at build time so enumerating one is a walk over a contiguous range
+			//Root level entries hang off the header, everything else off its parent's slot
+			std::vector<std::vector<std::uint32_t>> listings(file_count + 1);
+			std::vector<std::uint32_t> children;
+
+			for (std::uint32_t i = 0; i < file_count; i++)
+			{
+				const auto& file = this->files[i];
+
+				//Mod binaries are loaded by us, the game should not find them and load them a second time
+				if (file.flags & flag_module)
+				{
+					continue;
+				}
+
+				const auto separator = file.key.rfind('\\');
+
+				if (separator == std::string::npos)
+				{
+					listings[file_count].emplace_back(i);
+				}
+				else if (auto parent = this->lookup.find(file.key.substr(0, separator)); parent != this->lookup.end())
+				{
+					listings[parent->second].emplace_back(i);
+				}
+			}
+
+			for (auto& listing : listings)
+			{
+				std::sort(listing.begin(), listing.end(), [&](std::uint32_t a, std::uint32_t b)
+				{
+					return this->files[a].key < this->files[b].key;
+				});
+			}
+
+			std::vector<std::uint32_t> starts(file_count + 1);
+
+			for (std::uint32_t i = 0; i <= file_count; i++)
+			{
+				starts[i] = static_cast<std::uint32_t>(children.size());
+
+				for (auto child : listings[i])
+				{
+					children.emplace_back(placement[child]);
+				}
+			}
+
+			header.child_total = static_cast<std::uint32_t>(children.size());
+			header.root_children = starts[file_count];
+			header.root_child_count = static_cast<std::uint32_t>(listings[file_count].size());
+
+			std::uint32_t offset = sizeof(header_t);
+			header.buckets = offset;
+			offset = overlay::builder::align(offset + bucket_count * sizeof(std::uint32_t));
+			header.slots = offset;
+			offset += slot_count * sizeof(slot_t);
+			header.layers = offset;
+			offset += header.layer_count * sizeof(std::uint32_t);
+			header.modules = offset;
+			offset += header.module_count * sizeof(std::uint32_t);
+			header.children = offset;
+			offset += header.child_total * sizeof(std::uint32_t);
+			header.rules = offset;
+			offset += header.rule_count * sizeof(std::uint32_t);
+			header.pool = overlay::builder::align(offset);
+
+			std::string pool;
+			std::vector<slot_t> slots(slot_count);
+
+			for (std::uint32_t i = 0; i < file_count; i++)
+			{
+				const auto& file = this->files[i];
+				auto& slot = slots[placement[i]];
+
+				slot.hash = hashes[i];
+				slot.layer = file.layer;
+				slot.shadowed = file.shadowed;
+				slot.flags = file.flags;
+				slot.attributes = file.meta.attributes;
+				slot.size = file.meta.size;
+				slot.time = file.meta.time;
+				slot.offset = file.meta.offset;
+				slot.stored = file.meta.stored;
+				slot.children = starts[i];
+				slot.child_count = static_cast<std::uint32_t>(listings[i].size());
+
+				slot.key = static_cast<std::uint32_t>(pool.size());
+				slot.key_len = static_cast<std::uint16_t>(file.key.size());
+				pool.append(file.key);
+
+				slot.target = static_cast<std::uint32_t>(pool.size());
+				pool.append(file.target);
+				pool.push_back('\0');
+
+				//Wide copy for the W and NT APIs, converted here once instead of on every hit
+				char16_t wide[1024];
+				const std::size_t wide_len = path::utf16(file.target, wide, 1024);
+
+				pool.resize((pool.size() + 1) & ~std::size_t(1));
+				slot.target_wide = static_cast<std::uint32_t>(pool.size());
+				pool.append(reinterpret_cast<const char*>(wide), (wide_len + 1) * sizeof(char16_t));
+
+				slot.name = static_cast<std::uint32_t>(pool.size());
+				slot.name_len = static_cast<std::uint16_t>(path::utf16(file.name, wide, 1024));
+				pool.append(reinterpret_cast<const char*>(wide), (slot.name_len + 1) * sizeof(char16_t));
+			}
+
+			std::vector<std::uint32_t> layers;
+			for (const auto& layer : this->layers)
+			{
+				layers.emplace_back(static_cast<std::uint32_t>(pool.size()));
+				pool.append(layer);
+				pool.push_back('\0');
+			}
+
+			std::vector<std::uint32_t> modules;
+			for (const auto& module : this->modules)
+			{
+				modules.emplace_back(static_cast<std::uint32_t>(pool.size()));
+				pool.append(module);
+				pool.push_back('\0');
+			}
+
+			std::vector<std::uint32_t> rules;
+			for (const auto& rule : this->rules)
+			{
+				rules.emplace_back(static_cast<std::uint32_t>(pool.size()));
+				pool.append(rule);
+				pool.push_back('\0');
+			}
+
+			header.size = header.pool + static_cast<std::uint32_t>(pool.size());
+
+			std::vector<char> image(header.size);
+			std::memcpy(&image[0], &header, sizeof(header));
+			std::memcpy(&image[header.buckets], displacements.data(), displacements.size() * sizeof(std::uint32_t));
+			std::memcpy(&image[header.slots], slots.data(), slots.size() * sizeof(slot_t));
+			std::memcpy(&image[header.layers], layers.data(), layers.size() * sizeof(std::uint32_t));
+			std::memcpy(&image[header.modules], modules.data(), modules.size() * sizeof(std::uint32_t));
+			std::memcpy(&image[header.children], children.data(), children.size() * sizeof(std::uint32_t));
+			std::memcpy(&image[header.rules], rules.data(), rules.size() * sizeof(std::uint32_t));
+			std::memcpy(&image[header.pool], pool.data(), pool.size());
+
+			return image;
+		}
+
+	private:
+		struct file_t
+		{
+			std::string key;
+			std::string target;
+			std::string name;
+			std::uint16_t layer;
+			std::uint16_t shadowed;
+			std::uint32_t flags;
+			meta_t meta;
+			bool pinned; //Claimed by a serve rule of its own layer
+		};
+
+		struct glob_rule_t
+		{
+			std::uint16_t layer;
+			bool ignore;
+		};
+
+		std::vector<file_t> files;
+		std::vector<std::string> layers;
+		std::vector<std::string> modules;
+		std::vector<std::string> rules;
+		std::unordered_map<std::string, std::size_t> lookup;
+		trie replaced;
+		glob globs;
+		std::vector<glob_rule_t> glob_rules;
+
+		struct directive_t
+		{
+			std::string verb;
+			std::string argument;
+		};
+
+		//Rules files are "<verb> <argument>" per line, blank lines and lines starting with # are skipped
+		static std::vector<directive_t> read_rules(const std::filesystem::path& file)
+		{
+			std::vector<directive_t> retn;
+			std::ifstream stream(file);
+			std::string line;
+
+			while (std::getline(stream, line))
+			{
+				line.erase(0, line.find_first_not_of(" \t"));
+				line.erase(line.find_last_not_of(" \t\r") + 1);
+
+				if (line.empty() || line[0] == '#')
+				{
+					continue;
+				}
+
+				const auto space = line.find_first_of(" \t");
+				if (space == std::string::npos)
+				{
+					continue;
+				}
+
+				retn.push_back({ line.substr(0, space), line.substr(line.find_first_not_of(" \t", space)) });
+			}
+
+			return retn;
+		}
+
+		static std::string folded(std::string_view relative)
+		{
+			char buffer[1024];
+			return std::string(buffer, path::fold_utf8(relative, buffer, sizeof(buffer)));
+		}
+
+		static bool ends_with(const std::string& relative, std::string_view extension)
+		{
+			const auto name = overlay::builder::folded(relative);
+			return name.size() > extension.size() && !name.compare(name.size() - extension.size(), extension.size(), extension);
+		}
+
+		static bool packed(const std::string& relative)
+		{
+			return overlay::builder::ends_with(relative, chunk::extension);
+		}
+
+		//Only zips right in the layer root, one further down is a file the game itself may want
+		static bool archive(const std::string& relative)
+		{
+			return relative.find_first_of("/\\") == std::string::npos && overlay::builder::ends_with(relative, ".zip");
+		}
+
+		static std::uint32_t align(std::uint32_t offset)
+		{
+			return (offset + 7) & ~7u;
+		}
+
+		static meta_t stat(const std::filesystem::directory_entry& entry)
+		{
+			meta_t meta{};
+			std::error_code ec;
+
+#ifdef _WIN32
+			//The directory_entry has nothing for the raw attribute bits, one query per entry at build time keeps them exact
+			WIN32_FILE_ATTRIBUTE_DATA data;
+			if (GetFileAttributesExW(entry.path().c_str(), GetFileExInfoStandard, &data))
+			{
+				meta.attributes = data.dwFileAttributes;
+				meta.size = (std::uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+				meta.time = (std::uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+				return meta;
+			}
+#endif
+
+			const bool directory = entry.is_directory(ec);
+			const auto perms = entry.status(ec).permissions();
+
+			meta.attributes = directory ? attribute_directory : attribute_archive;
+			meta.attributes |= (perms & std::filesystem::perms::owner_write) == std::filesystem::perms::none ? std::uint32_t(attribute_readonly) : 0u;
+			meta.size = directory ? 0 : static_cast<std::uint64_t>(entry.file_size(ec));
+			meta.time = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(entry.last_write_time(ec).time_since_epoch()).count());
+			return meta;
+		}
+
+		//Hash and displace, buckets are placed largest first and each gets the first displacement that lands all of its keys in free slots
+		static bool place(const std::vector<std::uint64_t>& hashes, std::uint32_t seed, std::uint32_t bucket_count, std::uint32_t slot_count,
+			std::vector<std::uint32_t>& displacements, std::vector<std::uint32_t>& placement)
+		{
+			std::vector<std::vector<std::uint32_t>> buckets(bucket_count);
+			for (std::uint32_t i = 0; i < hashes.size(); i++)
+			{
+				buckets[overlay::bucket(hashes[i], seed, bucket_count)].emplace_back(i);
+			}
+
+			std::vector<std::uint32_t> order(bucket_count);
+			for (std::uint32_t i = 0; i < bucket_count; i++)
+			{
+				order[i] = i;
+			}
+
+			std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+			{
+				return buckets[a].size() > buckets[b].size();
+			});
+
+			displacements.assign(bucket_count, 0);
+			placement.assign(hashes.size(), 0);
+
+			std::vector<bool> taken(slot_count);
+			std::vector<std::uint32_t> candidate;
+
+			for (auto b : order)
+			{
+				if (buckets[b].empty())
+				{
+					break;
+				}
+
+				bool placed = false;
+
+				for (std::uint32_t d = 0; d < (1u << 20) && !placed; d++)
+				{
+					candidate.clear();
+					placed = true;
+
+					for (auto i : buckets[b])
+					{
+						auto slot = overlay::slot(hashes[i], seed, d, slot_count);
+
+						if (taken[slot] || std::find(candidate.begin(), candidate.end(), slot) != candidate.end())
+						{
+							placed = false;
+							break;
+						}
+
+						candidate.emplace_back(slot);
+					}
+
+					if (placed)
+					{
+						displacements[b] = d;
+
+						for (std::size_t k = 0; k < candidate.size(); k++)
+						{
+							taken[candidate[k]] = true;
+							placement[buckets[b][k]] = candidate[k];
+						}
+					}
+				}
+
+				if (!placed)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+	};
+
+	//Maps a prebuilt manifest read-only, fails if it is missing or was written by another version
+	static bool load(const std::string& path)
+	{
+		overlay::unload();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		GetFileSizeEx(file, &size);
+
+		HANDLE mapping = size.QuadPart ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		CloseHandle(file);
+
+		if (!mapping)
+		{
+			return false;
+		}
+
+		overlay::view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		CloseHandle(mapping);
+
+		overlay::view_size = static_cast<std::size_t>(size.QuadPart);
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat info;
+		fstat(file, &info);
+
+		void* view = info.st_size ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		close(file);
+
+		overlay::view = view != MAP_FAILED ? static_cast<const char*>(view) : nullptr;
+		overlay::view_size = static_cast<std::size_t>(info.st_size);
+#endif
+
+		if (!overlay::view || !overlay::attach(overlay::view, overlay::view_size))
+		{
+			overlay::unload();
+			return false;
+		}
+
+		return true;
+	}
+
+	//Takes ownership of an image built in process
+	static bool use(std::vector<char>&& image)
+	{
+		overlay::unload();
+		overlay::storage = std::move(image);
+		return overlay::attach(overlay::storage.data(), overlay::storage.size());
+	}
+
+	static bool save(const std::string& path, const std::vector<char>& image)
+	{
+		const auto file = std::filesystem::u8path(path);
+		std::filesystem::create_directories(file.parent_path());
+
+		std::ofstream stream(file, std::ios::binary | std::ofstream::out | std::ofstream::trunc);
+		if (!stream.is_open())
+		{
+			return false;
+		}
+
+		stream.write(image.data(), static_cast<std::streamsize>(image.size()));
+		return stream.good();
+	}
+
+	static void unload()
+	{
+		if (overlay::view)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(overlay::view);
+#else
+			munmap(const_cast<char*>(overlay::view), overlay::view_size);
+#endif
+		}
+
+		overlay::view = nullptr;
+		overlay::view_size = 0;
+		overlay::storage.clear();
+		overlay::negative.clear();
+		overlay::header = nullptr;
+	}
+
+	//Fingerprint of the layer trees, anything added, removed or rewritten changes it
+	static std::uint64_t fingerprint(const std::vector<std::string>& layers)
+	{
+		std::uint64_t hash = path::hash(std::to_string(overlay::version));
+
+		for (const auto& layer : layers)
+		{
+			std::error_code ec;
+			std::filesystem::recursive_directory_iterator it(std::filesystem::u8path(layer), std::filesystem::directory_options::skip_permission_denied, ec);
+
+			hash = overlay::combine(hash, path::hash(layer));
+
+			for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+			{
+				std::error_code ignored;
+				const auto time = static_cast<std::uint64_t>(it->last_write_time(ignored).time_since_epoch().count());
+				const auto size = it->is_directory(ignored) ? 0 : static_cast<std::uint64_t>(it->file_size(ignored));
+
+				hash = overlay::combine(hash, path::hash(it->path().u8string()));
+				hash = overlay::combine(hash, time);
+				hash = overlay::combine(hash, size);
+			}
+		}
+
+		return hash;
+	}
+
+	//Returns the slot for a normalized key, or nullptr if no layer provides it
+	static const slot_t* find(std::string_view key)
+	{
+		if (!overlay::header || !overlay::header->file_count)
+		{
+			return nullptr;
+		}
+
+		const std::uint64_t hash = path::hash(key);
+		overlay::count(overlay::stats.lookups);
+
+		//Most opens are not overridden, let those leave before touching the slot table
+		if (!overlay::negative.empty() && !overlay::negative.contains(hash))
+		{
+			overlay::count(overlay::stats.rejected);
+			return nullptr;
+		}
+
+		const auto displacement = overlay::buckets[overlay::bucket(hash, overlay::header->seed, overlay::header->bucket_count)];
+		const auto& slot = overlay::slots[overlay::slot(hash, overlay::header->seed, displacement, overlay::header->slot_count)];
+
+		if (slot.hash == hash && slot.key_len == key.size() && !std::memcmp(overlay::pool + slot.key, key.data(), key.size()))
+		{
+			overlay::count(overlay::stats.hits);
+			return &slot;
+		}
+
+		overlay::count(overlay::stats.false_positives);
+		return nullptr;
+	}
+
+	//Builds the negative lookup filter over every key in the attached index
+	static void build_filter()
+	{
+		std::vector<std::uint64_t> hashes;
+
+		for (std::uint32_t i = 0; overlay::header && i < overlay::header->slot_count; i++)
+		{
+			if (overlay::slots[i].hash)
+			{
+				hashes.emplace_back(overlay::slots[i].hash);
+			}
+		}
+
+		overlay::negative.build(hashes);
+	}
+
+	static const char* target(const slot_t* slot)
+	{
+		return overlay::pool + slot->target;
+	}
+
+	static const char16_t* target_wide(const slot_t* slot)
+	{
+		return reinterpret_cast<const char16_t*>(overlay::pool + slot->target_wide);
+	}
+
+	static std::string_view key(const slot_t* slot)
+	{
+		return std::string_view(overlay::pool + slot->key, slot->key_len);
+	}
+
+	//Original case file name of an entry, UTF-16 and null terminated
+	static const char16_t* name(const slot_t* slot)
+	{
+		return reinterpret_cast<const char16_t*>(overlay::pool + slot->name);
+	}
+
+	//Precomputed listing of a directory entry, or of the merged layer roots when directory is nullptr
+	//Returns the number of entries, each one found with overlay::at
+	static std::uint32_t children(const slot_t* directory, const std::uint32_t*& entries)
+	{
+		if (!overlay::header)
+		{
+			return 0;
+		}
+
+		const auto start = directory ? directory->children : overlay::header->root_children;
+		entries = overlay::child_list + start;
+
+		return directory ? directory->child_count : overlay::header->root_child_count;
+	}
+
+	static const slot_t* at(std::uint32_t index)
+	{
+		return &overlay::slots[index];
+	}
+
+	static const char* layer(std::uint16_t id)
+	{
+		return id < overlay::header->layer_count ? overlay::pool + overlay::layers[id] : "";
+	}
+
+	//Every indexed path in key order, for showing which layer won
+	static std::vector<const slot_t*> entries()
+	{
+		std::vector<const slot_t*> retn;
+
+		for (std::uint32_t i = 0; overlay::header && i < overlay::header->slot_count; i++)
+		{
+			if (overlay::slots[i].hash)
+			{
+				retn.emplace_back(&overlay::slots[i]);
+			}
+		}
+
+		std::sort(retn.begin(), retn.end(), [](const slot_t* a, const slot_t* b)
+		{
+			return overlay::key(a) < overlay::key(b);
+		});
+
+		return retn;
+	}
+
+	static std::uint32_t layer_count()
+	{
+		return overlay::header ? overlay::header->layer_count : 0;
+	}
+
+	//Directories a layer replaced as a whole, folded with a trailing separator
+	static std::vector<std::string_view> replaced()
+	{
+		std::vector<std::string_view> retn;
+
+		for (std::uint32_t i = 0; overlay::header && i < overlay::header->rule_count; i++)
+		{
+			retn.emplace_back(overlay::pool + overlay::rule_list[i]);
+		}
+
+		return retn;
+	}
+
+	//Mod binaries at the root of each layer, in load order
+	static std::vector<const char*> modules()
+	{
+		std::vector<const char*> retn;
+
+		for (std::uint32_t i = 0; overlay::header && i < overlay::header->module_count; i++)
+		{
+			retn.emplace_back(overlay::pool + overlay::module_list[i]);
+		}
+
+		return retn;
+	}
+
+	static std::uint64_t manifest_fingerprint()
+	{
+		return overlay::header ? overlay::header->fingerprint : 0;
+	}
+
+	static std::size_t size()
+	{
+		return overlay::header ? overlay::header->file_count : 0;
+	}
+
+	static std::initializer_list<std::string_view> module_exts;
+	static constexpr const char* rules_file = "overlay.rules";
+
+	//Layer name of the pack's write layer, what the game wrote in earlier sessions, it goes above every mod layer
+	static constexpr const char* write_layer = "_saves";
+	static stats_t stats;
+
+#ifdef DEBUG
+	static constexpr bool counting = true;
+#else
+	static constexpr bool counting = false;
+#endif
+
+private:
+	static void count(std::atomic<std::uint64_t>& counter)
+	{
+		if constexpr (overlay::counting)
+		{
+			counter.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	inline static std::vector<char> storage;
+	inline static filter negative;
+	inline static const char* view = nullptr;
+	inline static std::size_t view_size = 0;
+
+	inline static const header_t* header = nullptr;
+	inline static const std::uint32_t* buckets = nullptr;
+	inline static const slot_t* slots = nullptr;
+	inline static const std::uint32_t* layers = nullptr;
+	inline static const std::uint32_t* module_list = nullptr;
+	inline static const std::uint32_t* child_list = nullptr;
+	inline static const std::uint32_t* rule_list = nullptr;
+	inline static const char* pool = nullptr;
+
+	static bool attach(const char* image, std::size_t size)
+	{
+		const auto candidate = reinterpret_cast<const header_t*>(image);
+
+		if (size < sizeof(header_t) || candidate->magic != overlay::magic || candidate->version != overlay::version || candidate->size != size)
+		{
+			return false;
+		}
+
+		if (candidate->pool > size || candidate->slots + std::uint64_t(candidate->slot_count) * sizeof(slot_t) > size)
+		{
+			return false;
+		}
+
+		overlay::header = candidate;
+		overlay::buckets = reinterpret_cast<const std::uint32_t*>(image + candidate->buckets);
+		overlay::slots = reinterpret_cast<const slot_t*>(image + candidate->slots);
+		overlay::layers = reinterpret_cast<const std::uint32_t*>(image + candidate->layers);
+		overlay::module_list = reinterpret_cast<const std::uint32_t*>(image + candidate->modules);
+		overlay::child_list = reinterpret_cast<const std::uint32_t*>(image + candidate->children);
+		overlay::rule_list = reinterpret_cast<const std::uint32_t*>(image + candidate->rules);
+		overlay::pool = image + candidate->pool;
+		return true;
+	}
+
+	static std::uint64_t mix(std::uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	static std::uint64_t combine(std::uint64_t hash, std::uint64_t value)
+	{
+		return overlay::mix(hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2)));
+	}
+
+	//Maps a 32 bit value onto [0, range) without a division
+	static std::uint32_t reduce(std::uint32_t x, std::uint32_t range)
+	{
+		return static_cast<std::uint32_t>((static_cast<std::uint64_t>(x) * range) >> 32);
+	}
+
+	static std::uint32_t bucket(std::uint64_t hash, std::uint32_t seed, std::uint32_t bucket_count)
+	{
+		return overlay::reduce(static_cast<std::uint32_t>(overlay::mix(hash ^ seed) >> 32), bucket_count);
+	}
+
+	static std::uint32_t slot(std::uint64_t hash, std::uint32_t seed, std::uint32_t displacement, std::uint32_t slot_count)
+	{
+		return overlay::reduce(static_cast<std::uint32_t>(overlay::mix(hash + seed + displacement * 0x9E3779B97F4A7C15ull)), slot_count);
+	}
+};
+
+inline std::initializer_list<std::string_view> overlay::module_exts
+{
+	".dll",
+	".asi",
+};
+
+inline overlay::stats_t overlay::stats;
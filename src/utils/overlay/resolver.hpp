@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "overlay.hpp"
+#include "trie.hpp"
+#include "path/path.hpp"
+
+//What the file hooks do with a path before they call the real API, without any of the Windows parts
+//A path is folded, the game dir is stripped off it and the rest is looked up in the attached overlay index
+//Lives here rather than in the loader so the bench can replay recorded opens through the exact same code
+class resolver
+{
+public:
+	//Big enough for any path the ANSI and wide APIs accept once it is folded to UTF-8
+	static constexpr std::size_t buffer_size = 260 * 4;
+
+	//What a path resolved to, a layer file or a hole punched by a replace rule
+	struct hit_t
+	{
+		const overlay::slot_t* slot;
+		bool hidden;
+	};
+
+	//root is the folded game dir with a trailing separator, rules are the folded directories layers replaced as a whole
+	template <typename T> void init(const std::string& root, const T& rules)
+	{
+		//Plain, long path and NT namespace spellings of the game dir
+		this->mounts.clear();
+		if (!root.empty())
+		{
+			this->mounts.insert(root, 0);
+			this->mounts.insert("\\\\?\\" + root, 0);
+			this->mounts.insert("\\??\\" + root, 0);
+		}
+
+		this->replaced.clear();
+		for (const auto& rule : rules)
+		{
+			this->replaced.insert(rule, 0);
+		}
+
+		this->mounts.compact();
+		this->replaced.compact();
+	}
+
+	//Turns a folded path into an overlay key, false if it points outside of the game dir
+	bool locate(std::string_view& key) const
+	{
+		std::uint32_t mount;
+		std::size_t length;
+
+		//Shorten files read from the game dir, anything else absolute lives outside of it
+		if (this->mounts.longest(key, mount, length))
+		{
+			key.remove_prefix(length);
+		}
+		else if ((key.size() > 1 && key[1] == ':') || (!key.empty() && key[0] == '\\'))
+		{
+			return false;
+		}
+
+		//Or potentially relative
+		while (key.size() > 2 && key[0] == '.' && key[1] == '\\')
+		{
+			key.remove_prefix(2);
+		}
+
+		//Directory queries like to carry a trailing separator
+		while (!key.empty() && key.back() == '\\')
+		{
+			key.remove_suffix(1);
+		}
+
+		return true;
+	}
+
+	bool hidden(std::string_view key) const
+	{
+		std::uint32_t layer;
+		std::size_t length;
+		return this->replaced.longest(key, layer, length);
+	}
+
+	//Every entry point ends up here with a folded path
+	hit_t resolve(std::string_view key) const
+	{
+		if (!this->locate(key) || key.empty())
+		{
+			return {};
+		}
+
+		if (auto slot = overlay::find(key))
+		{
+			return { slot, false };
+		}
+
+		return { nullptr, this->hidden(key) };
+	}
+
+	//UTF-8 as it comes from the API, pure ASCII paths stay on the vector fold
+	hit_t resolve_utf8(std::string_view name) const
+	{
+		char buffer[resolver::buffer_size];
+		const std::size_t length = path::fold_utf8(name, buffer, sizeof(buffer));
+
+		return length ? this->resolve(std::string_view(buffer, length)) : hit_t{};
+	}
+
+	hit_t resolve_wide(std::wstring_view name) const
+	{
+		char buffer[resolver::buffer_size];
+		const std::size_t length = path::fold_wide(name, buffer, sizeof(buffer));
+
+		return length ? this->resolve(std::string_view(buffer, length)) : hit_t{};
+	}
+
+private:
+	//Folded game directory with a trailing separator in every spelling the APIs hand us, longest match is stripped to get an overlay key
+	trie mounts;
+
+	//Directories a layer replaced as a whole, anything under them the layers do not have is reported missing
+	trie replaced;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//Compressed radix trie over folded paths, answers "which inserted key is the longest prefix of this path"
+//A lookup walks the bytes of the path once instead of comparing against every key
+//Directory entries are inserted with their trailing separator so "movies\\" never matches "movies2\\"
+class trie
+{
+public:
+	trie()
+	{
+		this->clear();
+	}
+
+	void insert(std::string_view key, std::uint32_t value)
+	{
+		std::uint32_t node = 0;
+
+		while (!key.empty())
+		{
+			std::uint32_t child = this->child(node, key[0]);
+
+			if (child == none)
+			{
+				child = this->make(key);
+				this->nodes[child].sibling = this->nodes[node].child;
+				this->nodes[node].child = child;
+				node = child;
+				break;
+			}
+
+			const auto label = this->label(child);
+			std::size_t common = 0;
+
+			while (common < label.size() && common < key.size() && label[common] == key[common])
+			{
+				common++;
+			}
+
+			//Partial match, split the edge so the shared part becomes its own node
+			if (common < label.size())
+			{
+				const std::string shared(label.substr(0, common));
+				const std::uint32_t split = this->make(shared);
+
+				this->nodes[split].sibling = this->nodes[child].sibling;
+				this->nodes[split].child = child;
+				this->nodes[child].label += static_cast<std::uint32_t>(common);
+				this->nodes[child].label_len -= static_cast<std::uint32_t>(common);
+				this->nodes[child].first = this->labels[this->nodes[child].label];
+				this->nodes[child].sibling = none;
+
+				this->relink(node, child, split);
+				child = split;
+			}
+
+			key.remove_prefix(common);
+			node = child;
+		}
+
+		this->nodes[node].value = value;
+		this->nodes[node].terminal = true;
+	}
+
+	//Longest inserted key that prefixes path, length receives how much of path it covered
+	bool longest(std::string_view path, std::uint32_t& value, std::size_t& length) const
+	{
+		std::uint32_t node = 0;
+		std::size_t offset = 0;
+		bool found = this->nodes[0].terminal;
+
+		if (found)
+		{
+			value = this->nodes[0].value;
+			length = 0;
+		}
+
+		while (offset < path.size())
+		{
+			const std::uint32_t child = this->child(node, path[offset]);
+
+			if (child == none)
+			{
+				break;
+			}
+
+			const auto& entry = this->nodes[child];
+
+			if (path.size() - offset < entry.label_len || std::memcmp(path.data() + offset, this->labels.data() + entry.label, entry.label_len))
+			{
+				break;
+			}
+
+			offset += entry.label_len;
+			node = child;
+
+			if (entry.terminal)
+			{
+				found = true;
+				value = entry.value;
+				length = offset;
+			}
+		}
+
+		return found;
+	}
+
+	//Lays the nodes out breadth first so siblings sit next to each other and a lookup scans them within a cache line or two
+	//Call once after the last insert, lookups work either way
+	void compact()
+	{
+		std::vector<std::uint32_t> order;
+		std::vector<std::uint32_t> remap(this->nodes.size(), none);
+
+		order.reserve(this->nodes.size());
+		order.emplace_back(0);
+		remap[0] = 0;
+
+		for (std::size_t i = 0; i < order.size(); i++)
+		{
+			for (auto child = this->nodes[order[i]].child; child != none; child = this->nodes[child].sibling)
+			{
+				remap[child] = static_cast<std::uint32_t>(order.size());
+				order.emplace_back(child);
+			}
+		}
+
+		std::vector<node_t> compacted;
+		compacted.reserve(order.size());
+
+		for (auto old : order)
+		{
+			node_t node = this->nodes[old];
+			node.child = node.child == none ? none : remap[node.child];
+			node.sibling = node.sibling == none ? none : remap[node.sibling];
+			compacted.emplace_back(node);
+		}
+
+		this->nodes = std::move(compacted);
+	}
+
+	bool empty() const
+	{
+		return this->nodes.size() == 1 && !this->nodes[0].terminal;
+	}
+
+	void clear()
+	{
+		this->nodes.assign(1, node_t{});
+		this->labels.clear();
+	}
+
+private:
+	static constexpr std::uint32_t none = ~0u;
+
+	//Children are a sibling list, path bytes fan out little past the first few characters of a folder name
+	struct node_t
+	{
+		std::uint32_t label = 0;
+		std::uint32_t label_len = 0;
+		std::uint32_t child = none;
+		std::uint32_t sibling = none;
+		std::uint32_t value = 0;
+		char first = 0;
+		bool terminal = false;
+	};
+
+	std::vector<node_t> nodes;
+	std::string labels;
+
+	std::string_view label(std::uint32_t node) const
+	{
+		return std::string_view(this->labels.data() + this->nodes[node].label, this->nodes[node].label_len);
+	}
+
+	std::uint32_t child(std::uint32_t node, char c) const
+	{
+		for (auto i = this->nodes[node].child; i != none; i = this->nodes[i].sibling)
+		{
+			if (this->nodes[i].first == c)
+			{
+				return i;
+			}
+		}
+
+		return none;
+	}
+
+	std::uint32_t make(std::string_view label)
+	{
+		node_t node;
+		node.label = static_cast<std::uint32_t>(this->labels.size());
+		node.label_len = static_cast<std::uint32_t>(label.size());
+		node.first = label.empty() ? 0 : label[0];
+
+		this->labels.append(label);
+		this->nodes.emplace_back(node);
+		return static_cast<std::uint32_t>(this->nodes.size() - 1);
+	}
+
+	void relink(std::uint32_t parent, std::uint32_t from, std::uint32_t to)
+	{
+		if (this->nodes[parent].child == from)
+		{
+			this->nodes[parent].child = to;
+			return;
+		}
+
+		for (auto i = this->nodes[parent].child; i != none; i = this->nodes[i].sibling)
+		{
+			if (this->nodes[i].sibling == from)
+			{
+				this->nodes[i].sibling = to;
+				return;
+			}
+		}
+	}
+};
@@ -0,0 +1,585 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "casefold.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PATH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PATH_AVX2
+#else
+#include <cpuid.h>
+#define PATH_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//Allocation free path kernels, everything works on views and caller provided buffers
+//x86 gets SSE2 and AVX2 paths picked at runtime, everything else falls back to scalar
+class path
+{
+public:
+	//Lowercases ASCII and converts '/' to '\\' into a caller buffer in a single pass
+	//Returns the folded length, or 0 if the path does not fit
+	static std::size_t fold(std::string_view in, char* out, std::size_t size)
+	{
+		if (in.size() >= size)
+		{
+			return 0;
+		}
+
+		path::fold_ascii(in.data(), out, in.size());
+
+		out[in.size()] = '\0';
+		return in.size();
+	}
+
+	//Unicode aware fold, UTF-8 in and out with simple case folding applied to every code point
+	//Stays on the vector path for the ASCII run at the front, which is the whole path more often than not
+	static std::size_t fold_utf8(std::string_view in, char* out, std::size_t size)
+	{
+		const std::size_t ascii = path::ascii_prefix(in);
+
+		if (ascii == in.size())
+		{
+			return path::fold(in, out, size);
+		}
+
+		if (ascii >= size)
+		{
+			return 0;
+		}
+
+		path::fold_ascii(in.data(), out, ascii);
+
+		std::size_t length = ascii;
+
+		for (std::size_t i = ascii; i < in.size();)
+		{
+			std::uint32_t c = static_cast<std::uint8_t>(in[i]);
+			std::size_t consumed = 1;
+
+			if (c < 0x80)
+			{
+				c = static_cast<std::uint8_t>(path::fold_char(static_cast<char>(c)));
+			}
+			else
+			{
+				consumed = path::decode_utf8(in, i, c);
+			}
+
+			if (c >= 0x80 && consumed == 1)
+			{
+				//Malformed bytes are copied through untouched
+				if (length + 1 >= size)
+				{
+					return 0;
+				}
+
+				out[length++] = in[i];
+			}
+			else if (!(length = path::encode_utf8(casefold::fold(c), out, length, size)))
+			{
+				return 0;
+			}
+
+			i += consumed;
+		}
+
+		out[length] = '\0';
+		return length;
+	}
+
+	//Same as fold_utf8 but straight from UTF-16 (or UTF-32 where wchar_t is 4 bytes), no intermediate conversion
+	static std::size_t fold_wide(std::wstring_view in, char* out, std::size_t size)
+	{
+		std::size_t length = 0;
+
+		for (std::size_t i = 0; i < in.size(); i++)
+		{
+			std::uint32_t c = static_cast<std::uint32_t>(in[i]);
+
+			if (c < 0x80)
+			{
+				if (length + 1 >= size)
+				{
+					return 0;
+				}
+
+				out[length++] = path::fold_char(static_cast<char>(c));
+				continue;
+			}
+
+			if (sizeof(wchar_t) == 2 && c >= 0xD800 && c < 0xDC00 && i + 1 < in.size())
+			{
+				const std::uint32_t low = static_cast<std::uint32_t>(in[i + 1]);
+
+				if (low >= 0xDC00 && low < 0xE000)
+				{
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					i++;
+				}
+			}
+
+			length = path::encode_utf8(casefold::fold(c), out, length, size);
+
+			if (!length)
+			{
+				return 0;
+			}
+		}
+
+		out[length] = '\0';
+		return length;
+	}
+
+	//UTF-8 to UTF-16 without case changes, for handing stored paths to wide APIs
+	//Returns the length in code units, or 0 if the path does not fit
+	static std::size_t utf16(std::string_view in, char16_t* out, std::size_t size)
+	{
+		std::size_t length = 0;
+
+		for (std::size_t i = 0; i < in.size();)
+		{
+			std::uint32_t c = static_cast<std::uint8_t>(in[i]);
+			i += c < 0x80 ? 1 : path::decode_utf8(in, i, c);
+
+			if (length + (c >= 0x10000 ? 2 : 1) >= size)
+			{
+				return 0;
+			}
+
+			if (c >= 0x10000)
+			{
+				out[length++] = static_cast<char16_t>(0xD800 + ((c - 0x10000) >> 10));
+				out[length++] = static_cast<char16_t>(0xDC00 + ((c - 0x10000) & 0x3FF));
+			}
+			else
+			{
+				out[length++] = static_cast<char16_t>(c);
+			}
+		}
+
+		out[length] = u'\0';
+		return length;
+	}
+
+	//Length of the leading run of ASCII bytes
+	static std::size_t ascii_prefix(std::string_view in)
+	{
+		std::size_t i = 0;
+
+#ifdef PATH_X86
+		for (; i + 16 <= in.size(); i += 16)
+		{
+			const int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in.data() + i)));
+
+			if (mask)
+			{
+				return i + path::lowest_bit(mask);
+			}
+		}
+#endif
+
+		for (; i < in.size(); i++)
+		{
+			if (static_cast<std::uint8_t>(in[i]) >= 0x80)
+			{
+				return i;
+			}
+		}
+
+		return in.size();
+	}
+
+	//In place ASCII case conversion
+	static void lower(char* data, std::size_t size)
+	{
+		path::convert(data, size, 'A', 'Z');
+	}
+
+	static void upper(char* data, std::size_t size)
+	{
+		path::convert(data, size, 'a', 'z');
+	}
+
+	//In place single character replacement, e.g. separator normalization
+	static void replace(char* data, std::size_t size, char from, char to)
+	{
+		std::size_t i = 0;
+
+#ifdef PATH_X86
+		const __m128i match = _mm_set1_epi8(from);
+		const __m128i flip = _mm_set1_epi8(static_cast<char>(from ^ to));
+
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(v, match), flip));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), v);
+		}
+#endif
+
+		for (; i < size; i++)
+		{
+			if (data[i] == from)
+			{
+				data[i] = to;
+			}
+		}
+	}
+
+	//Removes prefix from the front of path if it is there, both sides are expected to be folded already
+	static bool strip_prefix(std::string_view& path, std::string_view prefix)
+	{
+		if (path.size() < prefix.size() || std::memcmp(path.data(), prefix.data(), prefix.size()))
+		{
+			return false;
+		}
+
+		path.remove_prefix(prefix.size());
+		return true;
+	}
+
+	static bool ends_with(std::string_view value, std::string_view ending)
+	{
+		return value.size() >= ending.size() && !std::memcmp(value.data() + value.size() - ending.size(), ending.data(), ending.size());
+	}
+
+	//DOS style wildcard match on folded UTF-8, '*' spans any run and '?' a single code point
+	//"*.*" also matches names without a dot, same as FindFirstFile
+	static bool match(std::string_view pattern, std::string_view name)
+	{
+		if (pattern == "*.*")
+		{
+			pattern = "*";
+		}
+
+		constexpr std::size_t none = ~std::size_t(0);
+		std::size_t p = 0, n = 0, star = none, mark = 0;
+
+		while (n < name.size())
+		{
+			if (p < pattern.size() && pattern[p] == '*')
+			{
+				star = ++p;
+				mark = n;
+			}
+			else if (p < pattern.size() && pattern[p] == '?')
+			{
+				p++;
+				n = path::next_char(name, n);
+			}
+			else if (p < pattern.size() && pattern[p] == name[n])
+			{
+				p++;
+				n++;
+			}
+			else if (star != none)
+			{
+				//Let the last star swallow one more character and retry from there
+				p = star;
+				n = mark = path::next_char(name, mark);
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		while (p < pattern.size() && pattern[p] == '*')
+		{
+			p++;
+		}
+
+		return p == pattern.size();
+	}
+
+	//Consumes eight bytes per step, never returns 0 so callers can use 0 as an empty marker
+	static std::uint64_t hash(std::string_view key)
+	{
+		const auto* data = reinterpret_cast<const std::uint8_t*>(key.data());
+		std::size_t size = key.size();
+
+		std::uint64_t hash = 0x9E3779B97F4A7C15ull ^ (size * 0xC2B2AE3D27D4EB4Full);
+
+		for (; size >= 8; size -= 8, data += 8)
+		{
+			std::uint64_t chunk;
+			std::memcpy(&chunk, data, 8);
+			hash = path::step(hash, chunk);
+		}
+
+		if (size)
+		{
+			std::uint64_t chunk = 0;
+			std::memcpy(&chunk, data, size);
+			hash = path::step(hash, chunk);
+		}
+
+		hash ^= hash >> 32;
+		hash *= 0xD6E8FEB86659FD93ull;
+		hash ^= hash >> 32;
+
+		return hash ? hash : 1;
+	}
+
+	static void fold_scalar(const char* in, char* out, std::size_t size)
+	{
+		for (std::size_t i = 0; i < size; i++)
+		{
+			out[i] = path::fold_char(in[i]);
+		}
+	}
+
+#ifdef PATH_X86
+	static void fold_sse2(const char* in, char* out, std::size_t size)
+	{
+		const __m128i below = _mm_set1_epi8('A' - 1);
+		const __m128i above = _mm_set1_epi8('Z' + 1);
+		const __m128i bit = _mm_set1_epi8(0x20);
+		const __m128i slash = _mm_set1_epi8('/');
+		const __m128i flip = _mm_set1_epi8('/' ^ '\\');
+
+		std::size_t i = 0;
+
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+			//Bytes of multibyte sequences are negative as signed chars so they never match the letter range
+			const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+			v = _mm_or_si128(v, _mm_and_si128(letters, bit));
+			v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(v, slash), flip));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+		}
+
+		path::fold_scalar(in + i, out + i, size - i);
+	}
+
+	static PATH_AVX2 void fold_avx2(const char* in, char* out, std::size_t size)
+	{
+		const __m256i below = _mm256_set1_epi8('A' - 1);
+		const __m256i above = _mm256_set1_epi8('Z' + 1);
+		const __m256i bit = _mm256_set1_epi8(0x20);
+		const __m256i slash = _mm256_set1_epi8('/');
+		const __m256i flip = _mm256_set1_epi8('/' ^ '\\');
+
+		std::size_t i = 0;
+
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+
+			const __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v));
+			v = _mm256_or_si256(v, _mm256_and_si256(letters, bit));
+			v = _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpeq_epi8(v, slash), flip));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+		}
+
+		path::fold_sse2(in + i, out + i, size - i);
+	}
+
+	static bool has_avx2()
+	{
+		static const bool supported = path::detect_avx2();
+		return supported;
+	}
+#endif
+
+private:
+	static void fold_ascii(const char* in, char* out, std::size_t size)
+	{
+#ifdef PATH_X86
+		//Typical paths are only a few vectors long, the ymm setup only pays off on long ones
+		if (size >= 128 && path::has_avx2())
+		{
+			path::fold_avx2(in, out, size);
+		}
+		else
+		{
+			path::fold_sse2(in, out, size);
+		}
+#else
+		path::fold_scalar(in, out, size);
+#endif
+	}
+
+	//Decodes one sequence starting at in[i], a malformed one consumes a single byte
+	static std::size_t decode_utf8(std::string_view in, std::size_t i, std::uint32_t& c)
+	{
+		const std::uint8_t lead = static_cast<std::uint8_t>(in[i]);
+		std::size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+
+		if (!length || i + length > in.size())
+		{
+			c = lead;
+			return 1;
+		}
+
+		std::uint32_t value = lead & (0x7F >> length);
+
+		for (std::size_t k = 1; k < length; k++)
+		{
+			const std::uint8_t next = static_cast<std::uint8_t>(in[i + k]);
+
+			if ((next & 0xC0) != 0x80)
+			{
+				c = lead;
+				return 1;
+			}
+
+			value = (value << 6) | (next & 0x3F);
+		}
+
+		c = value;
+		return length;
+	}
+
+	//Appends c at out[length], returns the new length or 0 when it does not fit with a terminator
+	static std::size_t encode_utf8(std::uint32_t c, char* out, std::size_t length, std::size_t size)
+	{
+		char bytes[4];
+		std::size_t count = 0;
+
+		if (c < 0x80)
+		{
+			bytes[count++] = static_cast<char>(c);
+		}
+		else if (c < 0x800)
+		{
+			bytes[count++] = static_cast<char>(0xC0 | (c >> 6));
+			bytes[count++] = static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			bytes[count++] = static_cast<char>(0xE0 | (c >> 12));
+			bytes[count++] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			bytes[count++] = static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			bytes[count++] = static_cast<char>(0xF0 | (c >> 18));
+			bytes[count++] = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			bytes[count++] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			bytes[count++] = static_cast<char>(0x80 | (c & 0x3F));
+		}
+
+		if (length + count >= size)
+		{
+			return 0;
+		}
+
+		std::memcpy(out + length, bytes, count);
+		return length + count;
+	}
+
+	//Index of the code point after the one at i
+	static std::size_t next_char(std::string_view in, std::size_t i)
+	{
+		for (i++; i < in.size() && (static_cast<std::uint8_t>(in[i]) & 0xC0) == 0x80; i++);
+		return i;
+	}
+
+	static std::size_t lowest_bit(unsigned int mask)
+	{
+		std::size_t bit = 0;
+
+		while (!(mask & 1))
+		{
+			mask >>= 1;
+			bit++;
+		}
+
+		return bit;
+	}
+
+	static char fold_char(char c)
+	{
+		if (c >= 'A' && c <= 'Z')
+		{
+			return c + ('a' - 'A');
+		}
+
+		return c == '/' ? '\\' : c;
+	}
+
+	//The shift carries the high bits the multiply produced back down so chunks that only differ at the end still spread
+	static std::uint64_t step(std::uint64_t hash, std::uint64_t chunk)
+	{
+		hash = (hash ^ chunk) * 0x9FB21C651E98DF25ull;
+		return hash ^ (hash >> 32);
+	}
+
+	static void convert(char* data, std::size_t size, char first, char last)
+	{
+		std::size_t i = 0;
+
+#ifdef PATH_X86
+		const __m128i below = _mm_set1_epi8(first - 1);
+		const __m128i above = _mm_set1_epi8(last + 1);
+		const __m128i bit = _mm_set1_epi8(0x20);
+
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+			v = _mm_xor_si128(v, _mm_and_si128(letters, bit));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), v);
+		}
+#endif
+
+		for (; i < size; i++)
+		{
+			if (data[i] >= first && data[i] <= last)
+			{
+				data[i] ^= 0x20;
+			}
+		}
+	}
+
+#ifdef PATH_X86
+	static bool detect_avx2()
+	{
+		unsigned int regs[4]{};
+
+#ifdef _MSC_VER
+		__cpuid(reinterpret_cast<int*>(regs), 1);
+#else
+		__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+		//The OS has to save the ymm registers too
+		const bool osxsave = (regs[2] & (1 << 27)) != 0;
+		if (!osxsave || (path::xgetbv() & 6) != 6)
+		{
+			return false;
+		}
+
+#ifdef _MSC_VER
+		__cpuidex(reinterpret_cast<int*>(regs), 7, 0);
+#else
+		__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+		return (regs[1] & (1 << 5)) != 0;
+	}
+
+	static std::uint64_t xgetbv()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#endif
+	}
+#endif
+};
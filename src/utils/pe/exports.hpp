@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "pe.hpp"
+
+//Export table of a module that is already mapped in memory, parsed once so every lookup after that is a hash probe
+//GetProcAddress binary searches the name table on every call, an exe with thousands of imports pays that thousands of times
+//The hash table is a flat open addressed array of name indices so parsing costs one hash per name and no allocation per entry
+class exports
+{
+public:
+	struct export_t
+	{
+		std::uint32_t rva;
+		const char* forward; //"dll.name" or "dll.#ordinal" when the export lives in another module, nullptr otherwise
+	};
+
+	//Headers are always mapped in the first page, the real size comes from them
+	exports(const std::uint8_t* base) : base(base)
+	{
+		const pe headers(base, 0x1000);
+
+		if (!headers.valid())
+		{
+			return;
+		}
+
+		this->image_size = headers.size_of_image();
+		this->directory = headers.directory(pe::directory_export);
+
+		if (!this->directory.rva || !this->inside(this->directory.rva, 40))
+		{
+			return;
+		}
+
+		std::uint32_t function_count, name_count, functions, names, ordinals;
+		std::memcpy(&this->ordinal_base, base + this->directory.rva + 16, 4);
+		std::memcpy(&function_count, base + this->directory.rva + 20, 4);
+		std::memcpy(&name_count, base + this->directory.rva + 24, 4);
+		std::memcpy(&functions, base + this->directory.rva + 28, 4);
+		std::memcpy(&names, base + this->directory.rva + 32, 4);
+		std::memcpy(&ordinals, base + this->directory.rva + 36, 4);
+
+		if (!this->inside(functions, function_count * 4ull) || !this->inside(names, name_count * 4ull) || !this->inside(ordinals, name_count * 2ull))
+		{
+			return;
+		}
+
+		this->functions = reinterpret_cast<const std::uint32_t*>(base + functions);
+		this->function_count = function_count;
+		this->name_table = reinterpret_cast<const std::uint32_t*>(base + names);
+		this->ordinal_table = reinterpret_cast<const std::uint16_t*>(base + ordinals);
+
+		std::uint32_t capacity = 16;
+		while (capacity < name_count * 2)
+		{
+			capacity <<= 1;
+		}
+
+		this->slots.assign(capacity, 0);
+		this->mask = capacity - 1;
+
+		for (std::uint32_t i = 0; i < name_count; i++)
+		{
+			const auto name = this->name_table[i];
+
+			if (name >= this->image_size || this->ordinal_table[i] >= function_count)
+			{
+				continue;
+			}
+
+			const char* text = reinterpret_cast<const char*>(base + name);
+			const auto hash = exports::hash(std::string_view(text, strnlen(text, this->image_size - name)));
+
+			auto slot = hash & this->mask;
+			while (this->slots[slot])
+			{
+				slot = (slot + 1) & this->mask;
+			}
+
+			this->slots[slot] = (std::uint64_t(hash) << 32) | (i + 1);
+			this->count++;
+		}
+	}
+
+	bool find(std::string_view name, export_t& out) const
+	{
+		if (this->slots.empty())
+		{
+			return false;
+		}
+
+		const auto hash = exports::hash(name);
+
+		for (auto slot = hash & this->mask; this->slots[slot]; slot = (slot + 1) & this->mask)
+		{
+			if (static_cast<std::uint32_t>(this->slots[slot] >> 32) != hash)
+			{
+				continue;
+			}
+
+			const auto index = static_cast<std::uint32_t>(this->slots[slot]) - 1;
+			const auto text = this->name_table[index];
+
+			if (name.size() < this->image_size - text && !std::memcmp(this->base + text, name.data(), name.size()) && !this->base[text + name.size()])
+			{
+				return this->at(this->ordinal_table[index], out);
+			}
+		}
+
+		return false;
+	}
+
+	bool find(std::uint16_t ordinal, export_t& out) const
+	{
+		return ordinal >= this->ordinal_base && this->at(ordinal - this->ordinal_base, out);
+	}
+
+	std::size_t size() const
+	{
+		return this->count;
+	}
+
+private:
+	const std::uint8_t* base;
+	std::uint32_t image_size = 0;
+	pe::data_directory_t directory{ 0, 0 };
+	std::uint32_t ordinal_base = 0;
+	const std::uint32_t* functions = nullptr;
+	std::uint32_t function_count = 0;
+	const std::uint32_t* name_table = nullptr;
+	const std::uint16_t* ordinal_table = nullptr;
+	std::vector<std::uint64_t> slots; //Hash in the high half, name index + 1 in the low half, zero is empty
+	std::uint32_t mask = 0;
+	std::uint32_t count = 0;
+
+	//FNV-1a, export names are short and this only runs once per name at parse time
+	static std::uint32_t hash(std::string_view name)
+	{
+		std::uint32_t hash = 0x811C9DC5;
+
+		for (auto c : name)
+		{
+			hash = (hash ^ static_cast<std::uint8_t>(c)) * 0x01000193;
+		}
+
+		return hash;
+	}
+
+	bool inside(std::uint32_t rva, std::uint64_t size) const
+	{
+		return rva <= this->image_size && size <= this->image_size - rva;
+	}
+
+	bool at(std::uint32_t index, export_t& out) const
+	{
+		if (index >= this->function_count || !this->functions[index])
+		{
+			return false;
+		}
+
+		out.rva = this->functions[index];
+
+		//An RVA pointing back into the export directory is the text of a forwarder, not code
+		const bool forwarded = out.rva >= this->directory.rva && out.rva < this->directory.rva + this->directory.size;
+		out.forward = forwarded ? reinterpret_cast<const char*>(this->base + out.rva) : nullptr;
+		return true;
+	}
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pe.hpp"
+
+//Lays a DLL out in memory the way the system loader would, minus everything that needs the OS
+//Sections are copied, base relocations applied for the address the image actually landed at and every import slot filled from a resolver
+//Nothing here touches shared state so images can be mapped on several threads at once, only the resolver has to be thread safe
+class mapper
+{
+public:
+	//Address of the export or 0, name is nullptr for an import by ordinal
+	typedef std::function<std::uint64_t(const char* module, const char* name, std::uint16_t ordinal)> resolver_t;
+
+	//target is SizeOfImage writable bytes that will be executed at address
+	static bool map(const pe& image, std::uint8_t* target, std::uint64_t address, const resolver_t& resolve, std::string& error)
+	{
+		const auto headers = std::min<std::size_t>({ image.size_of_headers(), image.size_of_image(), image.size() });
+		std::memcpy(target, image.bytes(), headers);
+		image.copy(target, 1);
+
+		if (!mapper::relocate(image, target, address))
+		{
+			error = "cannot be relocated";
+			return false;
+		}
+
+		return mapper::bind(image, target, resolve, error);
+	}
+
+	static bool relocate(const pe& image, std::uint8_t* target, std::uint64_t address)
+	{
+		const auto delta = address - image.image_base();
+		const auto directory = image.directory(pe::directory_basereloc);
+
+		if (!delta)
+		{
+			return true;
+		}
+
+		if (!directory.rva || !mapper::inside(image, directory.rva, directory.size))
+		{
+			return false;
+		}
+
+		for (std::uint32_t offset = 0; offset + 8 <= directory.size;)
+		{
+			std::uint32_t page, size;
+			std::memcpy(&page, target + directory.rva + offset, 4);
+			std::memcpy(&size, target + directory.rva + offset + 4, 4);
+
+			if (size < 8 || size > directory.size - offset)
+			{
+				return false;
+			}
+
+			for (std::uint32_t i = 8; i + 2 <= size; i += 2)
+			{
+				std::uint16_t entry;
+				std::memcpy(&entry, target + directory.rva + offset + i, 2);
+
+				const std::uint32_t rva = page + (entry & 0xFFF);
+
+				switch (entry >> 12)
+				{
+				case relocation_absolute:
+					break;
+				case relocation_highlow:
+					if (!mapper::add<std::uint32_t>(image, target, rva, delta))
+					{
+						return false;
+					}
+					break;
+				case relocation_dir64:
+					if (!mapper::add<std::uint64_t>(image, target, rva, delta))
+					{
+						return false;
+					}
+					break;
+				default:
+					return false;
+				}
+			}
+
+			offset += size;
+		}
+
+		return true;
+	}
+
+	static bool bind(const pe& image, std::uint8_t* target, const resolver_t& resolve, std::string& error)
+	{
+		return image.machine() == pe::machine_amd64 ? mapper::bind<std::uint64_t>(image, target, resolve, error) : mapper::bind<std::uint32_t>(image, target, resolve, error);
+	}
+
+	//Runs fn(i) for every i below count on up to threads threads, each one pulling the next index from a shared counter
+	template <typename T> static void parallel(std::size_t count, unsigned threads, T&& fn)
+	{
+		std::atomic<std::size_t> next{ 0 };
+		const auto worker = [&]()
+		{
+			for (std::size_t i = next++; i < count; i = next++)
+			{
+				fn(i);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		const auto extra = std::min<std::size_t>(std::max(threads, 1u), std::max<std::size_t>(count, 1)) - 1;
+
+		for (std::size_t i = 0; i < extra; i++)
+		{
+			workers.emplace_back(worker);
+		}
+
+		worker();
+
+		for (auto& thread : workers)
+		{
+			thread.join();
+		}
+	}
+
+private:
+	static constexpr std::uint16_t relocation_absolute = 0;
+	static constexpr std::uint16_t relocation_highlow = 3;
+	static constexpr std::uint16_t relocation_dir64 = 10;
+
+	static bool inside(const pe& image, std::uint64_t rva, std::uint64_t size)
+	{
+		return rva <= image.size_of_image() && size <= image.size_of_image() - rva;
+	}
+
+	template <typename T> static bool add(const pe& image, std::uint8_t* target, std::uint32_t rva, std::uint64_t delta)
+	{
+		if (!mapper::inside(image, rva, sizeof(T)))
+		{
+			return false;
+		}
+
+		T value;
+		std::memcpy(&value, target + rva, sizeof(T));
+		value = static_cast<T>(value + delta);
+		std::memcpy(target + rva, &value, sizeof(T));
+		return true;
+	}
+
+	//Reads strings out of the mapped image, never past its end
+	static const char* text(const pe& image, const std::uint8_t* target, std::uint32_t rva)
+	{
+		if (rva >= image.size_of_image() || !std::memchr(target + rva, 0, image.size_of_image() - rva))
+		{
+			return nullptr;
+		}
+
+		return reinterpret_cast<const char*>(target + rva);
+	}
+
+	template <typename T> static bool bind(const pe& image, std::uint8_t* target, const resolver_t& resolve, std::string& error)
+	{
+		constexpr T by_ordinal = T(1) << (sizeof(T) * 8 - 1);
+		const auto directory = image.directory(pe::directory_import);
+
+		if (!directory.rva)
+		{
+			return true;
+		}
+
+		for (std::uint32_t descriptor = directory.rva; mapper::inside(image, descriptor, 20); descriptor += 20)
+		{
+			std::uint32_t lookup, name, first;
+			std::memcpy(&lookup, target + descriptor, 4);
+			std::memcpy(&name, target + descriptor + 12, 4);
+			std::memcpy(&first, target + descriptor + 16, 4);
+
+			if (!name)
+			{
+				return true;
+			}
+
+			const char* module = mapper::text(image, target, name);
+			lookup = lookup ? lookup : first;
+
+			if (!module)
+			{
+				error = "bad import descriptor";
+				return false;
+			}
+
+			for (std::uint32_t i = 0;; i++)
+			{
+				T thunk;
+
+				if (!mapper::inside(image, lookup + std::uint64_t(i) * sizeof(T), sizeof(T)) || !mapper::inside(image, first + std::uint64_t(i) * sizeof(T), sizeof(T)))
+				{
+					error = std::string("bad import table for ") + module;
+					return false;
+				}
+
+				std::memcpy(&thunk, target + lookup + i * sizeof(T), sizeof(T));
+
+				if (!thunk)
+				{
+					break;
+				}
+
+				const char* function = (thunk & by_ordinal) ? nullptr : mapper::text(image, target, static_cast<std::uint32_t>(thunk) + 2);
+				const auto ordinal = static_cast<std::uint16_t>(thunk);
+
+				if (!(thunk & by_ordinal) && !function)
+				{
+					error = std::string("bad import name in ") + module;
+					return false;
+				}
+
+				const T address = static_cast<T>(resolve(module, function, ordinal));
+
+				if (!address)
+				{
+					error = std::string("unresolved import ") + module + "!" + (function ? function : std::to_string(ordinal));
+					return false;
+				}
+
+				std::memcpy(target + first + i * sizeof(T), &address, sizeof(T));
+			}
+		}
+
+		return true;
+	}
+};
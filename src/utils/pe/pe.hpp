@@ -0,0 +1,343 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//Read only view over the raw bytes of a PE file, nothing is copied and no Windows headers are needed so the bench can use it too
+//Every offset is checked against the span, a truncated file reads as invalid instead of faulting
+class pe
+{
+public:
+	static constexpr std::uint16_t machine_i386 = 0x014C;
+	static constexpr std::uint16_t machine_amd64 = 0x8664;
+
+	//IMAGE_DLLCHARACTERISTICS_NO_SEH, the image has no structured exception handlers at all
+	static constexpr std::uint16_t dll_no_seh = 0x0400;
+
+	enum directory_t : std::uint32_t
+	{
+		directory_export = 0,
+		directory_import = 1,
+		directory_basereloc = 5,
+		directory_tls = 9,
+		directory_load_config = 10,
+		directory_iat = 12,
+	};
+
+	struct data_directory_t
+	{
+		std::uint32_t rva;
+		std::uint32_t size;
+	};
+
+	//Same layout as IMAGE_SECTION_HEADER
+	struct section_t
+	{
+		char name[8];
+		std::uint32_t virtual_size;
+		std::uint32_t virtual_address;
+		std::uint32_t raw_size;
+		std::uint32_t raw_offset;
+		std::uint32_t relocations;
+		std::uint32_t line_numbers;
+		std::uint16_t relocation_count;
+		std::uint16_t line_number_count;
+		std::uint32_t characteristics;
+
+		bool named(const char* other) const
+		{
+			return !std::strncmp(this->name, other, sizeof(this->name));
+		}
+
+		//What the loader copies, the raw data clipped to the section size
+		std::uint32_t copy_size() const
+		{
+			return std::min(this->raw_size, this->virtual_size);
+		}
+	};
+
+	pe(const std::uint8_t* data, std::size_t size) : data(data), length(size)
+	{
+		std::uint32_t lfanew = 0;
+
+		if (!this->read(0, this->dos_magic) || this->dos_magic != 0x5A4D || !this->read(0x3C, lfanew))
+		{
+			return;
+		}
+
+		std::uint32_t signature = 0;
+		if (!this->read(lfanew, signature) || signature != 0x4550)
+		{
+			return;
+		}
+
+		//File header
+		const std::size_t file = lfanew + 4;
+		std::uint16_t section_count = 0, optional_size = 0;
+
+		if (!this->read(file, this->machine_type) || !this->read(file + 2, section_count) || !this->read(file + 4, this->stamp) || !this->read(file + 16, optional_size))
+		{
+			return;
+		}
+
+		//Optional header, PE32 and PE32+ only differ in where the fields after the entry point sit
+		const std::size_t optional = file + 20;
+		std::uint16_t optional_magic = 0;
+
+		if (!this->read(optional, optional_magic) || !this->read(optional + 16, this->entry))
+		{
+			return;
+		}
+
+		const bool plus = optional_magic == 0x20B;
+		std::uint32_t directory_count = 0;
+
+		if (plus)
+		{
+			if (!this->read(optional + 24, this->base))
+			{
+				return;
+			}
+		}
+		else
+		{
+			std::uint32_t base32 = 0;
+			if (!this->read(optional + 28, base32))
+			{
+				return;
+			}
+			this->base = base32;
+		}
+
+		if (!this->read(optional + 56, this->image_size) || !this->read(optional + 60, this->headers_size) || !this->read(optional + 64, this->sum) || !this->read(optional + 70, this->dll_flags) || !this->read(optional + (plus ? 108 : 92), directory_count))
+		{
+			return;
+		}
+
+		this->directories.resize(std::min<std::uint32_t>(directory_count, 16));
+		for (std::uint32_t i = 0; i < this->directories.size(); i++)
+		{
+			if (!this->read(optional + (plus ? 112 : 96) + i * 8, this->directories[i]))
+			{
+				return;
+			}
+		}
+
+		this->section_table = optional + optional_size;
+		this->sections.resize(section_count);
+
+		for (std::uint16_t i = 0; i < section_count; i++)
+		{
+			if (!this->read(this->section_table + i * sizeof(section_t), this->sections[i]))
+			{
+				return;
+			}
+		}
+
+		this->good = true;
+	}
+
+	bool valid() const
+	{
+		return this->good;
+	}
+
+	std::uint16_t machine() const
+	{
+		return this->machine_type;
+	}
+
+	std::uint64_t image_base() const
+	{
+		return this->base;
+	}
+
+	std::uint32_t entry_point() const
+	{
+		return this->entry;
+	}
+
+	std::uint32_t size_of_image() const
+	{
+		return this->image_size;
+	}
+
+	std::uint32_t size_of_headers() const
+	{
+		return this->headers_size;
+	}
+
+	//Link time and checksum, together with the image size they tell builds of the same module apart
+	std::uint32_t time_stamp() const
+	{
+		return this->stamp;
+	}
+
+	std::uint32_t checksum() const
+	{
+		return this->sum;
+	}
+
+	std::uint16_t dll_characteristics() const
+	{
+		return this->dll_flags;
+	}
+
+	//Entries in the SafeSEH table of a PE32 load config, -1 when the image has none and its handlers are unknown
+	std::int64_t safe_handlers() const
+	{
+		const auto config = this->directory(directory_load_config);
+		const auto offset = this->file_offset(config.rva);
+		std::uint32_t size = 0, table = 0, count = 0;
+
+		//Size, then SEHandlerTable and SEHandlerCount at 0x40 and 0x44 of IMAGE_LOAD_CONFIG_DIRECTORY32
+		if (this->machine_type != pe::machine_i386 || !config.rva || !offset || !this->read(offset, size) || size < 0x48 ||
+			!this->read(offset + 0x40, table) || !this->read(offset + 0x44, count) || !table)
+		{
+			return -1;
+		}
+
+		return count;
+	}
+
+	//Offset of the section table from the start of the file
+	std::size_t section_offset() const
+	{
+		return this->section_table;
+	}
+
+	data_directory_t directory(directory_t index) const
+	{
+		return index < this->directories.size() ? this->directories[index] : data_directory_t{ 0, 0 };
+	}
+
+	const std::vector<section_t>& section_list() const
+	{
+		return this->sections;
+	}
+
+	const std::uint8_t* bytes() const
+	{
+		return this->data;
+	}
+
+	std::size_t size() const
+	{
+		return this->length;
+	}
+
+	//Copies the raw data of every section to its virtual address below target
+	//Big images are cut into chunks that worker threads pull from a shared counter, small ones stay on the calling thread
+	//Returns how many bytes were copied
+	std::size_t copy(std::uint8_t* target, unsigned threads = std::thread::hardware_concurrency()) const
+	{
+		struct chunk_t
+		{
+			std::size_t from;
+			std::uint32_t to;
+			std::uint32_t size;
+		};
+
+		std::vector<chunk_t> chunks;
+		std::size_t total = 0;
+
+		for (const auto& section : this->sections)
+		{
+			if (section.raw_offset >= this->length || section.virtual_address >= this->image_size)
+			{
+				continue;
+			}
+
+			//Clipped to the file and to the image so a bad header cannot write past either
+			const std::uint32_t size = static_cast<std::uint32_t>(std::min<std::size_t>({ section.copy_size(), this->length - section.raw_offset, this->image_size - section.virtual_address }));
+
+			for (std::uint32_t offset = 0; offset < size; offset += pe::chunk_size)
+			{
+				chunks.push_back({ section.raw_offset + offset, section.virtual_address + offset, std::min(pe::chunk_size, size - offset) });
+			}
+
+			total += size;
+		}
+
+		std::atomic<std::size_t> next{ 0 };
+		const auto worker = [&]()
+		{
+			for (std::size_t i = next++; i < chunks.size(); i = next++)
+			{
+				std::memcpy(target + chunks[i].to, this->data + chunks[i].from, chunks[i].size);
+			}
+		};
+
+		unsigned count = 0;
+		if (total >= pe::parallel_threshold)
+		{
+			count = std::min<unsigned>(std::max(threads, 1u), static_cast<unsigned>(chunks.size())) - 1;
+		}
+
+		std::vector<std::thread> workers;
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			workers.emplace_back(worker);
+		}
+
+		worker();
+
+		for (auto& thread : workers)
+		{
+			thread.join();
+		}
+
+		return total;
+	}
+
+	static constexpr std::uint32_t chunk_size = 4 * 1024 * 1024;
+	static constexpr std::size_t parallel_threshold = 16 * 1024 * 1024;
+
+private:
+	const std::uint8_t* data;
+	std::size_t length;
+	bool good = false;
+
+	std::uint16_t dos_magic = 0;
+	std::uint16_t machine_type = 0;
+	std::uint32_t entry = 0;
+	std::uint64_t base = 0;
+	std::uint32_t image_size = 0;
+	std::uint32_t headers_size = 0;
+	std::uint32_t stamp = 0;
+	std::uint32_t sum = 0;
+	std::uint16_t dll_flags = 0;
+	std::size_t section_table = 0;
+	std::vector<data_directory_t> directories;
+	std::vector<section_t> sections;
+
+	//Where an rva lies in the file, 0 when no section holds it
+	std::size_t file_offset(std::uint32_t rva) const
+	{
+		for (const auto& section : this->sections)
+		{
+			if (rva >= section.virtual_address && rva - section.virtual_address < section.raw_size)
+			{
+				return section.raw_offset + (rva - section.virtual_address);
+			}
+		}
+
+		return 0;
+	}
+
+	template <typename T> bool read(std::size_t offset, T& out) const
+	{
+		if (offset > this->length || this->length - offset < sizeof(T))
+		{
+			return false;
+		}
+
+		std::memcpy(&out, this->data + offset, sizeof(T));
+		return true;
+	}
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+
+#include "pe.hpp"
+#include "path/path.hpp"
+
+//Laid out copy of an exe plus the module and export every import thunk was bound to
+//The loader writes one after a normal load, a repeat launch of the same exe only commits the ranges, copies them and binds addresses
+//Entries are keyed by the exe itself and refused as soon as any module they were bound against is a different build
+class prelink
+{
+public:
+	static constexpr std::uint32_t magic = 0x4C504D4D; //MMPL
+	static constexpr std::uint32_t version = 1;
+
+	struct header_t
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t key;
+		std::uint32_t size;
+		std::uint32_t image_base, image_size;
+		std::uint32_t range_count, ranges;
+		std::uint32_t module_count, modules;
+		std::uint32_t binding_count, bindings;
+		std::uint32_t pool;
+	};
+
+	//Part of the image, commit bytes are committed at rva and the first data bytes come from offset in the cache file
+	struct range_t
+	{
+		std::uint32_t rva;
+		std::uint32_t commit;
+		std::uint32_t data;
+		std::uint32_t offset;
+	};
+
+	//What a bound module looked like, any field changing means it is a different build
+	struct module_t
+	{
+		std::uint32_t name; //Full path, loaded by that path again on a hit
+		std::uint32_t time_stamp;
+		std::uint32_t size_of_image;
+		std::uint32_t checksum;
+	};
+
+	//One import address table slot and where its function lives, relative to the module so ASLR does not matter
+	struct binding_t
+	{
+		std::uint32_t iat;
+		std::uint32_t module;
+		std::uint32_t rva;
+	};
+
+	//An edited or replaced exe changes its size, write time or headers, so it never picks up a stale image
+	static std::uint64_t key(const std::uint8_t* headers, std::size_t length, std::uint64_t size, std::uint64_t time)
+	{
+		std::uint64_t retn = path::hash(std::string_view(reinterpret_cast<const char*>(headers), length));
+		retn ^= path::hash(std::string_view(reinterpret_cast<const char*>(&size), sizeof(size))) * 3;
+		retn ^= path::hash(std::string_view(reinterpret_cast<const char*>(&time), sizeof(time))) * 5;
+		return retn ^ prelink::version;
+	}
+
+	//Identity of a module that is mapped in memory
+	static module_t identity(const std::uint8_t* base)
+	{
+		const pe headers(base, 0x1000);
+		return { 0, headers.time_stamp(), headers.size_of_image(), headers.checksum() };
+	}
+
+	class builder
+	{
+	public:
+		std::uint32_t module(const std::string& name, const module_t& identity)
+		{
+			for (std::uint32_t i = 0; i < this->modules.size(); i++)
+			{
+				if (this->names[i] == name)
+				{
+					return i;
+				}
+			}
+
+			this->names.emplace_back(name);
+			this->modules.emplace_back(identity);
+			return static_cast<std::uint32_t>(this->modules.size() - 1);
+		}
+
+		void bind(std::uint32_t iat, std::uint32_t module, std::uint32_t rva)
+		{
+			this->bindings.push_back({ iat, module, rva });
+		}
+
+		//Image data is taken from the exe file as is, import thunks in it are still unbound
+		std::vector<char> finish(std::uint64_t key, const pe& image) const
+		{
+			std::vector<range_t> ranges;
+			std::vector<std::size_t> sources;
+
+			ranges.push_back({ 0, image.size_of_headers(), static_cast<std::uint32_t>(std::min<std::size_t>({ image.size_of_headers(), image.size_of_image(), image.size() })), 0 });
+			sources.emplace_back(0);
+
+			for (const auto& section : image.section_list())
+			{
+				if (section.virtual_address >= image.size_of_image())
+				{
+					continue;
+				}
+
+				const std::uint32_t room = image.size_of_image() - section.virtual_address;
+				const std::uint32_t data = section.raw_offset < image.size() ? static_cast<std::uint32_t>(std::min<std::size_t>({ section.copy_size(), image.size() - section.raw_offset, room })) : 0;
+
+				ranges.push_back({ section.virtual_address, std::min(std::max({ section.virtual_size, section.raw_size, data }), room), data, 0 });
+				sources.emplace_back(section.raw_offset);
+			}
+
+			header_t header{};
+			header.magic = prelink::magic;
+			header.version = prelink::version;
+			header.key = key;
+			header.image_base = static_cast<std::uint32_t>(image.image_base());
+			header.image_size = image.size_of_image();
+			header.range_count = static_cast<std::uint32_t>(ranges.size());
+			header.module_count = static_cast<std::uint32_t>(this->modules.size());
+			header.binding_count = static_cast<std::uint32_t>(this->bindings.size());
+
+			std::uint32_t offset = sizeof(header_t);
+			header.ranges = offset;
+			offset += header.range_count * sizeof(range_t);
+			header.modules = offset;
+			offset += header.module_count * sizeof(module_t);
+			header.bindings = offset;
+			offset += header.binding_count * sizeof(binding_t);
+			header.pool = offset;
+
+			std::string pool;
+			auto modules = this->modules;
+
+			for (std::size_t i = 0; i < modules.size(); i++)
+			{
+				modules[i].name = static_cast<std::uint32_t>(pool.size());
+				pool.append(this->names[i]);
+				pool.push_back('\0');
+			}
+
+			//Image data starts page aligned so a hit copies whole pages out of the mapped cache file
+			offset = (offset + static_cast<std::uint32_t>(pool.size()) + 0xFFF) & ~0xFFFu;
+
+			for (auto& range : ranges)
+			{
+				range.offset = offset;
+				offset += (range.data + 0xF) & ~0xFu;
+			}
+
+			header.size = offset;
+
+			std::vector<char> out(header.size);
+			std::memcpy(&out[0], &header, sizeof(header));
+			std::memcpy(&out[header.ranges], ranges.data(), ranges.size() * sizeof(range_t));
+			std::memcpy(&out[header.modules], modules.data(), modules.size() * sizeof(module_t));
+			std::memcpy(&out[header.bindings], this->bindings.data(), this->bindings.size() * sizeof(binding_t));
+			std::memcpy(&out[header.pool], pool.data(), pool.size());
+
+			for (std::size_t i = 0; i < ranges.size(); i++)
+			{
+				std::memcpy(&out[ranges[i].offset], image.bytes() + sources[i], ranges[i].data);
+			}
+
+			return out;
+		}
+
+	private:
+		std::vector<std::string> names;
+		std::vector<module_t> modules;
+		std::vector<binding_t> bindings;
+	};
+
+	//Header of a cache file if it is complete, for this key and every table in it is inside the file
+	static const header_t* open(const char* data, std::size_t size, std::uint64_t key)
+	{
+		const auto header = reinterpret_cast<const header_t*>(data);
+
+		if (size < sizeof(header_t) || header->magic != prelink::magic || header->version != prelink::version || header->key != key || header->size != size)
+		{
+			return nullptr;
+		}
+
+		if (!prelink::inside(size, header->ranges, header->range_count, sizeof(range_t)) || !prelink::inside(size, header->modules, header->module_count, sizeof(module_t))
+			|| !prelink::inside(size, header->bindings, header->binding_count, sizeof(binding_t)) || header->pool > size || header->image_size < 4)
+		{
+			return nullptr;
+		}
+
+		for (std::uint32_t i = 0; i < header->range_count; i++)
+		{
+			const auto& range = prelink::ranges(header)[i];
+
+			if (!prelink::inside(size, range.offset, range.data, 1) || range.rva > header->image_size || range.commit > header->image_size - range.rva || range.data > range.commit)
+			{
+				return nullptr;
+			}
+		}
+
+		for (std::uint32_t i = 0; i < header->binding_count; i++)
+		{
+			const auto& binding = prelink::bindings(header)[i];
+
+			if (binding.module >= header->module_count || binding.iat > header->image_size - 4)
+			{
+				return nullptr;
+			}
+		}
+
+		return header;
+	}
+
+	static const range_t* ranges(const header_t* header)
+	{
+		return reinterpret_cast<const range_t*>(reinterpret_cast<const char*>(header) + header->ranges);
+	}
+
+	static const module_t* modules(const header_t* header)
+	{
+		return reinterpret_cast<const module_t*>(reinterpret_cast<const char*>(header) + header->modules);
+	}
+
+	static const binding_t* bindings(const header_t* header)
+	{
+		return reinterpret_cast<const binding_t*>(reinterpret_cast<const char*>(header) + header->bindings);
+	}
+
+	static const char* name(const header_t* header, const module_t& module)
+	{
+		return reinterpret_cast<const char*>(header) + header->pool + module.name;
+	}
+
+	//Written next to the target and renamed over it, two launches racing on the same exe never see half a file
+	static bool save(const std::string& path, const std::vector<char>& image)
+	{
+		const auto file = std::filesystem::u8path(path);
+		auto temporary = file;
+		temporary += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+
+		std::error_code ec;
+		std::filesystem::create_directories(file.parent_path(), ec);
+
+		{
+			std::ofstream stream(temporary, std::ios::binary | std::ofstream::out | std::ofstream::trunc);
+			if (!stream.is_open() || !stream.write(image.data(), static_cast<std::streamsize>(image.size())))
+			{
+				return false;
+			}
+		}
+
+		std::filesystem::rename(temporary, file, ec);
+		if (ec)
+		{
+			std::filesystem::remove(temporary, ec);
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	static bool inside(std::size_t size, std::uint32_t offset, std::uint32_t count, std::size_t stride)
+	{
+		return offset <= size && std::uint64_t(count) * stride <= size - offset;
+	}
+};
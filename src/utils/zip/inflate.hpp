@@ -0,0 +1,519 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+//Raw DEFLATE decoder (RFC 1951), the stream zip stores for method 8
+//Decodes a block at a time so a caller can hold a whole entry or only a sliding part of it
+//Compressed bytes are pulled from a callback in pieces, the whole stream never has to be in memory
+class inflate
+{
+public:
+	//Reads size bytes at offset, the same shape the chunk reader takes its bytes in
+	typedef std::function<bool(std::uint64_t offset, void* out, std::uint32_t size)> source_fn;
+
+	//Matches reach back this far, a sliding caller has to keep at least this much of what it already decoded
+	static constexpr std::size_t history = 32 * 1024;
+
+	//stored is how many compressed bytes the stream has, starting at offset
+	inflate(source_fn source, std::uint64_t offset, std::uint64_t stored) : source(std::move(source)), next(offset), end(offset + stored)
+	{
+		this->input.resize(inflate::input_size);
+	}
+
+	//Decodes the next block onto out at written and moves written past it, out grows as needed but never past limit bytes
+	//false for corrupt input or a stream that decodes to more than limit
+	bool block(std::vector<char>& out, std::size_t& written, std::size_t limit)
+	{
+		if (this->last)
+		{
+			return false;
+		}
+
+		this->last = this->take(1);
+
+		bool decoded = false;
+
+		switch (this->take(2))
+		{
+		case 0:
+			decoded = this->stored(out, written, limit);
+			break;
+
+		case 1:
+			if (!this->fixed_built)
+			{
+				this->fixed();
+			}
+
+			decoded = this->codes(this->fixed_lengths, this->fixed_distances, out, written, limit);
+			break;
+
+		case 2:
+			decoded = this->dynamic() && this->codes(this->lengths, this->distances, out, written, limit);
+			break;
+		}
+
+		//Padding past the end of the stream is fine to look at but not to use
+		return decoded && this->count >= this->padded * 8;
+	}
+
+	bool finished() const
+	{
+		return this->last;
+	}
+
+	//Where the next block starts, in bits from offset 0 of the source, only meaningful between blocks
+	std::uint64_t boundary() const
+	{
+		return (this->next - this->available + this->position) * 8 - this->count;
+	}
+
+	//Carries on from a boundary() an earlier decoder of the same stream reported
+	//Matches still reach back into what came before it, the caller puts that history in front of out first
+	void resume(std::uint64_t boundary)
+	{
+		this->next = boundary >> 3;
+		this->position = this->available = 0;
+		this->bits = 0;
+		this->count = 0;
+		this->padded = 0;
+		this->last = false;
+		this->take(static_cast<unsigned>(boundary & 7));
+	}
+
+	//Decodes a whole stream into out, which is already sized to what it decodes to
+	static bool whole(source_fn source, std::uint64_t offset, std::uint64_t stored, std::vector<char>& out)
+	{
+		inflate decoder(std::move(source), offset, stored);
+		std::size_t written = 0;
+
+		while (!decoder.finished())
+		{
+			if (!decoder.block(out, written, out.size()))
+			{
+				return false;
+			}
+		}
+
+		return written == out.size();
+	}
+
+private:
+	static constexpr std::size_t input_size = 64 * 1024;
+	static constexpr unsigned fast_bits = 10;
+	static constexpr unsigned max_bits = 15;
+
+	//A code up to fast_bits long is one table lookup, (symbol << 4) | length, 0 where the code is longer or unused
+	//Longer codes take the canonical walk over counts and symbols
+	struct huffman_t
+	{
+		std::uint16_t fast[1 << inflate::fast_bits];
+		std::uint16_t counts[inflate::max_bits + 1];
+		std::uint16_t symbols[288];
+	};
+
+	source_fn source;
+	std::uint64_t next, end;
+
+	std::vector<std::uint8_t> input;
+	std::size_t position = 0, available = 0;
+	std::uint64_t bits = 0;
+	unsigned count = 0;
+	std::size_t padded = 0;
+
+	bool last = false;
+	bool fixed_built = false;
+
+	huffman_t lengths, distances;
+	huffman_t fixed_lengths, fixed_distances;
+
+	bool refill()
+	{
+		const auto size = static_cast<std::uint32_t>(std::min<std::uint64_t>(this->input.size(), this->end - this->next));
+
+		if (!size || !this->source(this->next, this->input.data(), size))
+		{
+			return false;
+		}
+
+		this->next += size;
+		this->position = 0;
+		this->available = size;
+		return true;
+	}
+
+	//Past the end of the input zeros come in, block() fails if any of them got used
+	void need(unsigned wanted)
+	{
+		if (this->count >= wanted)
+		{
+			return;
+		}
+
+		//Tops the buffer up to at least 56 bits with one load while 8 bytes of input are left
+		if (this->available - this->position >= 8)
+		{
+			std::uint64_t word;
+			std::memcpy(&word, this->input.data() + this->position, sizeof(word));
+
+			this->bits |= word << this->count;
+			this->position += (63 - this->count) >> 3;
+			this->count |= 56;
+			return;
+		}
+
+		while (this->count < wanted)
+		{
+			std::uint64_t byte = 0;
+
+			if (this->position < this->available || this->refill())
+			{
+				byte = this->input[this->position++];
+			}
+			else
+			{
+				this->padded++;
+			}
+
+			this->bits |= byte << this->count;
+			this->count += 8;
+		}
+	}
+
+	void drop(unsigned used)
+	{
+		this->bits >>= used;
+		this->count -= used;
+	}
+
+	std::uint32_t take(unsigned wanted)
+	{
+		if (!wanted)
+		{
+			return 0;
+		}
+
+		this->need(wanted);
+		const auto value = static_cast<std::uint32_t>(this->bits & ((std::uint64_t(1) << wanted) - 1));
+		this->drop(wanted);
+		return value;
+	}
+
+	static std::uint32_t reverse(std::uint32_t code, unsigned length)
+	{
+		std::uint32_t retn = 0;
+
+		for (unsigned i = 0; i < length; i++)
+		{
+			retn = (retn << 1) | ((code >> i) & 1);
+		}
+
+		return retn;
+	}
+
+	//Canonical code from code lengths, false when the lengths describe more codes than fit
+	static bool build(huffman_t& table, const std::uint8_t* code_lengths, unsigned symbols)
+	{
+		std::uint16_t offsets[inflate::max_bits + 2] = {};
+		std::memset(table.counts, 0, sizeof(table.counts));
+		std::memset(table.fast, 0, sizeof(table.fast));
+
+		for (unsigned i = 0; i < symbols; i++)
+		{
+			table.counts[code_lengths[i]]++;
+		}
+
+		table.counts[0] = 0;
+
+		int left = 1;
+		for (unsigned length = 1; length <= inflate::max_bits; length++)
+		{
+			left = (left << 1) - table.counts[length];
+
+			if (left < 0)
+			{
+				return false;
+			}
+		}
+
+		for (unsigned length = 1; length <= inflate::max_bits; length++)
+		{
+			offsets[length + 1] = offsets[length] + table.counts[length];
+		}
+
+		for (unsigned i = 0; i < symbols; i++)
+		{
+			if (code_lengths[i])
+			{
+				table.symbols[offsets[code_lengths[i]]++] = static_cast<std::uint16_t>(i);
+			}
+		}
+
+		//Short codes fill every table entry that starts with their bits, deflate sends codes least significant bit first
+		std::uint32_t code = 0;
+		std::size_t index = 0;
+
+		for (unsigned length = 1; length <= inflate::fast_bits; length++)
+		{
+			for (unsigned i = 0; i < table.counts[length]; i++, index++, code++)
+			{
+				const auto entry = static_cast<std::uint16_t>((table.symbols[index] << 4) | length);
+
+				for (std::uint32_t slot = inflate::reverse(code, length); slot < (1u << inflate::fast_bits); slot += 1u << length)
+				{
+					table.fast[slot] = entry;
+				}
+			}
+
+			code <<= 1;
+		}
+
+		return true;
+	}
+
+	int decode(const huffman_t& table)
+	{
+		this->need(inflate::fast_bits);
+
+		if (const auto entry = table.fast[this->bits & ((1u << inflate::fast_bits) - 1)])
+		{
+			this->drop(entry & 15);
+			return entry >> 4;
+		}
+
+		int code = 0, first = 0, index = 0;
+
+		for (unsigned length = 1; length <= inflate::max_bits; length++)
+		{
+			code |= static_cast<int>(this->take(1));
+			const int count = table.counts[length];
+
+			if (code - count < first)
+			{
+				return table.symbols[index + (code - first)];
+			}
+
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+
+		return -1;
+	}
+
+	static bool reserve(std::vector<char>& out, std::size_t written, std::size_t wanted, std::size_t limit)
+	{
+		if (written + wanted <= out.size())
+		{
+			return true;
+		}
+
+		if (written + wanted > limit)
+		{
+			return false;
+		}
+
+		out.resize(std::min(limit, std::max(written + wanted, out.size() * 2)));
+		return true;
+	}
+
+	bool stored(std::vector<char>& out, std::size_t& written, std::size_t limit)
+	{
+		this->drop(this->count & 7);
+
+		const auto length = this->take(16);
+		if ((length ^ 0xFFFF) != this->take(16) || !inflate::reserve(out, written, length, limit))
+		{
+			return false;
+		}
+
+		for (std::uint32_t i = 0; i < length; i++)
+		{
+			out[written++] = static_cast<char>(this->take(8));
+		}
+
+		return true;
+	}
+
+	void fixed()
+	{
+		std::uint8_t code_lengths[288];
+
+		std::fill(code_lengths, code_lengths + 144, 8);
+		std::fill(code_lengths + 144, code_lengths + 256, 9);
+		std::fill(code_lengths + 256, code_lengths + 280, 7);
+		std::fill(code_lengths + 280, code_lengths + 288, 8);
+		inflate::build(this->fixed_lengths, code_lengths, 288);
+
+		std::fill(code_lengths, code_lengths + 30, 5);
+		inflate::build(this->fixed_distances, code_lengths, 30);
+
+		this->fixed_built = true;
+	}
+
+	bool dynamic()
+	{
+		static const std::uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		const unsigned literal_count = this->take(5) + 257;
+		const unsigned distance_count = this->take(5) + 1;
+		const unsigned header_count = this->take(4) + 4;
+
+		if (literal_count > 286 || distance_count > 30)
+		{
+			return false;
+		}
+
+		std::uint8_t code_lengths[286 + 30] = {};
+
+		for (unsigned i = 0; i < header_count; i++)
+		{
+			code_lengths[order[i]] = static_cast<std::uint8_t>(this->take(3));
+		}
+
+		if (!inflate::build(this->lengths, code_lengths, 19))
+		{
+			return false;
+		}
+
+		//Literal and distance lengths are one run, a repeat may cross from one into the other
+		std::memset(code_lengths, 0, sizeof(code_lengths));
+
+		for (unsigned i = 0; i < literal_count + distance_count;)
+		{
+			const int symbol = this->decode(this->lengths);
+			unsigned repeat = 0;
+			std::uint8_t value = 0;
+
+			if (symbol < 0)
+			{
+				return false;
+			}
+
+			if (symbol < 16)
+			{
+				code_lengths[i++] = static_cast<std::uint8_t>(symbol);
+				continue;
+			}
+
+			if (symbol == 16)
+			{
+				if (!i)
+				{
+					return false;
+				}
+
+				value = code_lengths[i - 1];
+				repeat = 3 + this->take(2);
+			}
+			else if (symbol == 17)
+			{
+				repeat = 3 + this->take(3);
+			}
+			else
+			{
+				repeat = 11 + this->take(7);
+			}
+
+			if (i + repeat > literal_count + distance_count)
+			{
+				return false;
+			}
+
+			std::fill(code_lengths + i, code_lengths + i + repeat, value);
+			i += repeat;
+		}
+
+		//A block has to be able to end
+		if (!code_lengths[256])
+		{
+			return false;
+		}
+
+		return inflate::build(this->lengths, code_lengths, literal_count) && inflate::build(this->distances, code_lengths + literal_count, distance_count);
+	}
+
+	bool codes(const huffman_t& literals, const huffman_t& distances, std::vector<char>& out, std::size_t& written, std::size_t limit)
+	{
+		static const std::uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const std::uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const std::uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const std::uint8_t distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		for (;;)
+		{
+			int symbol = this->decode(literals);
+
+			if (symbol < 0)
+			{
+				return false;
+			}
+
+			if (symbol < 256)
+			{
+				if (written >= out.size() && !inflate::reserve(out, written, 1, limit))
+				{
+					return false;
+				}
+
+				out[written++] = static_cast<char>(symbol);
+				continue;
+			}
+
+			if (symbol == 256)
+			{
+				return true;
+			}
+
+			symbol -= 257;
+			if (symbol >= 29)
+			{
+				return false;
+			}
+
+			const std::size_t length = length_base[symbol] + this->take(length_extra[symbol]);
+			const int distance_symbol = this->decode(distances);
+
+			if (distance_symbol < 0 || distance_symbol >= 30)
+			{
+				return false;
+			}
+
+			const std::size_t distance = distance_base[distance_symbol] + this->take(distance_extra[distance_symbol]);
+
+			if (distance > written || !inflate::reserve(out, written, length, limit))
+			{
+				return false;
+			}
+
+			//Same overlapping copy as the LZ4 decoder, steps no longer than the distance
+			char* to = out.data() + written;
+			const char* from = to - distance;
+
+			if (distance >= length)
+			{
+				std::memcpy(to, from, length);
+			}
+			else if (distance >= 8)
+			{
+				for (std::size_t i = 0; i < length; i += 8)
+				{
+					std::memcpy(to + i, from + i, std::min<std::size_t>(8, length - i));
+				}
+			}
+			else
+			{
+				for (std::size_t i = 0; i < length; i++)
+				{
+					to[i] = from[i];
+				}
+			}
+
+			written += length;
+		}
+	}
+};
@@ -0,0 +1,610 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "inflate.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//Zip archives mounted as part of a layer, read in place instead of extracted
+//Listing maps the central directory and turns it into entries the overlay indexes like files on disk
+//Serving an entry needs only its data offset, stored entries are a range of the archive and deflated ones are decoded on demand
+class zip
+{
+public:
+	static constexpr std::uint16_t method_stored = 0;
+	static constexpr std::uint16_t method_deflated = 8;
+
+	struct entry_t
+	{
+		std::string name; //As stored, directories end in a slash
+		std::uint64_t offset; //Of the entry's data, past its local header
+		std::uint64_t stored;
+		std::uint64_t size;
+		std::uint16_t method;
+	};
+
+	//Reads size bytes of the archive at offset, has to be safe to call from several threads at once
+	typedef inflate::source_fn source_fn;
+
+	//Every entry this reader can serve, encrypted entries and methods other than stored and deflated are left out
+	static bool list(const std::filesystem::path& archive, std::vector<entry_t>& entries)
+	{
+		std::error_code ec;
+		const std::uint64_t size = std::filesystem::file_size(archive, ec);
+
+		//The end record sits in the last 22 bytes plus a comment of up to 64 KB, the zip64 locator right in front of it
+		constexpr std::uint64_t end_size = 22, locator_size = 20, comment_max = 0xFFFF;
+
+		if (ec || size < end_size)
+		{
+			return false;
+		}
+
+		const std::uint64_t tail_size = std::min(size, end_size + locator_size + comment_max);
+		mapping tail(archive, size - tail_size, static_cast<std::size_t>(tail_size));
+
+		if (!tail.data())
+		{
+			return false;
+		}
+
+		const auto tail_data = reinterpret_cast<const std::uint8_t*>(tail.data());
+		std::size_t end = std::string::npos;
+
+		for (std::size_t i = static_cast<std::size_t>(tail_size - end_size) + 1; i-- > 0;)
+		{
+			if (zip::read<std::uint32_t>(tail_data + i) == 0x06054B50 && i + end_size + zip::read<std::uint16_t>(tail_data + i + 20) <= tail_size)
+			{
+				end = i;
+				break;
+			}
+		}
+
+		if (end == std::string::npos)
+		{
+			return false;
+		}
+
+		std::uint64_t count = zip::read<std::uint16_t>(tail_data + end + 10);
+		std::uint64_t directory_size = zip::read<std::uint32_t>(tail_data + end + 12);
+		std::uint64_t directory = zip::read<std::uint32_t>(tail_data + end + 16);
+
+		std::ifstream stream(archive, std::ios::binary);
+
+		//Archives past 4 GB or 65535 entries keep the real numbers in the zip64 end record
+		if ((count == 0xFFFF || directory_size == 0xFFFFFFFF || directory == 0xFFFFFFFF) && end >= locator_size
+			&& zip::read<std::uint32_t>(tail_data + end - locator_size) == 0x07064B50)
+		{
+			std::uint8_t record[56];
+
+			if (!zip::read_at(stream, zip::read<std::uint64_t>(tail_data + end - locator_size + 8), record, sizeof(record)) || zip::read<std::uint32_t>(record) != 0x06064B50)
+			{
+				return false;
+			}
+
+			count = zip::read<std::uint64_t>(record + 32);
+			directory_size = zip::read<std::uint64_t>(record + 40);
+			directory = zip::read<std::uint64_t>(record + 48);
+		}
+
+		if (directory > size || directory_size > size - directory)
+		{
+			return false;
+		}
+
+		mapping central(archive, directory, static_cast<std::size_t>(directory_size));
+		const auto data = reinterpret_cast<const std::uint8_t*>(central.data());
+
+		if (directory_size && !data)
+		{
+			return false;
+		}
+
+		entries.reserve(entries.size() + static_cast<std::size_t>(std::min<std::uint64_t>(count, directory_size / 46)));
+
+		for (std::uint64_t at = 0, i = 0; i < count && at + 46 <= directory_size; i++)
+		{
+			const std::uint8_t* header = data + at;
+
+			if (zip::read<std::uint32_t>(header) != 0x02014B50)
+			{
+				return false;
+			}
+
+			const std::uint16_t flags = zip::read<std::uint16_t>(header + 8);
+			const std::uint16_t method = zip::read<std::uint16_t>(header + 10);
+			std::uint64_t stored = zip::read<std::uint32_t>(header + 20);
+			std::uint64_t unpacked = zip::read<std::uint32_t>(header + 24);
+			const std::uint16_t name_length = zip::read<std::uint16_t>(header + 28);
+			const std::uint16_t extra_length = zip::read<std::uint16_t>(header + 30);
+			const std::uint16_t comment_length = zip::read<std::uint16_t>(header + 32);
+			std::uint64_t local = zip::read<std::uint32_t>(header + 42);
+
+			const std::uint64_t next = at + 46 + name_length + extra_length + comment_length;
+			if (next > directory_size)
+			{
+				return false;
+			}
+
+			//Fields that did not fit are 0xFFFFFFFF and come in this order in the zip64 extra field
+			for (const std::uint8_t* extra = header + 46 + name_length; extra + 4 <= header + 46 + name_length + extra_length;)
+			{
+				const std::uint16_t id = zip::read<std::uint16_t>(extra);
+				const std::uint16_t length = zip::read<std::uint16_t>(extra + 2);
+				const std::uint8_t* field = extra + 4;
+				const std::uint8_t* field_end = std::min(field + length, header + 46 + name_length + extra_length);
+
+				if (id == 0x0001)
+				{
+					for (auto value : { &unpacked, &stored, &local })
+					{
+						if (*value == 0xFFFFFFFF && field + 8 <= field_end)
+						{
+							*value = zip::read<std::uint64_t>(field);
+							field += 8;
+						}
+					}
+				}
+
+				extra = field_end;
+			}
+
+			std::string name(reinterpret_cast<const char*>(header + 46), name_length);
+			at = next;
+
+			if ((flags & 1) || (method != method_stored && method != method_deflated) || !zip::safe(name))
+			{
+				continue;
+			}
+
+			//The local header repeats the name and has its own extra field, the data starts after both
+			std::uint8_t local_header[30];
+
+			if (!zip::read_at(stream, local, local_header, sizeof(local_header)) || zip::read<std::uint32_t>(local_header) != 0x04034B50)
+			{
+				continue;
+			}
+
+			const std::uint64_t offset = local + sizeof(local_header) + zip::read<std::uint16_t>(local_header + 26) + zip::read<std::uint16_t>(local_header + 28);
+
+			if (offset > size || stored > size - offset || (method == method_stored && stored != unpacked))
+			{
+				continue;
+			}
+
+			entries.push_back({ std::move(name), offset, stored, unpacked, method });
+		}
+
+		return true;
+	}
+
+	//Decoded entries shared by every reader, so a file the game opens over and over is only inflated once while it stays in here
+	class cache
+	{
+	public:
+		static constexpr std::size_t budget = 64 * 1024 * 1024;
+
+		static std::shared_ptr<const std::vector<char>> find(const std::string& key)
+		{
+			std::lock_guard<std::mutex> guard(cache::lock);
+
+			const auto it = cache::index.find(key);
+			if (it == cache::index.end())
+			{
+				return nullptr;
+			}
+
+			cache::order.splice(cache::order.begin(), cache::order, it->second);
+			return it->second->second;
+		}
+
+		static void insert(const std::string& key, std::shared_ptr<const std::vector<char>> data)
+		{
+			std::lock_guard<std::mutex> guard(cache::lock);
+
+			if (cache::index.count(key))
+			{
+				return;
+			}
+
+			cache::held += data->size();
+			cache::order.emplace_front(key, std::move(data));
+			cache::index.emplace(key, cache::order.begin());
+
+			//Readers that still hold an evicted entry keep it alive until they close
+			while (cache::held > cache::budget && cache::order.size() > 1)
+			{
+				cache::held -= cache::order.back().second->size();
+				cache::index.erase(cache::order.back().first);
+				cache::order.pop_back();
+			}
+		}
+
+	private:
+		typedef std::list<std::pair<std::string, std::shared_ptr<const std::vector<char>>>> order_t;
+
+		inline static std::mutex lock;
+		inline static order_t order;
+		inline static std::unordered_map<std::string, order_t::iterator> index;
+		inline static std::size_t held = 0;
+	};
+
+	//One entry seen as a file, reads at any offset
+	//Not safe to share between threads, the loader keeps one per handle behind the handle's lock
+	class reader
+	{
+	public:
+		//Deflated entries up to this size are decoded whole into the shared cache, bigger ones are decoded as they are read
+		static constexpr std::uint64_t whole_limit = 16 * 1024 * 1024;
+
+		//Streamed entries leave a restart point in the shared cache about this often, a seek decodes at most this much to get anywhere
+		static constexpr std::uint64_t point_spacing = 1024 * 1024;
+
+		//key names the entry in the shared cache, the archive path and the data offset make a good one
+		bool open(source_fn source, std::string key, std::uint64_t offset, std::uint64_t stored, std::uint64_t size, std::uint16_t method)
+		{
+			if (method != method_stored && method != method_deflated)
+			{
+				return false;
+			}
+
+			this->source = std::move(source);
+			this->key = std::move(key);
+			this->offset = offset;
+			this->stored = stored;
+			this->length = size;
+			this->method = method;
+			return true;
+		}
+
+		std::uint64_t size() const
+		{
+			return this->length;
+		}
+
+		//Same contract as a file read, fewer bytes than asked for only at the end, 0 past it or when the entry is corrupt
+		std::size_t read(std::uint64_t offset, void* out, std::size_t size)
+		{
+			if (offset >= this->length)
+			{
+				return 0;
+			}
+
+			size = static_cast<std::size_t>(std::min<std::uint64_t>(size, this->length - offset));
+
+			if (this->method == method_stored)
+			{
+				return this->source(this->offset + offset, out, static_cast<std::uint32_t>(size)) ? size : 0;
+			}
+
+			if (this->length <= reader::whole_limit)
+			{
+				if (!this->whole && !this->decode_whole())
+				{
+					return 0;
+				}
+
+				std::memcpy(out, this->whole->data() + offset, size);
+				return size;
+			}
+
+			return this->stream(offset, static_cast<char*>(out), size);
+		}
+
+	private:
+		source_fn source;
+		std::string key;
+		std::uint64_t offset = 0, stored = 0, length = 0;
+		std::uint16_t method = method_stored;
+
+		std::shared_ptr<const std::vector<char>> whole;
+
+		//Big entries, a window of decoded bytes that slides forward and jumps to a restart point on a seek back or far ahead
+		std::unique_ptr<inflate> decoder;
+		std::vector<char> window;
+		std::uint64_t window_start = 0;
+		std::size_t window_size = 0;
+		std::uint64_t recorded = 0; //The last restart point this reader knows is in the cache
+
+		bool decode_whole()
+		{
+			if ((this->whole = cache::find(this->key)))
+			{
+				return true;
+			}
+
+			auto data = std::make_shared<std::vector<char>>(static_cast<std::size_t>(this->length));
+
+			if (!inflate::whole(this->source, this->offset, this->stored, *data))
+			{
+				return false;
+			}
+
+			this->whole = data;
+			cache::insert(this->key, data);
+			return true;
+		}
+
+		//Restart points are cache entries of their own, so every reader of the entry shares them and they age out like decoded entries
+		//Point n is the first block boundary at or past n * point_spacing, it holds where that is, the bit the block starts at and the history before it
+		std::string point_key(std::uint64_t point) const
+		{
+			return this->key + "@" + std::to_string(point);
+		}
+
+		void record()
+		{
+			const std::uint64_t end = this->window_start + this->window_size;
+			const std::uint64_t point = end / reader::point_spacing;
+
+			if (point <= this->recorded || this->decoder->finished())
+			{
+				return;
+			}
+
+			const auto history = static_cast<std::size_t>(std::min<std::uint64_t>(inflate::history, end));
+			const std::uint64_t boundary = this->decoder->boundary();
+
+			auto data = std::make_shared<std::vector<char>>(sizeof(end) + sizeof(boundary) + history);
+			std::memcpy(data->data(), &end, sizeof(end));
+			std::memcpy(data->data() + sizeof(end), &boundary, sizeof(boundary));
+			std::memcpy(data->data() + sizeof(end) + sizeof(boundary), this->window.data() + this->window_size - history, history);
+
+			cache::insert(this->point_key(point), std::move(data));
+			this->recorded = point;
+		}
+
+		//The closest restart point at or before offset that is still cached, nullptr for the start of the stream
+		std::shared_ptr<const std::vector<char>> closest(std::uint64_t offset, std::uint64_t& at) const
+		{
+			for (std::uint64_t point = offset / reader::point_spacing; point > 0; point--)
+			{
+				if (auto data = cache::find(this->point_key(point)))
+				{
+					std::memcpy(&at, data->data(), sizeof(at));
+
+					if (at <= offset)
+					{
+						return data;
+					}
+				}
+			}
+
+			at = 0;
+			return nullptr;
+		}
+
+		void restart(const std::shared_ptr<const std::vector<char>>& point, std::uint64_t at)
+		{
+			this->decoder = std::make_unique<inflate>(this->source, this->offset, this->stored);
+			this->window.clear();
+			this->window_start = at;
+			this->window_size = 0;
+			this->recorded = at / reader::point_spacing;
+
+			if (point)
+			{
+				std::uint64_t boundary;
+				std::memcpy(&boundary, point->data() + sizeof(at), sizeof(boundary));
+
+				const std::size_t history = point->size() - sizeof(at) - sizeof(boundary);
+				this->window.assign(point->begin() + sizeof(at) + sizeof(boundary), point->end());
+				this->window_start = at - history;
+				this->window_size = history;
+				this->decoder->resume(boundary);
+			}
+		}
+
+		std::size_t stream(std::uint64_t offset, char* out, std::size_t size)
+		{
+			const std::uint64_t end = this->window_start + this->window_size;
+
+			//Decoding on from where the window is beats a jump unless the jump lands past it
+			if (!this->decoder || offset < this->window_start || offset >= end + reader::point_spacing)
+			{
+				std::uint64_t at;
+				const auto point = this->closest(offset, at);
+
+				if (!this->decoder || offset < this->window_start || at > end)
+				{
+					this->restart(point, at);
+				}
+			}
+
+			while (offset + size > this->window_start + this->window_size)
+			{
+				//Everything before the read and the history matches need can go, the rest moves to the front
+				const std::uint64_t keep_from = std::min<std::uint64_t>(offset, this->window_start + this->window_size - std::min<std::size_t>(this->window_size, inflate::history));
+
+				if (keep_from > this->window_start && this->window_size > 4 * inflate::history)
+				{
+					const auto drop = static_cast<std::size_t>(keep_from - this->window_start);
+
+					std::memmove(this->window.data(), this->window.data() + drop, this->window_size - drop);
+					this->window_start += drop;
+					this->window_size -= drop;
+				}
+
+				const auto limit = static_cast<std::size_t>(this->length - this->window_start);
+
+				if (this->decoder->finished() || !this->decoder->block(this->window, this->window_size, limit))
+				{
+					this->decoder.reset();
+					return 0;
+				}
+
+				this->record();
+			}
+
+			std::memcpy(out, this->window.data() + (offset - this->window_start), size);
+			return size;
+		}
+	};
+
+	//Writes an entry out as a plain file, for when the game wants to write to one
+	static bool extract(const std::filesystem::path& archive, std::uint64_t offset, std::uint64_t stored, std::uint64_t size, std::uint16_t method, const std::filesystem::path& to)
+	{
+		std::ifstream in(archive, std::ios::binary);
+		reader entry;
+
+		const bool opened = entry.open([&](std::uint64_t at, void* out, std::uint32_t count)
+		{
+			return zip::read_at(in, at, out, count);
+		}, archive.u8string() + ":" + std::to_string(offset), offset, stored, size, method);
+
+		if (!opened)
+		{
+			return false;
+		}
+
+		std::ofstream out(to, std::ios::binary | std::ios::trunc);
+		std::vector<char> buffer(1024 * 1024);
+
+		for (std::uint64_t at = 0; at < size; at += buffer.size())
+		{
+			const std::size_t count = entry.read(at, buffer.data(), buffer.size());
+
+			if (!count)
+			{
+				return false;
+			}
+
+			out.write(buffer.data(), count);
+		}
+
+		return out.good();
+	}
+
+private:
+	//Read only view of part of a file, the offset does not have to be aligned
+	class mapping
+	{
+	public:
+		mapping(const std::filesystem::path& file, std::uint64_t offset, std::size_t size)
+		{
+			if (!size)
+			{
+				return;
+			}
+
+#ifdef _WIN32
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			this->skip = static_cast<std::size_t>(offset % info.dwAllocationGranularity);
+
+			HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+
+			HANDLE section = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(handle);
+
+			if (!section)
+			{
+				return;
+			}
+
+			const std::uint64_t start = offset - this->skip;
+			this->view = MapViewOfFile(section, FILE_MAP_READ, static_cast<DWORD>(start >> 32), static_cast<DWORD>(start), size + this->skip);
+			CloseHandle(section);
+#else
+			this->skip = static_cast<std::size_t>(offset % static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE)));
+
+			const int handle = open(file.c_str(), O_RDONLY);
+			if (handle < 0)
+			{
+				return;
+			}
+
+			void* view = mmap(nullptr, size + this->skip, PROT_READ, MAP_PRIVATE, handle, static_cast<off_t>(offset - this->skip));
+			close(handle);
+
+			this->view = view != MAP_FAILED ? view : nullptr;
+#endif
+			this->size = size + this->skip;
+		}
+
+		~mapping()
+		{
+			if (this->view)
+			{
+#ifdef _WIN32
+				UnmapViewOfFile(this->view);
+#else
+				munmap(this->view, this->size);
+#endif
+			}
+		}
+
+		mapping(const mapping&) = delete;
+		mapping& operator=(const mapping&) = delete;
+
+		const char* data() const
+		{
+			return this->view ? static_cast<const char*>(this->view) + this->skip : nullptr;
+		}
+
+	private:
+		void* view = nullptr;
+		std::size_t size = 0;
+		std::size_t skip = 0;
+	};
+
+	template <typename T> static T read(const std::uint8_t* data)
+	{
+		T value;
+		std::memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	static bool read_at(std::ifstream& stream, std::uint64_t offset, void* out, std::size_t size)
+	{
+		stream.clear();
+		stream.seekg(static_cast<std::streamoff>(offset));
+		return static_cast<bool>(stream.read(static_cast<char*>(out), static_cast<std::streamsize>(size)));
+	}
+
+	//Names end up as overlay keys under the game dir, nothing may climb out of it
+	static bool safe(const std::string& name)
+	{
+		if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos)
+		{
+			return false;
+		}
+
+		for (std::size_t start = 0; start <= name.size();)
+		{
+			auto end = name.find_first_of("/\\", start);
+			end = end == std::string::npos ? name.size() : end;
+
+			if (name.compare(start, end - start, "..") == 0)
+			{
+				return false;
+			}
+
+			start = end + 1;
+		}
+
+		return true;
+	}
+};